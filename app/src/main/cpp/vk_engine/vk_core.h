@@ -14,14 +14,36 @@
  * limitations under the License.
  */
 
+#pragma once
+
+#include "vk_core/vk_asset_streamer.h"
+#include "vk_core/vk_command_recorder.h"
+#include "vk_core/vk_bvh.h"
+#include "vk_core/vk_culling.h"
+#include "vk_core/vk_culling_benchmark.h"
 #include "vk_core/vk_descriptor.h"
+#include "vk_core/vk_filesystem.h"
+#include "vk_core/vk_frame_pacer.h"
+#include "vk_core/vk_frame_scheduler.h"
+#include "vk_core/vk_gpu_culling.h"
+#include "vk_core/vk_instance_benchmark.h"
+#include "vk_core/vk_instance_buffer.h"
+#include "vk_core/vk_lod.h"
+#include "vk_core/vk_meshlet.h"
+#include "vk_core/vk_mesh.h"
+#include "vk_core/vk_mesh_optimizer.h"
+#include "vk_core/vk_pipeline_cache.h"
+#include "vk_core/vk_pipeline_manager.h"
+#include "vk_core/vk_uniform_ring.h"
 
 #include <array>
+#include <cmath>
 #include <fstream>
 #include <map>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 /**
@@ -34,19 +56,87 @@
 
 using namespace vkt;
 
+/*
+ * Inline records the whole render pass on the render thread. MultiThreaded
+ * spreads the draw list over CommandRecorder workers, which pays off once the
+ * scene has more than a handful of draws. Cached keeps one pre-recorded
+ * command buffer per frame slot and swapchain image and only re-records it
+ * after a structural change, since per-frame data reaches the GPU through the
+ * uniform buffers alone.
+ */
+enum class RecordingMode {
+    Inline,
+    MultiThreaded,
+    Cached
+};
+
+/*
+ * Indexed draws every visible instance's mesh in one draw. Meshlets splits
+ * each instance into one draw per meshlet, so the GPU culler can also drop
+ * clusters facing away from the camera or outside the frustum on their own.
+ * Meshlet draws are GPU-driven; frames culled on the CPU stay indexed.
+ */
+enum class GeometryMode {
+    Indexed,
+    Meshlets
+};
+
 class VKCore {
 public:
     void initVulkan();
     void render();
     void cleanup();
     void cleanupSwapChain();
-    void reset(ANativeWindow *newWindow, AAssetManager *newManager);
+    void reset(ANativeWindow *newWindow, AAssetManager *newManager,
+               const std::string &newDataPath);
+    void setFramesInFlight(uint32_t count);
+    void setRecordingMode(RecordingMode mode);
+    void setGeometryMode(GeometryMode mode);
+    void setPresentProfile(PresentProfile profile);
+    void setDrawList(const std::vector<DrawCommand> &draws);
+    void setInstances(const std::vector<InstanceData> &instances);
+    void updateInstance(uint32_t index, const InstanceData &instance);
+    std::optional<uint32_t> pickInstance(const glm::vec2 &position);
+    StreamingStats getStreamingStats() const;
+    const PresentStats& getPresentStats() const { return presentStats.getStats(); }
+    void waitIdle();
+    void savePipelineCache();
     bool initialized = false;
 
 private:
     std::unique_ptr<Device> device;
+    std::unique_ptr<MemoryAllocator> allocator;
+    std::unique_ptr<PipelineCache> pipelineCache;
+    std::unique_ptr<PipelineManager> pipelineManager;
     std::unique_ptr<SwapChain> swapChain;
     std::unique_ptr<Descriptor> descriptor;
+    std::unique_ptr<FrameScheduler> scheduler;
+    std::unique_ptr<CommandRecorder> recorder;
+    std::unique_ptr<StagingUploader> uploader;
+    // Generated at startup, drawn until the streamed scene mesh is resident
+    // and then retired to the streamer.
+    std::unique_ptr<Mesh> cubeMesh;
+    // Mesh every instance draws: cubeMesh or the streamed mesh.
+    const Mesh *sceneMesh = nullptr;
+    // Kept on the CPU for picking.
+    MeshData cubeData;
+    // How meshes store vertices for the GPU. The graphics pipeline is built
+    // for it, so it has to be settled before initVulkan; a mesh loaded from
+    // CUBE_MESH_PATH replaces it with its own. shader.vert reads positions
+    // and colours only.
+    VertexFormat vertexFormat;
+    static constexpr const char *CUBE_MESH_PATH = "meshes/cube.mesh";
+    std::unique_ptr<AssetStreamer> streamer;
+    static constexpr uint32_t NO_ASSET = UINT32_MAX;
+    uint32_t cubeAsset = NO_ASSET;
+    // Compiled for the streamed mesh's vertex format when it differs.
+    PipelineHandle streamedPipeline;
+    std::unique_ptr<InstanceBuffer> instanceBuffer;
+    std::unique_ptr<InstanceBenchmark> instanceBenchmark;
+    // Frames the benchmark has animated, which picks the window of
+    // instances animated next.
+    uint32_t animatedFrame = 0;
+    std::unique_ptr<GpuCuller> gpuCuller;
 
     void createInstance();
     void createSurface();
@@ -54,21 +144,42 @@ private:
     void createRenderPass();
     //void createDescriptorSetLayout();
     void setPipeline();
+    VkPipeline createGraphicsPipeline();
     void createFramebuffers();
     void createCommandPool();
+    void createMeshes();
+    void adoptStreamedMesh();
     void createCommandBuffer();
     void createSyncObjects();
+    void createCommandRecorder();
+    void invalidateCommandBuffers();
+    void freeCachedCommandBuffers();
+    VkCommandBuffer getCachedCommandBuffer(uint32_t frameSlot, uint32_t imageIndex);
     bool checkValidationLayerSupport();
     std::vector<const char *> getRequiredExtensions(bool enableValidation);
-    VkShaderModule createShaderModule(const std::vector<uint8_t> &code);
     void drawFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex);
-    void recreateSwapChain();
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount);
+    void recreateSwapChain(bool newWindow = false);
+    void resetFramePacer();
+    bool isFramePaced() const;
+    void updateFramePacer(std::chrono::steady_clock::time_point frameStart,
+                          const std::vector<VkPastPresentationTimingGOOGLE> &timings);
+    void destroyRetiredSwapChains(bool all);
     void onOrientationChange();
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                      VkDeviceMemory &bufferMemory);
-    void createUniformBuffers();
-    void updateUniformBuffers(uint32_t currentImage);
+                      MemoryAllocation &bufferMemory,
+                      AllocationStrategy strategy = AllocationStrategy::Buddy);
+    void createUniformRing();
+    void updateUniformBuffers(uint32_t frameSlot);
+    void updateDescriptorSet();
+    void stepInstanceBenchmark(float frameMs, float cpuMs);
+    void createGpuCuller();
+    void checkGpuCulling(uint32_t frameSlot);
+    uint32_t cullInstanceDraws();
+    float computeSceneStreamingPriority(uint32_t visibleCount);
+    void refitInstanceBvh();
+    void updateGpuObjects();
 
     /*
      * In order to enable validation layer toggle this to true and
@@ -80,12 +191,83 @@ private:
      */
     bool enableValidationLayers = false;
 
+    /*
+     * Toggle this to true to replace the scene with a growing grid of cubes
+     * and log frame and CPU time for each instance count. A small share of
+     * the instances is animated every frame to exercise partial streaming.
+     */
+    bool runInstanceBenchmark = false;
+
+    /*
+     * GPU-driven rendering culls and emits the instance draws in a compute
+     * pass; it needs the multiDrawIndirect and drawIndirectFirstInstance
+     * features and otherwise stays off. With validateGpuCulling every draw
+     * count the GPU produces is compared against a CPU reference once its
+     * frame has retired, which costs a full CPU cull per frame.
+     */
+    bool enableGpuCulling = true;
+    bool validateGpuCulling = false;
+
+    /*
+     * Frames drawn from the draw list cull the instances set through
+     * setInstances on the CPU and only draw the visible runs, walking
+     * instanceBvh or, with enableBvhCulling off, testing every instance with
+     * SIMD. Toggle runCullingBenchmark to log the CPU culling throughput of
+     * every compiled ISA on the first frame.
+     */
+    bool enableCpuCulling = true;
+    bool enableBvhCulling = true;
+
+    /*
+     * Draws every instance culled on the CPU at the coarsest level of detail
+     * whose error stays under a pixel on screen. Without it, and on the
+     * GPU-driven path, instances are drawn at full detail.
+     */
+    bool enableLod = true;
+    bool runCullingBenchmark = false;
+
+    /*
+     * Device-local memory streamed assets may occupy. Past it, the least
+     * recently used assets are evicted to make room.
+     */
+    VkDeviceSize streamingBudget = 128 * 1024 * 1024;
+
+    /*
+     * Samples per pixel, lowered to what the device supports. Multisampled
+     * color and depth stay in tile memory on tile-based GPUs and are
+     * resolved into the swapchain image within the render pass, so only the
+     * resolved image is ever written to memory. Set it to
+     * VK_SAMPLE_COUNT_1_BIT to disable multisampling.
+     */
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_4_BIT;
+
+    /*
+     * On rotation or resize the swapchain is recreated with the old one as
+     * oldSwapchain, while the frames in flight keep rendering to it; it is
+     * destroyed once they and its presents have completed. Toggle this to
+     * false to drain the GPU with vkDeviceWaitIdle instead. Every
+     * recreation logs how long it stalled the render thread.
+     */
+    bool handOffSwapChain = true;
+
+    /*
+     * With FIFO present modes, holds frames to a steady 60, 30 or 20 fps on
+     * a 60 Hz display rather than letting a frame that misses vsync show
+     * for twice as long as its neighbours. Presents are scheduled through
+     * VK_GOOGLE_display_timing where available; otherwise vsync is
+     * predicted from when images are acquired. See FramePacer.
+     */
+    bool enableFramePacing = true;
+
     const std::vector<const char *> validationLayers = {
             "VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> deviceExtensions = {
             VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     std::unique_ptr<ANativeWindow, ANativeWindowDeleter> window;
     AAssetManager *assetManager;
+    std::unique_ptr<FileSystem> fileSystem;
+    // App-private storage, used to persist the pipeline cache.
+    std::string dataPath;
 
     VkInstance instance;
     VkSurfaceKHR surface;
@@ -93,21 +275,94 @@ private:
     VkDebugUtilsMessengerEXT debugMessenger;
 
     std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    // Swapchains replaced by recreateSwapChain, with what was created for
+    // them, waiting for the last frame rendering to them.
+    struct RetiredSwapChain {
+        std::unique_ptr<SwapChain> swapChain;
+        std::vector<VkFramebuffer> framebuffers;
+        // Cached command buffers, when the image count changed.
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint64_t frameValue;
+    };
+    std::vector<RetiredSwapChain> retiredSwapChains;
+
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // RecordingMode::Cached state, indexed by [frameSlot * imageCount + imageIndex].
+    // A cached buffer is valid while its generation matches commandGeneration.
+    std::vector<VkCommandBuffer> cachedCommandBuffers;
+    std::vector<uint64_t> cachedGenerations;
+    uint64_t commandGeneration = 1;
+
     VkRenderPass renderPass;
+    // msaaSamples as supported by the device, fixed for the render pass'
+    // lifetime.
+    VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    // Compiled in the background; draws are skipped until it is ready.
+    PipelineHandle graphicsPipeline;
+    // graphicsPipeline as resolved at the start of the frame, so that every
+    // recording thread sees the same pipeline.
+    VkPipeline framePipeline = VK_NULL_HANDLE;
+    // Whether this frame's draws come from the GpuCuller, decided together
+    // with framePipeline.
+    bool frameGpuDriven = false;
+    uint64_t seenPublishedPipelines = 0;
+
+    // Per-frame uniform data is suballocated from the ring. The scene UBO is
+    // the first allocation of every frame, so its offset only depends on the
+    // frame slot, which keeps RecordingMode::Cached buffers valid.
+    static constexpr VkDeviceSize UNIFORM_RING_FRAME_CAPACITY = 64 * 1024;
+    std::unique_ptr<UniformRing> uniformRing;
+    uint32_t sceneUniformOffset = 0;
+    // Like sceneUniformOffset, the instance region only depends on the frame
+    // slot.
+    uint32_t instanceOffset = 0;
+    uint32_t cullUniformOffset = 0;
+    // Clip matrix of the scene's model space for the last frame, and the
+    // frustum extracted from it.
+    glm::mat4 frameClip{1.0f};
+    Frustum frameFrustum;
+    glm::vec3 frameCameraPosition{0.0f};
+    // Per frame slot, the draw count validateGpuCulling expects from the GPU,
+    // or UINT32_MAX when the slot was not culled on the GPU.
+    std::vector<uint32_t> expectedDrawCounts;
+
+    // Scene-space bounds of every instance, kept in step with the instance
+    // data. The draw list only holds visible runs of instances while
+    // instanceDrawList is set, that is until setDrawList replaces it.
+    SphereBounds instanceBounds;
+    Bvh instanceBvh;
+    LodSelector lodSelector;
+    std::vector<uint32_t> visibleInstances;
+    std::vector<DrawCommand> culledDrawList;
+    bool instanceDrawList = false;
+
+    /*
+     * Higher values let the CPU run further ahead of the GPU, trading input
+     * latency for throughput. See setFramesInFlight.
+     */
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    /*
+     * Present mode, swapchain image count and frame rate cap, traded off
+     * between latency, throughput and power. See setPresentProfile.
+     */
+    PresentProfile presentProfile = PresentProfile::Throughput;
+    PresentStatsTracker presentStats;
+    FramePacer framePacer;
+    uint32_t nextPresentId = 0;
+    // Swap interval last logged, 0 before the first paced frame.
+    uint32_t pacedSwapInterval = 0;
+    RecordingMode recordingMode = RecordingMode::Inline;
+    GeometryMode geometryMode = GeometryMode::Indexed;
 
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    // A single draw of the whole cube mesh.
+    std::vector<DrawCommand> drawList = {{36, 1, 0, 0, 0}};
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
+    std::chrono::steady_clock::time_point lastFrameTime;
 
-    uint32_t currentFrame = 0;
     bool orientationChanged = false;
 };
 
@@ -115,31 +370,52 @@ void VKCore::initVulkan() {
     createInstance();
     createSurface();
     device = std::make_unique<Device>(instance, surface);
+    allocator = std::make_unique<MemoryAllocator>(*device);
+    pipelineCache = std::make_unique<PipelineCache>(
+            *device, dataPath.empty() ? "" : dataPath + "/pipeline_cache.bin");
+    pipelineManager = std::make_unique<PipelineManager>(*device);
 
     setupDebugMessenger();
 
-    swapChain = std::make_unique<SwapChain>(*device);
+    sampleCount = device->findSampleCount(msaaSamples);
+    swapChain = std::make_unique<SwapChain>(*device, *allocator, sampleCount, presentProfile);
+    presentStats.reset(presentProfile, swapChain->getPresentConfig());
+    resetFramePacer();
     createRenderPass();
-    createUniformBuffers();
-
-    descriptor = std::make_unique<Descriptor>(*device, uniformBuffers);
+    createUniformRing();
+    instanceBuffer = std::make_unique<InstanceBuffer>(*device, *allocator, 1, framesInFlight);
+
+    descriptor = std::make_unique<Descriptor>(*device, uniformRing->getBuffer(),
+                                              instanceBuffer->getBuffer(),
+                                              instanceBuffer->getRange());
+    // The mesh decides the vertex format the pipeline is built for.
+    createMeshes();
     setPipeline();
     createFramebuffers();
     createCommandPool();
+    createGpuCuller();
+    setInstances(createInstanceGrid(1));
     createCommandBuffer();
     createSyncObjects();
+    createCommandRecorder();
     initialized = true;
+
+    if (runInstanceBenchmark) {
+        instanceBenchmark = std::make_unique<InstanceBenchmark>();
+        animatedFrame = 0;
+        setInstances(createInstanceGrid(instanceBenchmark->getInstanceCount()));
+    }
 }
 
 /*
  *	Create a buffer with specified usage and memory properties
  *	i.e a uniform buffer which uses HOST_COHERENT memory
- *  Upon creation, these buffers will list memory requirements which need to be
- *  satisfied by the device in use in order to be created.
+ *  The memory is suballocated from the allocator's pools, so it has to be
+ *  released with allocator->free rather than vkFreeMemory.
  */
 void VKCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                           VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                          VkDeviceMemory &bufferMemory) {
+                          MemoryAllocation &bufferMemory, AllocationStrategy strategy) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -148,94 +424,650 @@ void VKCore::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 
     VK_CHECK(vkCreateBuffer(device->getDevice(), &bufferInfo, nullptr, &buffer));
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device->getDevice(), buffer, &memRequirements);
+    bufferMemory = allocator->allocateBuffer(buffer, properties, 0, strategy);
+}
+
+/*
+ * Generates the cube drawn at startup and starts streaming the scene mesh
+ * from CUBE_MESH_PATH, built by tools/mesh_converter, in case the APK ships
+ * one; see adoptStreamedMesh.
+ */
+void VKCore::createMeshes() {
+    uploader = std::make_unique<StagingUploader>(*device, *allocator);
+    streamer = std::make_unique<AssetStreamer>(*device, *allocator, *fileSystem, streamingBudget);
+    cubeAsset = streamer->addMesh(CUBE_MESH_PATH, true);
+
+    cubeData = createCubeMesh();
+    generateLods(cubeData);
+    buildMeshlets(cubeData);
+    std::vector<MeshOptimizationReport> reports = optimizeMeshes({&cubeData});
+    logMeshOptimizationReport("cube", reports[0]);
+    cubeMesh = std::make_unique<Mesh>(*device, *allocator, *uploader, cubeData, vertexFormat);
+    sceneMesh = cubeMesh.get();
+    logVertexSizeReport(vertexFormat, cubeData.vertices);
+}
+
+/*
+ * Replaces the generated cube with the streamed scene mesh once it is
+ * resident. A mesh in another vertex format first waits for a pipeline
+ * compiled for that format in the background. The switch never waits for
+ * the GPU: the per-instance state is rebuilt through the per-slot streams
+ * of setInstances, and the cube is destroyed by the streamer once the
+ * frames in flight that draw it have completed.
+ */
+void VKCore::adoptStreamedMesh() {
+    const Mesh *mesh = streamer->getMesh(cubeAsset);
+    if (mesh == nullptr || mesh == sceneMesh) {
+        return;
+    }
+    if (mesh->getVertexFormat() != vertexFormat || streamedPipeline.isValid()) {
+        if (!streamedPipeline.isValid()) {
+            // The current pipeline has to be built before vertexFormat
+            // changes under it.
+            if (!graphicsPipeline.isReady()) {
+                return;
+            }
+            vertexFormat = mesh->getVertexFormat();
+            streamedPipeline = pipelineManager->compile(
+                    "cube streamed", [this] { return createGraphicsPipeline(); });
+        }
+        if (streamedPipeline.hasFailed()) {
+            LOG_ERR("No pipeline for the vertex format of %s", CUBE_MESH_PATH);
+            cubeAsset = NO_ASSET;
+            return;
+        }
+        if (!streamedPipeline.isReady()) {
+            return;
+        }
+        graphicsPipeline = streamedPipeline;
+        streamedPipeline = PipelineHandle();
+    }
+
+    if (cubeMesh) {
+        streamer->retire(std::move(cubeMesh), scheduler->getSubmittedValue());
+    }
+    sceneMesh = mesh;
+    cubeData = *streamer->getMeshData(cubeAsset);
+    std::vector<InstanceData> instances;
+    for (uint32_t i = 0; i < instanceBuffer->getCount(); i++) {
+        instances.push_back(instanceBuffer->get(i));
+    }
+    setInstances(instances);
+    invalidateCommandBuffers();
+    LOG_INFO("Drawing %s: %u vertices", CUBE_MESH_PATH, sceneMesh->getVertexCount());
+}
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = device->findMemoryType(memRequirements.memoryTypeBits, properties);
+/*
+ * Residency of the streamed assets, see AssetStreamer.
+ */
+StreamingStats VKCore::getStreamingStats() const {
+    return streamer ? streamer->getStats() : StreamingStats();
+}
 
-    VK_CHECK(vkAllocateMemory(device->getDevice(), &allocInfo, nullptr, &bufferMemory));
+void VKCore::createGpuCuller() {
+    expectedDrawCounts.assign(framesInFlight, UINT32_MAX);
+    if (!enableGpuCulling) {
+        return;
+    }
+    if (!device->supportsMultiDrawIndirect()) {
+        LOG_INFO("GPU culling unavailable: multiDrawIndirect and drawIndirectFirstInstance are "
+                 "required");
+        return;
+    }
+    gpuCuller = std::make_unique<GpuCuller>(*device, *allocator, *pipelineManager, *pipelineCache,
+                                            *fileSystem, framesInFlight);
+    updateDescriptorSet();
+}
 
-    vkBindBufferMemory(device->getDevice(), buffer, bufferMemory, 0);
+void VKCore::createUniformRing() {
+    uniformRing = std::make_unique<UniformRing>(*device, *allocator,
+                                                UNIFORM_RING_FRAME_CAPACITY, framesInFlight);
 }
 
-void VKCore::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+/*
+ * Changes how many frames the CPU may record ahead of the GPU. Once Vulkan is
+ * up this drains the queue and resizes every per-frame ring, so it is meant for
+ * configuration changes rather than per-frame use.
+ */
+void VKCore::setFramesInFlight(uint32_t count) {
+    count = std::clamp(count, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+    if (count == framesInFlight) {
+        return;
+    }
+    framesInFlight = count;
+    if (!initialized) {
+        return;
+    }
+
+    // Present operations may still reference the per-slot semaphores.
+    vkDeviceWaitIdle(device->getDevice());
+    // The new scheduler counts frames from zero again, and latency depends
+    // on the frame count.
+    destroyRetiredSwapChains(true);
+    presentStats.logStats();
+    presentStats.reset(presentProfile, swapChain->getPresentConfig());
+    freeCachedCommandBuffers();
+    recorder = nullptr;
+    scheduler = nullptr;
+    uniformRing = nullptr;
+    createUniformRing();
+    instanceBuffer->reallocate(instanceBuffer->getCapacity(), framesInFlight);
+    if (gpuCuller) {
+        gpuCuller->setFramesInFlight(framesInFlight);
+    }
+    expectedDrawCounts.assign(framesInFlight, UINT32_MAX);
+    updateDescriptorSet();
+
+    vkFreeCommandBuffers(device->getDevice(), commandPool,
+                         static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    createCommandBuffer();
+    createSyncObjects();
+    createCommandRecorder();
+}
+
+/*
+ * Switches present profiles at runtime by handing the swapchain off to one
+ * created for the new profile. The stats of the old profile are logged and
+ * measuring starts over.
+ */
+void VKCore::setPresentProfile(PresentProfile profile) {
+    if (profile == presentProfile) {
+        return;
+    }
+    presentProfile = profile;
+    if (!initialized) {
+        return;
+    }
+
+    presentStats.logStats();
+    recreateSwapChain();
+    presentStats.reset(presentProfile, swapChain->getPresentConfig());
+}
+
+void VKCore::setGeometryMode(GeometryMode mode) {
+    if (mode == geometryMode) {
+        return;
+    }
+    geometryMode = mode;
+    if (!initialized || !gpuCuller) {
+        return;
+    }
+
+    updateGpuObjects();
+    invalidateCommandBuffers();
+}
+
+/*
+ * Hands the GPU culler one object per instance, or per meshlet of every
+ * instance in GeometryMode::Meshlets. Frames in flight keep culling their
+ * own copy of the old objects; only outgrowing the culler's capacity waits
+ * for them.
+ */
+void VKCore::updateGpuObjects() {
+    uint32_t count = instanceBuffer->getCount();
+    std::vector<GpuObject> objects;
+    if (geometryMode == GeometryMode::Meshlets) {
+        const std::vector<Meshlet> &meshlets = sceneMesh->getMeshlets();
+        objects.reserve(static_cast<size_t>(count) * meshlets.size());
+        for (uint32_t i = 0; i < count; i++) {
+            for (const auto &meshlet : meshlets) {
+                objects.push_back({meshlet.boundingSphere, meshlet.cone,
+                                   meshlet.triangleCount * 3, meshlet.firstIndex, 0, i});
+            }
+        }
+    } else {
+        objects.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            objects.push_back({sceneMesh->getBoundingSphere(), glm::vec4(0.0f),
+                               sceneMesh->getIndexCount(), 0, 0, i});
+        }
+    }
+    if (objects.size() > gpuCuller->getCapacity()) {
+        vkDeviceWaitIdle(device->getDevice());
+    }
+    gpuCuller->setObjects(objects);
+}
+
+void VKCore::setRecordingMode(RecordingMode mode) {
+    if (mode == recordingMode) {
+        return;
+    }
+    recordingMode = mode;
+    if (!initialized) {
+        return;
+    }
+
+    // Worker pools and cached buffers may still be in use by frames in flight.
+    scheduler->waitIdle();
+    freeCachedCommandBuffers();
+    createCommandRecorder();
+}
+
+/*
+ * Only the CPU-driven path walks the draw list; GPU-driven frames draw the
+ * objects set up by setInstances.
+ */
+void VKCore::setDrawList(const std::vector<DrawCommand> &draws) {
+    drawList = draws;
+    instanceDrawList = false;
+    invalidateCommandBuffers();
+}
+
+/*
+ * Replaces the instanced scene and draws all of it with the cube mesh in a
+ * single call, or with one culled indirect draw per instance when GPU culling
+ * is on. Growing past the current capacity drains the queue and reallocates
+ * to the next power of two, so steady scenes should size their first call
+ * generously. Within capacity the instances and the GPU culler's objects are
+ * only queued for streaming into each frame slot, and nothing waits.
+ */
+void VKCore::setInstances(const std::vector<InstanceData> &instances) {
+    uint32_t count = static_cast<uint32_t>(instances.size());
+    if (count > instanceBuffer->getCapacity()) {
+        vkDeviceWaitIdle(device->getDevice());
+        uint32_t capacity = instanceBuffer->getCapacity();
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        instanceBuffer->reallocate(capacity, framesInFlight);
+        updateDescriptorSet();
+    }
+    instanceBuffer->assign(instances);
+
+    glm::vec4 meshSphere = sceneMesh->getBoundingSphere();
+    std::vector<Aabb> boxes(count);
+    instanceBounds.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        instanceBounds.set(i, transformSphere(instances[i].model, meshSphere));
+        boxes[i] = transformAabb(instances[i].model, sceneMesh->getBounds());
+    }
+    instanceBvh.build(boxes);
+    lodSelector.resize(count);
+
+    if (gpuCuller) {
+        updateGpuObjects();
+    }
+    setDrawList({{sceneMesh->getIndexCount(), count, 0, 0, 0}});
+    instanceDrawList = true;
+}
+
+/*
+ * Changes one instance. Only changed instances are copied to the GPU, and
+ * recorded command buffers stay valid.
+ */
+void VKCore::updateInstance(uint32_t index, const InstanceData &instance) {
+    instanceBuffer->set(index, instance);
+    instanceBounds.set(index, transformSphere(instance.model, sceneMesh->getBoundingSphere()));
+    instanceBvh.update(index, transformAabb(instance.model, sceneMesh->getBounds()));
+}
+
+/*
+ * Returns the instance under position, in normalized device coordinates of
+ * the last frame, if any. instanceBvh narrows the ray down to the instances
+ * whose bounds it crosses, which are then tested triangle by triangle in
+ * their own space.
+ */
+std::optional<uint32_t> VKCore::pickInstance(const glm::vec2 &position) {
+    refitInstanceBvh();
+
+    glm::mat4 inverseClip = glm::inverse(frameClip);
+    glm::vec4 near = inverseClip * glm::vec4(position, -1.0f, 1.0f);
+    glm::vec4 far = inverseClip * glm::vec4(position, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(near) / near.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(far) / far.w - origin);
+
+    auto hitCube = [&](uint32_t instance, float &distance) {
+        // Distances along an affinely transformed ray stay comparable.
+        glm::mat4 toInstance = glm::inverse(instanceBuffer->get(instance).model);
+        glm::vec3 localOrigin = glm::vec3(toInstance * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(toInstance * glm::vec4(direction, 0.0f));
+
+        distance = INFINITY;
+        const auto &indices = cubeData.indices;
+        const MeshLod &lod = cubeData.lods[0];
+        for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3) {
+            glm::vec2 barycentric;
+            float triangleDistance;
+            if (glm::intersectRayTriangle(localOrigin, localDirection,
+                                          cubeData.vertices[indices[i]].position,
+                                          cubeData.vertices[indices[i + 1]].position,
+                                          cubeData.vertices[indices[i + 2]].position,
+                                          barycentric, triangleDistance) &&
+                triangleDistance >= 0.0f) {
+                distance = std::min(distance, triangleDistance);
+            }
+        }
+        return distance < INFINITY;
+    };
+
+    RayHit hit;
+    if (!instanceBvh.raycast(origin, direction, hit, hitCube)) {
+        return std::nullopt;
+    }
+    return hit.primitive;
+}
+
+/*
+ * Applies instance updates to instanceBvh, rebuilding it once refitting has
+ * made it too loose to cull efficiently.
+ */
+void VKCore::refitInstanceBvh() {
+    instanceBvh.refit();
+    if (instanceBvh.needsRebuild()) {
+        instanceBvh.rebuild();
+    }
+}
+
+void VKCore::updateDescriptorSet() {
+    descriptor->updateDescriptorSet(uniformRing->getBuffer(), instanceBuffer->getBuffer(),
+                                    instanceBuffer->getRange());
+    if (gpuCuller) {
+        gpuCuller->updateDescriptorSet(uniformRing->getBuffer(), instanceBuffer->getBuffer(),
+                                       instanceBuffer->getRange());
+    }
+}
+
+/*
+ * Marks every cached command buffer as stale. Call this whenever something
+ * baked into the recorded commands changes: pipeline, framebuffers, extent or
+ * the draw list.
+ */
+void VKCore::invalidateCommandBuffers() {
+    commandGeneration++;
+}
+
+void VKCore::freeCachedCommandBuffers() {
+    if (!cachedCommandBuffers.empty()) {
+        vkFreeCommandBuffers(device->getDevice(), commandPool,
+                             static_cast<uint32_t>(cachedCommandBuffers.size()),
+                             cachedCommandBuffers.data());
+    }
+    cachedCommandBuffers.clear();
+    cachedGenerations.clear();
+}
+
+/*
+ * Returns the pre-recorded command buffer for this frame slot and swapchain
+ * image, recording it first if it is stale. The buffer was last submitted for
+ * the same frame slot, which the FrameScheduler has already retired, so it is
+ * safe to reset here.
+ */
+VkCommandBuffer VKCore::getCachedCommandBuffer(uint32_t frameSlot, uint32_t imageIndex) {
+    size_t imageCount = swapChainFramebuffers.size();
+    if (cachedCommandBuffers.size() != framesInFlight * imageCount) {
+        freeCachedCommandBuffers();
+        cachedCommandBuffers.resize(framesInFlight * imageCount);
+        cachedGenerations.assign(cachedCommandBuffers.size(), 0);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(cachedCommandBuffers.size());
+        VK_CHECK(vkAllocateCommandBuffers(device->getDevice(), &allocInfo,
+                                          cachedCommandBuffers.data()));
+    }
+
+    size_t index = frameSlot * imageCount + imageIndex;
+    if (cachedGenerations[index] != commandGeneration) {
+        vkResetCommandBuffer(cachedCommandBuffers[index], 0);
+        drawFrame(cachedCommandBuffers[index], imageIndex);
+        cachedGenerations[index] = commandGeneration;
+    }
+    return cachedCommandBuffers[index];
+}
+
+void VKCore::createCommandRecorder() {
+    recorder = nullptr;
+    if (recordingMode == RecordingMode::MultiThreaded) {
+        recorder = std::make_unique<CommandRecorder>(*device, framesInFlight);
+    }
+}
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+void VKCore::waitIdle() {
+    if (initialized) {
+        vkDeviceWaitIdle(device->getDevice());
+    }
+}
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     uniformBuffers[i], uniformBuffersMemory[i]);
+void VKCore::savePipelineCache() {
+    if (initialized) {
+        pipelineCache->save();
     }
 }
 
-void VKCore::reset(ANativeWindow *newWindow, AAssetManager *newManager) {
+void VKCore::reset(ANativeWindow *newWindow, AAssetManager *newManager,
+                   const std::string &newDataPath) {
     window.reset(newWindow);
     assetManager = newManager;
+    dataPath = newDataPath;
+    if (!fileSystem) {
+        fileSystem = std::make_unique<FileSystem>(assetManager);
+    }
     if (initialized) {
         createSurface();
-        recreateSwapChain();
+        recreateSwapChain(true);
     }
 }
 
-void VKCore::recreateSwapChain() {
-    vkDeviceWaitIdle(device->getDevice());
-    cleanupSwapChain();
-    swapChain = std::make_unique<SwapChain>(*device);
+/*
+ * Replaces the swapchain after the surface changed. With handOffSwapChain
+ * the old one is retired rather than destroyed, so the render thread does
+ * not wait for the GPU; a new window has nothing to hand off.
+ */
+void VKCore::recreateSwapChain(bool newWindow) {
+    auto start = std::chrono::steady_clock::now();
+    bool handOff = handOffSwapChain && !newWindow;
+    if (handOff) {
+        RetiredSwapChain retired;
+        retired.framebuffers = std::move(swapChainFramebuffers);
+        swapChainFramebuffers.clear();
+        retired.frameValue = scheduler->getSubmittedValue();
+        auto newSwapChain = std::make_unique<SwapChain>(*device, *allocator, sampleCount,
+                                                        presentProfile, swapChain.get());
+        retired.swapChain = std::move(swapChain);
+        swapChain = std::move(newSwapChain);
+        // Cached buffers are indexed by image; they are re-recorded for the
+        // new framebuffers, but reallocated only if the image count changed.
+        if (swapChain->getSwapChainImageViews().size() != retired.framebuffers.size()) {
+            retired.commandBuffers = std::move(cachedCommandBuffers);
+            cachedCommandBuffers.clear();
+            cachedGenerations.clear();
+        }
+        retiredSwapChains.push_back(std::move(retired));
+    } else {
+        vkDeviceWaitIdle(device->getDevice());
+        cleanupSwapChain();
+        destroyRetiredSwapChains(true);
+        swapChain = nullptr;
+        swapChain = std::make_unique<SwapChain>(*device, *allocator, sampleCount,
+                                                presentProfile);
+    }
     createFramebuffers();
+    invalidateCommandBuffers();
+    resetFramePacer();
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() -
+                                                        start).count();
+    LOG_INFO("Swapchain recreated in %.2f ms (%s)", ms,
+             handOff ? "handed off" : "device idle");
+}
+
+/*
+ * Destroys the retired swapchains nothing uses any more: the GPU has
+ * finished the frames that rendered to them and the presentation engine is
+ * done with their presents. Without present fences, the presents are taken
+ * as done once a frame rendered to a newer swapchain has completed. With
+ * all, the caller has waited for the device to go idle.
+ */
+void VKCore::destroyRetiredSwapChains(bool all) {
+    uint64_t completedValue = all ? UINT64_MAX : scheduler->getCompletedValue();
+    for (size_t i = 0; i < retiredSwapChains.size();) {
+        RetiredSwapChain &retired = retiredSwapChains[i];
+        bool presented = device->supportsPresentFence() ? retired.swapChain->pollPresentFences()
+                                                        : completedValue > retired.frameValue;
+        if (!all && (completedValue < retired.frameValue || !presented)) {
+            i++;
+            continue;
+        }
+        for (VkFramebuffer framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(device->getDevice(), framebuffer, nullptr);
+        }
+        if (!retired.commandBuffers.empty()) {
+            vkFreeCommandBuffers(device->getDevice(), commandPool,
+                                 static_cast<uint32_t>(retired.commandBuffers.size()),
+                                 retired.commandBuffers.data());
+        }
+        retiredSwapChains[i] = std::move(retiredSwapChains.back());
+        retiredSwapChains.pop_back();
+    }
+}
+
+/*
+ * Starts pacing over for a new swapchain: refresh duration and frame rate
+ * cap may have changed, and vsync has to be found again.
+ */
+void VKCore::resetFramePacer() {
+    uint64_t refreshDuration = swapChain->getRefreshDuration();
+    framePacer.setRefreshDuration(refreshDuration != 0 ? refreshDuration
+                                                       : FramePacer::DEFAULT_REFRESH_DURATION);
+    framePacer.reset();
+
+    uint32_t minSwapInterval = 1;
+    float maxFrameRate = swapChain->getPresentConfig().maxFrameRate;
+    if (maxFrameRate > 0.0f) {
+        float refreshRate = 1e9f / static_cast<float>(framePacer.getRefreshDuration());
+        minSwapInterval = static_cast<uint32_t>(std::ceil(refreshRate / maxFrameRate - 0.01f));
+    }
+    framePacer.setMinSwapInterval(minSwapInterval);
+}
+
+bool VKCore::isFramePaced() const {
+    VkPresentModeKHR presentMode = swapChain->getPresentConfig().presentMode;
+    return enableFramePacing && (presentMode == VK_PRESENT_MODE_FIFO_KHR ||
+                                 presentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+}
+
+/*
+ * Feeds the frame that was just presented to the pacer, along with the
+ * present times the display reported since the last frame. Presents made
+ * before pacing started carry no desired time and are skipped.
+ */
+void VKCore::updateFramePacer(std::chrono::steady_clock::time_point frameStart,
+                              const std::vector<VkPastPresentationTimingGOOGLE> &timings) {
+    auto now = std::chrono::steady_clock::now();
+    framePacer.onFrameWork(toPacerTime(now) - toPacerTime(frameStart));
+    for (const VkPastPresentationTimingGOOGLE &timing : timings) {
+        if (timing.desiredPresentTime != 0) {
+            framePacer.onPresentTiming(timing.desiredPresentTime, timing.actualPresentTime);
+        }
+    }
+
+    uint32_t swapInterval = framePacer.getSwapInterval();
+    if (swapInterval != pacedSwapInterval) {
+        pacedSwapInterval = swapInterval;
+        LOG_INFO("Frame pacing at %.1f fps (swap interval %u, %s)",
+                 1e9f / static_cast<float>(framePacer.getRefreshDuration() * swapInterval),
+                 swapInterval, swapChain->hasDisplayTiming() ? "display timing"
+                                                             : "predicted vsync");
+    }
 }
 
 void VKCore::render() {
+    bool framePaced = isFramePaced();
+    FramePlan framePlan{};
+    float maxFrameRate = swapChain->getPresentConfig().maxFrameRate;
+    if (framePaced) {
+        framePlan = framePacer.planFrame(toPacerTime(std::chrono::steady_clock::now()));
+        std::this_thread::sleep_until(fromPacerTime(framePlan.wakeTime));
+    } else if (maxFrameRate > 0.0f) {
+        std::this_thread::sleep_until(
+                lastFrameTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<float>(1.0f / maxFrameRate)));
+    }
+    auto frameStart = std::chrono::steady_clock::now();
+    presentStats.update(scheduler->getCompletedValue(), frameStart);
+    presentStats.beginFrame(scheduler->getFrameValue(), frameStart);
     if (orientationChanged) {
         onOrientationChange();
     }
 
-    vkWaitForFences(device->getDevice(), 1, &inFlightFences[currentFrame], VK_TRUE,
-                    UINT64_MAX);
+    destroyRetiredSwapChains(false);
+    streamer->update(scheduler->getFrameValue(), scheduler->getCompletedValue());
+    if (cubeAsset != NO_ASSET) {
+        adoptStreamedMesh();
+    }
+
+    // Cached command buffers recorded before a pipeline became ready lack
+    // its draws.
+    uint64_t publishedPipelines = pipelineManager->getPublishedCount();
+    if (publishedPipelines != seenPublishedPipelines) {
+        seenPublishedPipelines = publishedPipelines;
+        invalidateCommandBuffers();
+    }
+    framePipeline = graphicsPipeline.get();
+    frameGpuDriven = gpuCuller && gpuCuller->isReady() && framePipeline != VK_NULL_HANDLE;
+
+    scheduler->beginFrame();
+    uint32_t frameSlot = scheduler->getFrameSlot();
+    if (validateGpuCulling) {
+        checkGpuCulling(frameSlot);
+    }
+
     uint32_t imageIndex;
+    auto acquireStart = std::chrono::steady_clock::now();
     VkResult result = vkAcquireNextImageKHR(
-            device->getDevice(), swapChain->getSwapChain(), UINT64_MAX, imageAvailableSemaphores[currentFrame],
-            VK_NULL_HANDLE, &imageIndex);
+            device->getDevice(), swapChain->getSwapChain(), UINT64_MAX,
+            scheduler->getImageAvailableSemaphore(), VK_NULL_HANDLE, &imageIndex);
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         recreateSwapChain();
         return;
     }
     assert(result == VK_SUCCESS ||
            result == VK_SUBOPTIMAL_KHR);  // failed to acquire swap chain image
-    updateUniformBuffers(currentFrame);
-
-    vkResetFences(device->getDevice(), 1, &inFlightFences[currentFrame]);
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-
-    drawFrame(commandBuffers[currentFrame], imageIndex);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (framePaced) {
+        framePacer.onFrameAcquired(toPacerTime(acquireStart),
+                                   toPacerTime(std::chrono::steady_clock::now()));
+    }
+    updateUniformBuffers(frameSlot);
+    instanceOffset = instanceBuffer->sync(frameSlot);
+    if (gpuCuller) {
+        gpuCuller->sync(frameSlot);
+    }
+    if (runCullingBenchmark) {
+        benchmarkCulling(frameFrustum);
+        runCullingBenchmark = false;
+    }
+    // UINT32_MAX while the frame's instances were not culled on the CPU.
+    uint32_t visibleCount = UINT32_MAX;
+    if (enableCpuCulling && instanceDrawList && !frameGpuDriven) {
+        visibleCount = cullInstanceDraws();
+    }
+    if (cubeAsset != NO_ASSET) {
+        streamer->request(cubeAsset, computeSceneStreamingPriority(visibleCount));
+    }
+    if (validateGpuCulling && frameGpuDriven) {
+        expectedDrawCounts[frameSlot] = gpuCuller->countVisible(frameFrustum, frameCameraPosition,
+                                                                *instanceBuffer);
+    }
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    VkCommandBuffer commandBuffer;
+    if (recordingMode == RecordingMode::Cached) {
+        commandBuffer = getCachedCommandBuffer(frameSlot, imageIndex);
+    } else {
+        commandBuffer = commandBuffers[frameSlot];
+        vkResetCommandBuffer(commandBuffer, 0);
+        drawFrame(commandBuffer, imageIndex);
+    }
 
-    VK_CHECK(vkQueueSubmit(device->getGraphicsQueue(), 1, &submitInfo,
-                           inFlightFences[currentFrame]));
+    scheduler->submit(device->getGraphicsQueue(), commandBuffer);
+    auto submitTime = std::chrono::steady_clock::now();
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
+    VkSemaphore signalSemaphores[] = {scheduler->getRenderFinishedSemaphore()};
+
     presentInfo.waitSemaphoreCount = 1;
     presentInfo.pWaitSemaphores = signalSemaphores;
 
@@ -245,6 +1077,33 @@ void VKCore::render() {
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
 
+#ifdef VK_EXT_swapchain_maintenance1
+    // Tells destroyRetiredSwapChains when the swapchain is no longer presented.
+    VkFence presentFence = swapChain->getPresentFence();
+    VkSwapchainPresentFenceInfoEXT presentFenceInfo{};
+    presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+    presentFenceInfo.swapchainCount = 1;
+    presentFenceInfo.pFences = &presentFence;
+    if (presentFence != VK_NULL_HANDLE) {
+        presentInfo.pNext = &presentFenceInfo;
+    }
+#endif
+
+    VkPresentTimeGOOGLE presentTime{};
+    presentTime.presentID = nextPresentId++;
+    // 0 leaves unpaced frames to the present mode; their timing is still
+    // reported, for the present latency.
+    presentTime.desiredPresentTime = framePaced ? framePlan.desiredPresentTime : 0;
+    VkPresentTimesInfoGOOGLE presentTimesInfo{};
+    presentTimesInfo.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+    presentTimesInfo.swapchainCount = 1;
+    presentTimesInfo.pTimes = &presentTime;
+    if (swapChain->hasDisplayTiming()) {
+        presentTimesInfo.pNext = presentInfo.pNext;
+        presentInfo.pNext = &presentTimesInfo;
+        presentStats.onPresent(presentTime.presentID, frameStart);
+    }
+
     result = vkQueuePresentKHR(device->getPresentQueue(), &presentInfo);
     if (result == VK_SUBOPTIMAL_KHR) {
         orientationChanged = true;
@@ -253,10 +1112,47 @@ void VKCore::render() {
     } else {
         assert(result == VK_SUCCESS);  // failed to present swap chain image!
     }
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    scheduler->endFrame();
+    std::vector<VkPastPresentationTimingGOOGLE> timings = swapChain->getPastPresentationTimings();
+    for (const VkPastPresentationTimingGOOGLE &timing : timings) {
+        presentStats.onPresentTiming(timing.presentID, fromPacerTime(timing.actualPresentTime));
+    }
+    if (framePaced) {
+        updateFramePacer(frameStart, timings);
+    }
+
+    if (instanceBenchmark) {
+        float frameMs = std::chrono::duration<float, std::milli>(frameStart - lastFrameTime).count();
+        float cpuMs = std::chrono::duration<float, std::milli>(submitTime - frameStart).count();
+        stepInstanceBenchmark(frameMs, cpuMs);
+    }
+    lastFrameTime = frameStart;
 }
 
-void VKCore::updateUniformBuffers(uint32_t currentImage) {
+/*
+ * Feeds the last frame to the benchmark and animates about 1% of the
+ * instances, a different window every frame, for the next one.
+ */
+void VKCore::stepInstanceBenchmark(float frameMs, float cpuMs) {
+    if (instanceBenchmark->frame(frameMs, cpuMs, instanceBuffer->getStreamedCount())) {
+        setInstances(createInstanceGrid(instanceBenchmark->getInstanceCount()));
+    }
+    if (!instanceBenchmark->isRunning()) {
+        instanceBenchmark = nullptr;
+        return;
+    }
+
+    uint32_t count = instanceBuffer->getCount();
+    uint32_t animatedCount = std::max(count / 100, 1u);
+    uint32_t first = (animatedFrame++ * animatedCount) % count;
+    glm::mat4 spin = glm::rotate(glm::mat4(1.0f), glm::radians(5.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    for (uint32_t i = 0; i < animatedCount; i++) {
+        uint32_t index = (first + i) % count;
+        updateInstance(index, {instanceBuffer->get(index).model * spin});
+    }
+}
+
+void VKCore::updateUniformBuffers(uint32_t frameSlot) {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
     auto currentTime = std::chrono::high_resolution_clock::now();
@@ -271,14 +1167,144 @@ void VKCore::updateUniformBuffers(uint32_t currentImage) {
     ubo.view = glm::lookAt(glm::vec3(4.0f, 4.0f, 4.0f),
                            glm::vec3(0.0f, 0.0f, 0.0f),
                            glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), swapChain->getSwapChainExtent().width / (float) swapChain->getSwapChainExtent().height, 0.1f, 10.0f);
+    // Drawn upright for the display's orientation, then pre-rotated into the
+    // swapchain's so the compositor does not have to.
+    VkExtent2D displayExtent = swapChain->getDisplayExtent();
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), displayExtent.width / (float) displayExtent.height, 0.1f, 10.0f);
+    ubo.proj = getPreRotation(swapChain->getPreTransform()) * proj;
+
+    uniformRing->beginFrame(frameSlot);
+    sceneUniformOffset = uniformRing->push(ubo);
+    // Instance transforms are relative to the scene's model matrix.
+    frameClip = ubo.proj * ubo.view * ubo.model;
+    frameFrustum = Frustum::fromMatrix(frameClip);
+    frameCameraPosition = glm::vec3(glm::inverse(ubo.view * ubo.model)[3]);
+    // Screen-space error is measured on the upright frame.
+    lodSelector.setView(proj, ubo.view * ubo.model, displayExtent.height);
+    if (gpuCuller) {
+        CullUniforms cullUniforms{};
+        std::copy(std::begin(frameFrustum.planes), std::end(frameFrustum.planes),
+                  cullUniforms.planes);
+        cullUniforms.cameraPosition = glm::vec4(frameCameraPosition, 1.0f);
+        cullUniforms.objectCount = gpuCuller->getObjectCount();
+        cullUniformOffset = uniformRing->push(cullUniforms);
+    }
+    uniformRing->flush();
+}
+
+/*
+ * Replaces the draw list with one instanced draw per run of consecutive
+ * visible instances sharing a level of detail. Neighbouring instances tend
+ * to be visible together, so this stays a short list. Cached command buffers
+ * are only invalidated when the visible set actually changed. Returns the
+ * number of visible instances, which lead visibleInstances.
+ */
+uint32_t VKCore::cullInstanceDraws() {
+    uint32_t visibleCount;
+    if (enableBvhCulling) {
+        refitInstanceBvh();
+        visibleCount = instanceBvh.cullFrustum(frameFrustum, visibleInstances);
+        std::sort(visibleInstances.begin(), visibleInstances.end());
+    } else {
+        visibleCount = cullSpheres(frameFrustum, instanceBounds, visibleInstances);
+    }
 
-    void *data;
-    vkMapMemory(device->getDevice(), uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device->getDevice(), uniformBuffersMemory[currentImage]);
+    const std::vector<MeshLod> &lods = sceneMesh->getLods();
+    float meshRadius = sceneMesh->getBoundingSphere().w;
+    culledDrawList.clear();
+    for (uint32_t i = 0; i < visibleCount; i++) {
+        uint32_t instance = visibleInstances[i];
+        uint32_t lodIndex = 0;
+        if (enableLod && lods.size() > 1) {
+            glm::vec3 center(instanceBounds.centerX[instance], instanceBounds.centerY[instance],
+                             instanceBounds.centerZ[instance]);
+            float radius = instanceBounds.radius[instance];
+            lodIndex = lodSelector.select(instance, lods, center, radius, radius / meshRadius);
+        }
+        const MeshLod &lod = lods[lodIndex];
+        if (!culledDrawList.empty()) {
+            DrawCommand &last = culledDrawList.back();
+            if (last.firstInstance + last.instanceCount == instance &&
+                last.firstIndex == lod.firstIndex) {
+                last.instanceCount++;
+                continue;
+            }
+        }
+        culledDrawList.push_back({lod.indexCount, 1, lod.firstIndex, 0, instance});
+    }
+
+    bool unchanged = std::equal(
+            culledDrawList.begin(), culledDrawList.end(), drawList.begin(), drawList.end(),
+            [](const DrawCommand &a, const DrawCommand &b) {
+                return a.firstInstance == b.firstInstance && a.instanceCount == b.instanceCount &&
+                       a.firstIndex == b.firstIndex;
+            });
+    if (!unchanged) {
+        drawList.swap(culledDrawList);
+        invalidateCommandBuffers();
+    }
+    return visibleCount;
 }
 
+/*
+ * Streaming priority of the scene mesh, which every instance draws: that of
+ * the instance covering the most of the frame's view, ranked as visible when
+ * any instance is. visibleCount is the frame's CPU culling result, or
+ * UINT32_MAX to test the instances here, as when they are culled on the GPU.
+ */
+float VKCore::computeSceneStreamingPriority(uint32_t visibleCount) {
+    if (instanceBounds.size() == 0) {
+        glm::vec4 sphere = sceneMesh->getBoundingSphere();
+        return computeStreamingPriority(
+                sphere, frameCameraPosition,
+                frameFrustum.intersectsSphere(glm::vec3(sphere), sphere.w));
+    }
+    if (visibleCount == UINT32_MAX) {
+        visibleCount = cullSpheres(frameFrustum, instanceBounds, visibleInstances);
+    }
+
+    float priority = 0.0f;
+    auto rank = [&](uint32_t instance, bool visible) {
+        glm::vec4 sphere(instanceBounds.centerX[instance], instanceBounds.centerY[instance],
+                         instanceBounds.centerZ[instance], instanceBounds.radius[instance]);
+        priority = std::max(priority,
+                            computeStreamingPriority(sphere, frameCameraPosition, visible));
+    };
+    if (visibleCount > 0) {
+        for (uint32_t i = 0; i < visibleCount; i++) {
+            rank(visibleInstances[i], true);
+        }
+    } else {
+        for (uint32_t i = 0; i < instanceBounds.size(); i++) {
+            rank(i, false);
+        }
+    }
+    return priority;
+}
+
+/*
+ * Compares the draw count the GPU produced the last time this slot was
+ * culled with the CPU reference taken at the time. The slot has just been
+ * retired, so the count is final.
+ */
+void VKCore::checkGpuCulling(uint32_t frameSlot) {
+    uint32_t expected = expectedDrawCounts[frameSlot];
+    expectedDrawCounts[frameSlot] = UINT32_MAX;
+    if (expected == UINT32_MAX) {
+        return;
+    }
+    uint32_t drawCount = gpuCuller->readDrawCount(frameSlot);
+    if (drawCount != expected) {
+        LOG_ERR("GPU culling emitted %u draws, the CPU reference expects %u", drawCount, expected);
+    }
+}
+
+/*
+ * Presents turn suboptimal once the display rotates away from the
+ * swapchain's pre-transform. The identity extent is unchanged, so the
+ * replacement only swaps the swapchain images and keeps the transient
+ * attachments.
+ */
 void VKCore::onOrientationChange() {
     recreateSwapChain();
     orientationChanged = false;
@@ -293,6 +1319,11 @@ void VKCore::drawFrame(VkCommandBuffer commandBuffer,
 
     VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
+    if (frameGpuDriven) {
+        gpuCuller->recordCull(commandBuffer, scheduler->getFrameSlot(), cullUniformOffset,
+                              instanceOffset);
+    }
+
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = renderPass;
@@ -300,6 +1331,55 @@ void VKCore::drawFrame(VkCommandBuffer commandBuffer,
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = swapChain->getSwapChainExtent();
 
+    // Color and depth are the first two attachments with or without
+    // multisampling; the resolve target is not cleared.
+    VkClearValue clearValues[2]{};
+    clearValues[0].color = {{0.25f, 0.3f, 0.25f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassInfo.clearValueCount = 2;
+    renderPassInfo.pClearValues = clearValues;
+
+    // GPU-driven frames record a single indirect draw.
+    uint32_t drawCount = frameGpuDriven ? 1 : static_cast<uint32_t>(drawList.size());
+    if (recorder != nullptr) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+        const auto &secondaryBuffers = recorder->record(
+                scheduler->getFrameSlot(), inheritanceInfo, drawCount,
+                [this](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+                    recordDraws(secondary, first, count);
+                });
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryBuffers.size()),
+                             secondaryBuffers.data());
+    } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        recordDraws(commandBuffer, 0, drawCount);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+/*
+ * Records a range of the draw list. Secondary command buffers do not inherit
+ * any state from the primary, so every range sets up its own dynamic state
+ * and bindings. This may run on CommandRecorder workers and must only read
+ * shared state.
+ */
+void VKCore::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                         uint32_t drawCount) {
+    // Both cover the whole image in the swapchain's identity orientation;
+    // pre-rotation happens in clip space, so only a sub-rectangle would need
+    // rotating.
     VkViewport viewport{};
     viewport.width = (float)swapChain->getSwapChainExtent().width;
     viewport.height = (float)swapChain->getSwapChainExtent().height;
@@ -311,21 +1391,28 @@ void VKCore::drawFrame(VkCommandBuffer commandBuffer,
     scissor.extent = swapChain->getSwapChainExtent();
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    VkClearValue clearColor = {{{0.25f, 0.3f, 0.25f, 1.0f}}};
-
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
+    if (framePipeline == VK_NULL_HANDLE) {
+        return;
+    }
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      graphicsPipeline);
+                      framePipeline);
+    sceneMesh->bind(commandBuffer, pipelineLayout);
+    VkDescriptorSet descriptorSet = descriptor->getDescriptorSet();
+    // In binding order: scene uniforms, then instances.
+    uint32_t dynamicOffsets[] = {sceneUniformOffset, instanceOffset};
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descriptor->getDescriptorSets()[currentFrame],
-                            0, nullptr);
+                            pipelineLayout, 0, 1, &descriptorSet,
+                            2, dynamicOffsets);
 
-    vkCmdDraw(commandBuffer, 36, 1, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
-    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+    if (frameGpuDriven) {
+        gpuCuller->recordDraw(commandBuffer, scheduler->getFrameSlot());
+        return;
+    }
+    for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++) {
+        const DrawCommand &draw = drawList[i];
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount,
+                         draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+    }
 }
 
 void VKCore::cleanupSwapChain() {
@@ -337,24 +1424,40 @@ void VKCore::cleanupSwapChain() {
 void VKCore::cleanup() {
     vkDeviceWaitIdle(device->getDevice());
     cleanupSwapChain();
+    destroyRetiredSwapChains(true);
+    swapChain->logRenderTargetStats();
+    presentStats.logStats();
     swapChain = nullptr;
     descriptor = nullptr;
+    recorder = nullptr;
+    scheduler = nullptr;
+    cachedCommandBuffers.clear();
+    cachedGenerations.clear();
+
+    uniformRing = nullptr;
+    // Waits for its culling pipeline, so it goes before the PipelineManager.
+    gpuCuller = nullptr;
+    instanceBuffer = nullptr;
+    instanceBenchmark = nullptr;
+    streamer->logStats();
+    streamer = nullptr;
+    cubeMesh = nullptr;
+    uploader = nullptr;
+    // Joins the compile threads before anything they reference goes away.
+    pipelineManager = nullptr;
+    graphicsPipeline = PipelineHandle();
+    pipelineCache->save();
+    pipelineCache = nullptr;
+    allocator->logStats();
+    allocator = nullptr;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(device->getDevice(), uniformBuffers[i], nullptr);
-        vkFreeMemory(device->getDevice(), uniformBuffersMemory[i], nullptr);
-    }
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device->getDevice(), imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device->getDevice(), renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device->getDevice(), inFlightFences[i], nullptr);
-    }
     vkDestroyCommandPool(device->getDevice(), commandPool, nullptr);
-    vkDestroyPipeline(device->getDevice(), graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(device->getDevice(), pipelineLayout, nullptr);
     vkDestroyRenderPass(device->getDevice(), renderPass, nullptr);
-    vkDestroyDevice(device->getDevice(), nullptr);
+    // Device's destructor destroys the VkDevice, which has to go before the
+    // surface and instance. Nothing may touch the device from here on, so
+    // waitIdle and savePipelineCache check initialized.
+    device = nullptr;
     if (enableValidationLayers) {
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
@@ -406,6 +1509,13 @@ std::vector<const char *> VKCore::getRequiredExtensions(
     if (enableValidation) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
+#ifdef VK_EXT_swapchain_maintenance1
+    // Optional: Device only enables present fences with these.
+    if (areInstanceExtensionsSupported(SURFACE_MAINTENANCE_EXTENSIONS)) {
+        extensions.insert(extensions.end(), SURFACE_MAINTENANCE_EXTENSIONS.begin(),
+                          SURFACE_MAINTENANCE_EXTENSIONS.end());
+    }
+#endif
     return extensions;
 }
 
@@ -421,7 +1531,8 @@ void VKCore::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.1 is needed to query extension features such as timeline semaphores.
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -479,19 +1590,34 @@ void VKCore::createSurface() {
 
 // END DEVICE SUITABILITY
 
+/*
+ * Creates a single-subpass render pass laid out for tile-based GPUs. Nothing
+ * is loaded from memory and only the single-sampled color that is presented
+ * is stored: depth and, with multisampling, the multisampled color are
+ * cleared on load and discarded at the end, and the multisampled color is
+ * resolved into the swapchain image by the subpass itself. The attachments
+ * are:
+ * 	0. Color, multisampled when sampleCount > 1, else the swapchain image.
+ * 	1. Depth, with sampleCount samples.
+ * 	2. With multisampling only, the swapchain image the color resolves to.
+ */
 void VKCore::createRenderPass() {
+    bool multisampled = sampleCount != VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChain->getSwapChainImageFormat();
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = sampleCount;
 
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                                           : VK_ATTACHMENT_STORE_OP_STORE;
 
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                               : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -499,7 +1625,7 @@ void VKCore::createRenderPass() {
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = device->findDepthFormat();
-    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.samples = sampleCount;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -511,23 +1637,48 @@ void VKCore::createRenderPass() {
     depthAttachmentRef.attachment = 1;
     depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    // The whole resolve target is overwritten, so its contents are not loaded.
+    VkAttachmentDescription resolveAttachment{};
+    resolveAttachment.format = swapChain->getSwapChainImageFormat();
+    resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference resolveAttachmentRef{};
+    resolveAttachmentRef.attachment = 2;
+    resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    subpass.pResolveAttachments = multisampled ? &resolveAttachmentRef : nullptr;
 
+    // Frames in flight share the transient attachments: a frame's clears
+    // wait for the previous frame's depth and color writes.
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment,
+                                             resolveAttachment};
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = multisampled ? 3 : 2;
+    renderPassInfo.pAttachments = attachments;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 1;
@@ -536,11 +1687,35 @@ void VKCore::createRenderPass() {
     VK_CHECK(vkCreateRenderPass(device->getDevice(), &renderPassInfo, nullptr, &renderPass));
 }
 
+/*
+ * Creates the pipeline layout right away, since command buffers need it, and
+ * queues the pipeline itself for background compilation.
+ */
+void VKCore::setPipeline() {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptor->getDescriptorSetLayout();
+    // Mesh::bind pushes the constants decoding the vertex format.
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(VertexConstants);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(device->getDevice(), &pipelineLayoutInfo, nullptr,
+                                    &pipelineLayout));
+
+    graphicsPipeline = pipelineManager->compile("cube", [this] { return createGraphicsPipeline(); });
+    invalidateCommandBuffers();
+}
+
 /*
  * Creates a graphics pipeline loading a simple vertex and fragment shader, both
  * with 'main' set as entrypoint A list of standard parameters are provided:
- * 	- The vertex input coming from the application is set to empty - we are
- * hardcoding the triangle in the vertex shader.
+ * 	- The vertex input is built from vertexFormat: one interleaved binding
+ * with quantized position and colour.
  * 	- The input assembly is configured to draw triangle lists
  *  - We intend to draw onto the whole screen, so the scissoring extent is
  * specified as being the whole swapchain extent.
@@ -548,8 +1723,8 @@ void VKCore::createRenderPass() {
  * planes (depthClampEnable=false) as well as sending geometry to the frame
  * buffer and generate fragments for the whole area of the geometry. We consider
  * geometry in terms of the clockwise order of their respective vertex input.
- *  - Multisampling is disabled
- *  - Depth and stencil testing are disabled
+ *  - Multisampling uses sampleCount samples without sample shading
+ *  - Depth testing and writing are enabled, stencil testing is disabled
  * 	- ColorBlending is set to opaque mode, meaning any new fragments will
  * overwrite the ones already existing in the framebuffer
  *  - We utilise Vulkan's concept of dynamic state for viewport and scissoring.
@@ -559,15 +1734,19 @@ void VKCore::createRenderPass() {
  *  - The pipeline layout sends 1 uniform buffer object to the shader containing
  * a 4x4 rotation matrix specified by the descriptorSetLayout. This is required
  * in order to render a rotated scene when the device has been rotated.
+ *
+ * Runs on a PipelineManager worker. Everything it touches (shader assets, the
+ * render pass and the pipeline layout) outlives the manager.
  */
-void VKCore::setPipeline() {
-    auto vertShaderCode =
-            LoadBinaryFileToVector("shaders/shader.vert.spv", assetManager);
-    auto fragShaderCode =
-            LoadBinaryFileToVector("shaders/shader.frag.spv", assetManager);
+VkPipeline VKCore::createGraphicsPipeline() {
+    FileView vertShaderCode = fileSystem->open("shaders/shader.vert.spv");
+    FileView fragShaderCode = fileSystem->open("shaders/shader.frag.spv");
+    if (!vertShaderCode || !fragShaderCode) {
+        throw std::runtime_error("Failed to load shaders!");
+    }
 
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    VkShaderModule vertShaderModule = createShaderModule(*device, vertShaderCode.span());
+    VkShaderModule fragShaderModule = createShaderModule(*device, fragShaderCode.span());
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType =
@@ -586,13 +1765,8 @@ void VKCore::setPipeline() {
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
                                                       fragShaderStageInfo};
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.pVertexBindingDescriptions = nullptr;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-    vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+    VertexLayout vertexLayout = vertexFormat.getLayout();
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = vertexLayout.getInputState();
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType =
@@ -624,7 +1798,7 @@ void VKCore::setPipeline() {
     multisampling.sType =
             VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.rasterizationSamples = sampleCount;
     multisampling.minSampleShading = 1.0f;
     multisampling.pSampleMask = nullptr;
     multisampling.alphaToCoverageEnable = VK_FALSE;
@@ -656,15 +1830,6 @@ void VKCore::setPipeline() {
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptor->getDescriptorSetLayout();
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-    VK_CHECK(vkCreatePipelineLayout(device->getDevice(), &pipelineLayoutInfo, nullptr,
-                                    &pipelineLayout));
     std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT,
                                                        VK_DYNAMIC_STATE_SCISSOR};
     VkPipelineDynamicStateCreateInfo dynamicStateCI{};
@@ -692,38 +1857,35 @@ void VKCore::setPipeline() {
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.pDepthStencilState = &depthStencil;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo,
-                                       nullptr, &graphicsPipeline));
+    VkPipeline pipeline;
+    auto compileStart = std::chrono::steady_clock::now();
+    VK_CHECK(vkCreateGraphicsPipelines(device->getDevice(), pipelineCache->getCache(), 1,
+                                       &pipelineInfo, nullptr, &pipeline));
+    float compileMs = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - compileStart).count();
+    LOG_INFO("Graphics pipeline created in %.2f ms (pipeline cache %s)", compileMs,
+             pipelineCache->isWarm() ? "hit" : "miss");
     vkDestroyShaderModule(device->getDevice(), fragShaderModule, nullptr);
     vkDestroyShaderModule(device->getDevice(), vertShaderModule, nullptr);
-}
-
-VkShaderModule VKCore::createShaderModule(const std::vector<uint8_t> &code) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-
-    // Satisfies alignment requirements since the allocator
-    // in vector ensures worst case requirements
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-    VkShaderModule shaderModule;
-    VK_CHECK(vkCreateShaderModule(device->getDevice(), &createInfo, nullptr, &shaderModule));
-
-    return shaderModule;
+    return pipeline;
 }
 
 void VKCore::createFramebuffers() {
     swapChainFramebuffers.resize(swapChain->getSwapChainImageViews().size());
     for (size_t i = 0; i < swapChain->getSwapChainImageViews().size(); i++) {
+        // Laid out as createRenderPass describes.
+        bool multisampled = sampleCount != VK_SAMPLE_COUNT_1_BIT;
         VkImageView attachments[] = {
-            swapChain->getSwapChainImageViews()[i],
-            swapChain->getDepthImageView()
+            multisampled ? swapChain->getColorImageView()
+                         : swapChain->getSwapChainImageViews()[i],
+            swapChain->getDepthImageView(),
+            swapChain->getSwapChainImageViews()[i]
         };
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.attachmentCount = multisampled ? 3 : 2;
         framebufferInfo.pAttachments = attachments;
         framebufferInfo.width = swapChain->getSwapChainExtent().width;
         framebufferInfo.height = swapChain->getSwapChainExtent().height;
@@ -744,7 +1906,7 @@ void VKCore::createCommandPool() {
 }
 
 void VKCore::createCommandBuffer() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    commandBuffers.resize(framesInFlight);
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
@@ -755,23 +1917,5 @@ void VKCore::createCommandBuffer() {
 }
 
 void VKCore::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VK_CHECK(vkCreateSemaphore(device->getDevice(), &semaphoreInfo, nullptr,
-                                   &imageAvailableSemaphores[i]));
-
-        VK_CHECK(vkCreateSemaphore(device->getDevice(), &semaphoreInfo, nullptr,
-                                   &renderFinishedSemaphores[i]));
-
-        VK_CHECK(vkCreateFence(device->getDevice(), &fenceInfo, nullptr, &inFlightFences[i]));
-    }
-}
\ No newline at end of file
+    scheduler = std::make_unique<FrameScheduler>(*device, framesInFlight);
+}
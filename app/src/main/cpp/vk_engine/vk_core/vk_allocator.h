@@ -0,0 +1,586 @@
+#pragma once
+
+#include "vk_device.h"
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+/*
+ * How a pool hands out space inside its blocks.
+ *
+ * Buddy suits long-lived resources that are freed in any order: sizes are
+ * rounded up to a power of two and freed neighbours merge back together.
+ * Linear is a bump allocator for short-lived resources that die together; a
+ * block only rewinds once every allocation made from it has been freed.
+ */
+enum class AllocationStrategy {
+    Buddy,
+    Linear
+};
+
+struct MemoryBlock;
+
+/*
+ * A range of device memory handed out by MemoryAllocator. The resource is
+ * bound at (memory, offset). mapped is non-null for host-visible memory, which
+ * stays mapped for the lifetime of the block.
+ */
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    VkMemoryPropertyFlags propertyFlags = 0;
+
+    // Owning block, or nullptr for a dedicated allocation.
+    MemoryBlock *block = nullptr;
+};
+
+struct MemoryPoolStats {
+    uint32_t memoryTypeIndex;
+    AllocationStrategy strategy;
+    bool optimalTiling;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    VkDeviceSize usedBytes;
+    VkDeviceSize reservedBytes;
+};
+
+struct MemoryBlock {
+    uint32_t poolIndex;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint8_t *mapped;
+
+    uint32_t allocationCount = 0;
+    VkDeviceSize usedBytes = 0;
+
+    // AllocationStrategy::Buddy: free offsets per order, order k spanning
+    // MIN_BUDDY_SIZE << k bytes, and the order of every live offset.
+    std::vector<std::set<VkDeviceSize>> freeLists;
+    std::unordered_map<VkDeviceSize, uint32_t> allocatedOrders;
+
+    // AllocationStrategy::Linear
+    VkDeviceSize cursor = 0;
+};
+
+/*
+ * MemoryAllocator suballocates buffers and images from large VkDeviceMemory
+ * blocks so that resource creation neither costs a kernel round trip nor eats
+ * into maxMemoryAllocationCount.
+ *
+ * Blocks are grouped into pools keyed by memory type and strategy. When the
+ * device reports a bufferImageGranularity above 1, linear resources (buffers)
+ * and optimal-tiling images get separate pools so they never share a page.
+ *
+ * With VK_KHR_dedicated_allocation, resources the driver prefers or requires
+ * to own their memory get a dedicated VkDeviceMemory; so do requests larger
+ * than half a block.
+ */
+class MemoryAllocator {
+public:
+    explicit MemoryAllocator(Device& device);
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+    MemoryAllocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags required,
+                                    VkMemoryPropertyFlags preferred = 0,
+                                    AllocationStrategy strategy = AllocationStrategy::Buddy);
+    MemoryAllocation allocateImage(VkImage image, VkImageTiling tiling,
+                                   VkMemoryPropertyFlags required,
+                                   VkMemoryPropertyFlags preferred = 0,
+                                   AllocationStrategy strategy = AllocationStrategy::Buddy);
+    void free(MemoryAllocation &allocation);
+
+    std::vector<MemoryPoolStats> getStats();
+    void logStats();
+
+private:
+    // Smallest buddy allocation, the granularity of AllocationStrategy::Buddy.
+    static constexpr VkDeviceSize MIN_BUDDY_SIZE = 256;
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    struct MemoryPool {
+        uint32_t memoryTypeIndex;
+        AllocationStrategy strategy;
+        bool optimalTiling;
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    };
+
+    Device& device;
+    std::mutex mutex;
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxAllocationCount;
+    std::vector<VkDeviceSize> blockSizes;
+
+    std::vector<MemoryPool> pools;
+    uint32_t deviceMemoryCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+
+    PFN_vkGetBufferMemoryRequirements2KHR getBufferMemoryRequirements2 = nullptr;
+    PFN_vkGetImageMemoryRequirements2KHR getImageMemoryRequirements2 = nullptr;
+
+    uint32_t chooseMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                              VkMemoryPropertyFlags preferred);
+    MemoryAllocation allocate(const VkMemoryRequirements &requirements, bool dedicated,
+                              VkBuffer buffer, VkImage image, bool optimalTiling,
+                              VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                              AllocationStrategy strategy);
+    MemoryAllocation allocateDedicated(const VkMemoryRequirements &requirements,
+                                       uint32_t memoryTypeIndex, VkBuffer buffer, VkImage image);
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex,
+                                        const void *pNext, uint8_t **mapped);
+    void freeDeviceMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex);
+
+    uint32_t getPool(uint32_t memoryTypeIndex, AllocationStrategy strategy, bool optimalTiling);
+    MemoryBlock *createBlock(uint32_t poolIndex);
+    void destroyBlock(MemoryBlock *block);
+
+    bool allocateFromBlock(MemoryBlock &block, AllocationStrategy strategy, VkDeviceSize size,
+                           VkDeviceSize alignment, VkDeviceSize &offset);
+    void freeFromBlock(MemoryBlock &block, AllocationStrategy strategy, VkDeviceSize offset,
+                       VkDeviceSize size);
+    uint32_t getBuddyOrder(VkDeviceSize size) const;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryAllocator::MemoryAllocator(Device &device) : device(device) {
+    vkGetPhysicalDeviceMemoryProperties(device.getPhysicalDevice(), &memProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
+    bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+    nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    // Small heaps (e.g. a 256 MiB host-visible window on some GPUs) get
+    // proportionally smaller blocks. Block sizes stay powers of two for the
+    // buddy allocator.
+    blockSizes.resize(memProperties.memoryHeapCount);
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+        VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+        while (blockSize > MIN_BUDDY_SIZE * 1024 &&
+               blockSize > memProperties.memoryHeaps[i].size / 8) {
+            blockSize /= 2;
+        }
+        blockSizes[i] = blockSize;
+    }
+
+    if (device.supportsDedicatedAllocation()) {
+        getBufferMemoryRequirements2 = (PFN_vkGetBufferMemoryRequirements2KHR) vkGetDeviceProcAddr(
+                device.getDevice(), "vkGetBufferMemoryRequirements2KHR");
+        getImageMemoryRequirements2 = (PFN_vkGetImageMemoryRequirements2KHR) vkGetDeviceProcAddr(
+                device.getDevice(), "vkGetImageMemoryRequirements2KHR");
+    }
+
+    LOG_INFO("Memory allocator: bufferImageGranularity %llu, dedicated allocations %s",
+             (unsigned long long) bufferImageGranularity,
+             getBufferMemoryRequirements2 != nullptr ? "enabled" : "disabled");
+}
+
+/*
+ * Allocates and binds memory for the buffer.
+ */
+MemoryAllocation MemoryAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags required,
+                                                 VkMemoryPropertyFlags preferred,
+                                                 AllocationStrategy strategy) {
+    VkMemoryRequirements requirements;
+    bool dedicated = false;
+    if (getBufferMemoryRequirements2 != nullptr) {
+        VkMemoryDedicatedRequirementsKHR dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+        VkMemoryRequirements2KHR requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+        requirements2.pNext = &dedicatedRequirements;
+
+        VkBufferMemoryRequirementsInfo2KHR info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2_KHR;
+        info.buffer = buffer;
+        getBufferMemoryRequirements2(device.getDevice(), &info, &requirements2);
+
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+                    dedicatedRequirements.requiresDedicatedAllocation;
+    } else {
+        vkGetBufferMemoryRequirements(device.getDevice(), buffer, &requirements);
+    }
+
+    MemoryAllocation allocation = allocate(requirements, dedicated, buffer, VK_NULL_HANDLE, false,
+                                           required, preferred, strategy);
+    VK_CHECK(vkBindBufferMemory(device.getDevice(), buffer, allocation.memory, allocation.offset));
+    return allocation;
+}
+
+/*
+ * Allocates and binds memory for the image.
+ */
+MemoryAllocation MemoryAllocator::allocateImage(VkImage image, VkImageTiling tiling,
+                                                VkMemoryPropertyFlags required,
+                                                VkMemoryPropertyFlags preferred,
+                                                AllocationStrategy strategy) {
+    VkMemoryRequirements requirements;
+    bool dedicated = false;
+    if (getImageMemoryRequirements2 != nullptr) {
+        VkMemoryDedicatedRequirementsKHR dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+        VkMemoryRequirements2KHR requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+        requirements2.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2KHR info{};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR;
+        info.image = image;
+        getImageMemoryRequirements2(device.getDevice(), &info, &requirements2);
+
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+                    dedicatedRequirements.requiresDedicatedAllocation;
+    } else {
+        vkGetImageMemoryRequirements(device.getDevice(), image, &requirements);
+    }
+
+    bool optimalTiling = tiling == VK_IMAGE_TILING_OPTIMAL;
+    MemoryAllocation allocation = allocate(requirements, dedicated, VK_NULL_HANDLE, image,
+                                           optimalTiling, required, preferred, strategy);
+    VK_CHECK(vkBindImageMemory(device.getDevice(), image, allocation.memory, allocation.offset));
+    return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                           bool dedicated, VkBuffer buffer, VkImage image,
+                                           bool optimalTiling, VkMemoryPropertyFlags required,
+                                           VkMemoryPropertyFlags preferred,
+                                           AllocationStrategy strategy) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t memoryTypeIndex = chooseMemoryType(requirements.memoryTypeBits, required, preferred);
+    VkMemoryPropertyFlags propertyFlags = memProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    VkDeviceSize blockSize = blockSizes[memProperties.memoryTypes[memoryTypeIndex].heapIndex];
+
+    // Lazily allocated memory is committed per allocation as the GPU touches
+    // it, so a transient attachment sharing a block would commit it all.
+    if (dedicated || requirements.size > blockSize / 2 ||
+        (propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+        return allocateDedicated(requirements, memoryTypeIndex, buffer, image);
+    }
+
+    // Without separate pools, linear and optimal resources would need
+    // bufferImageGranularity padding between every neighbour.
+    if (bufferImageGranularity == 1) {
+        optimalTiling = false;
+    }
+
+    // Rounding non-coherent allocations to whole atoms lets their owners
+    // flush any subrange without touching a neighbour.
+    VkDeviceSize size = requirements.size;
+    VkDeviceSize alignment = requirements.alignment;
+    if ((propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        !(propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        size = alignUp(size, nonCoherentAtomSize);
+        alignment = std::max(alignment, nonCoherentAtomSize);
+    }
+
+    uint32_t poolIndex = getPool(memoryTypeIndex, strategy, optimalTiling);
+    MemoryPool &pool = pools[poolIndex];
+
+    VkDeviceSize offset = 0;
+    MemoryBlock *target = nullptr;
+    for (auto &block : pool.blocks) {
+        if (allocateFromBlock(*block, strategy, size, alignment, offset)) {
+            target = block.get();
+            break;
+        }
+    }
+    if (target == nullptr) {
+        target = createBlock(poolIndex);
+        if (!allocateFromBlock(*target, strategy, size, alignment, offset)) {
+            throw std::runtime_error("Allocation does not fit in a fresh memory block!");
+        }
+    }
+
+    MemoryAllocation allocation;
+    allocation.memory = target->memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = target->mapped != nullptr ? target->mapped + offset : nullptr;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.propertyFlags = propertyFlags;
+    allocation.block = target;
+    return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateDedicated(const VkMemoryRequirements &requirements,
+                                                    uint32_t memoryTypeIndex, VkBuffer buffer,
+                                                    VkImage image) {
+    VkMemoryDedicatedAllocateInfoKHR dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR;
+    dedicatedInfo.buffer = buffer;
+    dedicatedInfo.image = image;
+
+    MemoryAllocation allocation;
+    uint8_t *mapped = nullptr;
+    allocation.memory = allocateDeviceMemory(
+            requirements.size, memoryTypeIndex,
+            getBufferMemoryRequirements2 != nullptr ? &dedicatedInfo : nullptr, &mapped);
+    allocation.size = requirements.size;
+    allocation.mapped = mapped;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.propertyFlags = memProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+    dedicatedCount++;
+    dedicatedBytes += requirements.size;
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (allocation.block == nullptr) {
+        freeDeviceMemory(allocation.memory, allocation.memoryTypeIndex);
+        dedicatedCount--;
+        dedicatedBytes -= allocation.size;
+    } else {
+        MemoryBlock *block = allocation.block;
+        MemoryPool &pool = pools[block->poolIndex];
+        freeFromBlock(*block, pool.strategy, allocation.offset, allocation.size);
+
+        // Keep one empty block per pool around so a resource being recreated
+        // does not bounce a whole block through the driver.
+        if (block->allocationCount == 0 && pool.blocks.size() > 1) {
+            destroyBlock(block);
+        }
+    }
+    allocation = MemoryAllocation{};
+}
+
+uint32_t MemoryAllocator::chooseMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                                           VkMemoryPropertyFlags preferred) {
+    if (preferred != 0) {
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+            if ((typeFilter & (1 << i)) && (flags & (required | preferred)) == (required | preferred)) {
+                return i;
+            }
+        }
+    }
+    return device.findMemoryType(typeFilter, required);
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex,
+                                                     const void *pNext, uint8_t **mapped) {
+    if (deviceMemoryCount >= maxAllocationCount) {
+        throw std::runtime_error("maxMemoryAllocationCount exceeded!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory;
+    VK_CHECK(vkAllocateMemory(device.getDevice(), &allocInfo, nullptr, &memory));
+    deviceMemoryCount++;
+
+    *mapped = nullptr;
+    if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void *data;
+        VK_CHECK(vkMapMemory(device.getDevice(), memory, 0, VK_WHOLE_SIZE, 0, &data));
+        *mapped = static_cast<uint8_t *>(data);
+    }
+    return memory;
+}
+
+void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) {
+    if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkUnmapMemory(device.getDevice(), memory);
+    }
+    vkFreeMemory(device.getDevice(), memory, nullptr);
+    deviceMemoryCount--;
+}
+
+uint32_t MemoryAllocator::getPool(uint32_t memoryTypeIndex, AllocationStrategy strategy,
+                                  bool optimalTiling) {
+    for (uint32_t i = 0; i < pools.size(); i++) {
+        if (pools[i].memoryTypeIndex == memoryTypeIndex && pools[i].strategy == strategy &&
+            pools[i].optimalTiling == optimalTiling) {
+            return i;
+        }
+    }
+
+    MemoryPool pool;
+    pool.memoryTypeIndex = memoryTypeIndex;
+    pool.strategy = strategy;
+    pool.optimalTiling = optimalTiling;
+    pools.push_back(std::move(pool));
+    return static_cast<uint32_t>(pools.size() - 1);
+}
+
+MemoryBlock *MemoryAllocator::createBlock(uint32_t poolIndex) {
+    MemoryPool &pool = pools[poolIndex];
+    uint32_t heapIndex = memProperties.memoryTypes[pool.memoryTypeIndex].heapIndex;
+
+    auto block = std::make_unique<MemoryBlock>();
+    block->poolIndex = poolIndex;
+    block->size = blockSizes[heapIndex];
+    block->memory = allocateDeviceMemory(block->size, pool.memoryTypeIndex, nullptr,
+                                         &block->mapped);
+
+    if (pool.strategy == AllocationStrategy::Buddy) {
+        uint32_t maxOrder = getBuddyOrder(block->size);
+        block->freeLists.resize(maxOrder + 1);
+        block->freeLists[maxOrder].insert(0);
+    }
+
+    pool.blocks.push_back(std::move(block));
+    return pool.blocks.back().get();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock *block) {
+    MemoryPool &pool = pools[block->poolIndex];
+    freeDeviceMemory(block->memory, pool.memoryTypeIndex);
+    pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(),
+                                   [block](const std::unique_ptr<MemoryBlock> &candidate) {
+                                       return candidate.get() == block;
+                                   }));
+}
+
+uint32_t MemoryAllocator::getBuddyOrder(VkDeviceSize size) const {
+    uint32_t order = 0;
+    while ((MIN_BUDDY_SIZE << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+/*
+ * Buddy nodes are aligned to their own size, so any power-of-two alignment
+ * no larger than the rounded size is satisfied for free.
+ */
+bool MemoryAllocator::allocateFromBlock(MemoryBlock &block, AllocationStrategy strategy,
+                                        VkDeviceSize size, VkDeviceSize alignment,
+                                        VkDeviceSize &offset) {
+    if (strategy == AllocationStrategy::Linear) {
+        offset = alignUp(block.cursor, alignment);
+        if (offset + size > block.size) {
+            return false;
+        }
+        block.cursor = offset + size;
+    } else {
+        uint32_t order = getBuddyOrder(std::max(size, alignment));
+        uint32_t available = order;
+        while (available < block.freeLists.size() && block.freeLists[available].empty()) {
+            available++;
+        }
+        if (available >= block.freeLists.size()) {
+            return false;
+        }
+
+        offset = *block.freeLists[available].begin();
+        block.freeLists[available].erase(block.freeLists[available].begin());
+        while (available > order) {
+            available--;
+            block.freeLists[available].insert(offset + (MIN_BUDDY_SIZE << available));
+        }
+        block.allocatedOrders[offset] = order;
+    }
+
+    block.allocationCount++;
+    block.usedBytes += size;
+    return true;
+}
+
+void MemoryAllocator::freeFromBlock(MemoryBlock &block, AllocationStrategy strategy,
+                                    VkDeviceSize offset, VkDeviceSize size) {
+    block.allocationCount--;
+    block.usedBytes -= size;
+
+    if (strategy == AllocationStrategy::Linear) {
+        if (block.allocationCount == 0) {
+            block.cursor = 0;
+        }
+        return;
+    }
+
+    auto allocated = block.allocatedOrders.find(offset);
+    uint32_t order = allocated->second;
+    block.allocatedOrders.erase(allocated);
+
+    uint32_t maxOrder = static_cast<uint32_t>(block.freeLists.size() - 1);
+    while (order < maxOrder) {
+        VkDeviceSize buddy = offset ^ (MIN_BUDDY_SIZE << order);
+        if (block.freeLists[order].erase(buddy) == 0) {
+            break;
+        }
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    block.freeLists[order].insert(offset);
+}
+
+std::vector<MemoryPoolStats> MemoryAllocator::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<MemoryPoolStats> stats;
+    for (const MemoryPool &pool : pools) {
+        MemoryPoolStats poolStats{pool.memoryTypeIndex, pool.strategy, pool.optimalTiling,
+                                  static_cast<uint32_t>(pool.blocks.size()), 0, 0, 0};
+        for (const auto &block : pool.blocks) {
+            poolStats.allocationCount += block->allocationCount;
+            poolStats.usedBytes += block->usedBytes;
+            poolStats.reservedBytes += block->size;
+        }
+        stats.push_back(poolStats);
+    }
+    return stats;
+}
+
+void MemoryAllocator::logStats() {
+    for (const MemoryPoolStats &stats : getStats()) {
+        LOG_INFO("Memory pool type %u %s%s: %u blocks, %u allocations, %llu / %llu KiB",
+                 stats.memoryTypeIndex,
+                 stats.strategy == AllocationStrategy::Buddy ? "buddy" : "linear",
+                 stats.optimalTiling ? " (optimal images)" : "",
+                 stats.blockCount, stats.allocationCount,
+                 (unsigned long long) stats.usedBytes / 1024,
+                 (unsigned long long) stats.reservedBytes / 1024);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    LOG_INFO("Dedicated allocations: %u, %llu KiB; %u of %u device memory objects in use",
+             dedicatedCount, (unsigned long long) dedicatedBytes / 1024, deviceMemoryCount,
+             maxAllocationCount);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+    for (MemoryPool &pool : pools) {
+        for (auto &block : pool.blocks) {
+            if (block->allocationCount != 0) {
+                LOG_ERR("Memory block destroyed with %u live allocations", block->allocationCount);
+            }
+            freeDeviceMemory(block->memory, pool.memoryTypeIndex);
+        }
+    }
+    if (dedicatedCount != 0) {
+        LOG_ERR("%u dedicated allocations leaked", dedicatedCount);
+    }
+}
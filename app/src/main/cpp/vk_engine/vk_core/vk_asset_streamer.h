@@ -0,0 +1,503 @@
+#pragma once
+
+#include "vk_mesh.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+enum class Residency {
+    Unloaded,
+    // Being read or decoded by the streamer's threads.
+    Loading,
+    // Decoded and waiting for budget, or its copy is executing on the GPU.
+    Uploading,
+    Resident,
+    Failed
+};
+
+struct StreamingStats {
+    uint32_t assetCount = 0;
+    uint32_t residentCount = 0;
+    uint32_t loadingCount = 0;
+    uint32_t uploadingCount = 0;
+    uint32_t failedCount = 0;
+    // Device-local memory held by resident and uploading assets.
+    VkDeviceSize residentBytes = 0;
+    VkDeviceSize budget = 0;
+    uint64_t evictionCount = 0;
+};
+
+/*
+ * Streaming priority of an asset drawn within a world-space (center.xyz,
+ * radius.w) sphere: how much of the view it covers from camera, in (0, 1].
+ * Visible assets are shifted above every invisible one.
+ */
+inline float computeStreamingPriority(const glm::vec4 &sphere, const glm::vec3 &camera,
+                                      bool visible) {
+    float distance = std::max(glm::length(glm::vec3(sphere) - camera) - sphere.w, 0.0f);
+    float size = sphere.w / (sphere.w + distance + 1e-6f);
+    return visible ? 1.0f + size : size;
+}
+
+/*
+ * AssetStreamer loads mesh files in the background so that the render thread
+ * never waits on storage:
+ *
+ * 	- I/O threads open the file and fault its mapping in.
+ * 	- Decode threads copy it into a staging buffer and, when asked for,
+ * 	  decode a CPU-side MeshData.
+ * 	- update(), on the render thread, submits the copy into device-local
+ * 	  buffers with a fence and polls the fences of earlier copies. It never
+ * 	  waits on them.
+ *
+ * Both thread pools take the highest-priority job first. Assets are
+ * requested every frame they are wanted, with a priority such as
+ * computeStreamingPriority; the first request queues the load. Resident
+ * assets count against the memory budget; when a new one does not fit, the
+ * least recently requested assets not requested in the last frame are
+ * evicted. Evicted meshes are destroyed once the frames that could still
+ * draw them have completed, so callers must request an asset in every frame
+ * they draw it.
+ */
+class AssetStreamer {
+public:
+    AssetStreamer(Device& device, MemoryAllocator& allocator, const FileSystem& fileSystem,
+                  VkDeviceSize budget, uint32_t ioThreadCount = 1,
+                  uint32_t decodeThreadCount = 0);
+    ~AssetStreamer();
+
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    uint32_t addMesh(const std::string &path, bool keepMeshData = false);
+    void request(uint32_t asset, float priority);
+    void update(uint64_t frameValue, uint64_t completedValue);
+    void retire(std::unique_ptr<Mesh> mesh, uint64_t lastFrameValue);
+    void setBudget(VkDeviceSize budget) { this->budget = budget; }
+
+    Residency getResidency(uint32_t asset) const { return assets[asset]->residency; }
+    const Mesh* getMesh(uint32_t asset) const;
+    const MeshData* getMeshData(uint32_t asset) const;
+    StreamingStats getStats() const;
+    void logStats() const;
+
+private:
+    struct Asset {
+        uint32_t index;
+        std::string path;
+        bool keepMeshData;
+        // Set by the render thread, read by the threads picking a job.
+        std::atomic<float> priority{0.0f};
+
+        // Render thread only.
+        Residency residency = Residency::Unloaded;
+        uint64_t lastRequested = 0;
+        std::chrono::steady_clock::time_point requestTime;
+        std::unique_ptr<Mesh> mesh;
+
+        // Owned by the stage holding the asset; stages hand assets over
+        // under queueMutex.
+        MeshFile file;
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        MemoryAllocation staging;
+        std::unique_ptr<MeshData> meshData;
+        bool failed = false;
+    };
+
+    struct Upload {
+        uint32_t asset;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+    };
+
+    struct RetiredMesh {
+        std::unique_ptr<Mesh> mesh;
+        // Last frame that may draw it.
+        uint64_t frameValue;
+    };
+
+    Device& device;
+    MemoryAllocator& allocator;
+    const FileSystem& fileSystem;
+    VkDeviceSize budget;
+
+    // Assets are only added on the render thread; the other threads reach
+    // them through the queues.
+    std::vector<std::unique_ptr<Asset>> assets;
+
+    std::mutex queueMutex;
+    std::condition_variable ioCondition;
+    std::condition_variable decodeCondition;
+    std::vector<Asset *> readQueue;
+    std::vector<Asset *> decodeQueue;
+    std::vector<Asset *> loaded;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    // Render thread only.
+    std::vector<Asset *> waiting;
+    std::vector<Upload> uploads;
+    std::vector<Upload> freeUploads;
+    std::vector<RetiredMesh> retired;
+    VkCommandPool commandPool;
+    uint64_t frameValue = 0;
+    VkDeviceSize residentBytes = 0;
+    uint64_t evictionCount = 0;
+
+    static Asset *popHighestPriority(std::vector<Asset *> &queue);
+    void ioLoop();
+    void decodeLoop();
+    bool makeRoom(VkDeviceSize size);
+    void startUpload(Asset &asset);
+    void releaseStaging(Asset &asset);
+};
+
+AssetStreamer::AssetStreamer(Device &device, MemoryAllocator &allocator,
+                             const FileSystem &fileSystem, VkDeviceSize budget,
+                             uint32_t ioThreadCount, uint32_t decodeThreadCount)
+        : device(device), allocator(allocator), fileSystem(fileSystem), budget(budget) {
+    QueueFamilyIndices queueFamilyIndices = device.findQueueFamilies(device.getPhysicalDevice());
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                     VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    VK_CHECK(vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPool));
+
+    if (decodeThreadCount == 0) {
+        // Decoding is mostly memcpy; leave the cores to rendering.
+        decodeThreadCount = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 2u);
+    }
+    for (uint32_t i = 0; i < std::max(ioThreadCount, 1u); i++) {
+        threads.emplace_back(&AssetStreamer::ioLoop, this);
+    }
+    for (uint32_t i = 0; i < decodeThreadCount; i++) {
+        threads.emplace_back(&AssetStreamer::decodeLoop, this);
+    }
+}
+
+/*
+ * Nothing is loaded until the asset is requested. With keepMeshData the
+ * decoded MeshData is kept next to the mesh, e.g. for picking.
+ */
+uint32_t AssetStreamer::addMesh(const std::string &path, bool keepMeshData) {
+    auto asset = std::make_unique<Asset>();
+    asset->index = static_cast<uint32_t>(assets.size());
+    asset->path = path;
+    asset->keepMeshData = keepMeshData;
+    assets.push_back(std::move(asset));
+    return assets.back()->index;
+}
+
+/*
+ * Marks asset as wanted in the current frame. Higher priorities load first.
+ */
+void AssetStreamer::request(uint32_t asset, float priority) {
+    Asset &entry = *assets[asset];
+    entry.priority.store(priority, std::memory_order_relaxed);
+    entry.lastRequested = frameValue;
+    if (entry.residency != Residency::Unloaded) {
+        return;
+    }
+    entry.residency = Residency::Loading;
+    entry.requestTime = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    readQueue.push_back(&entry);
+    ioCondition.notify_one();
+}
+
+const Mesh *AssetStreamer::getMesh(uint32_t asset) const {
+    const Asset &entry = *assets[asset];
+    return entry.residency == Residency::Resident ? entry.mesh.get() : nullptr;
+}
+
+const MeshData *AssetStreamer::getMeshData(uint32_t asset) const {
+    const Asset &entry = *assets[asset];
+    return entry.residency == Residency::Resident ? entry.meshData.get() : nullptr;
+}
+
+/*
+ * Called once per frame before the frame's requests. frameValue identifies
+ * the frame being recorded and completedValue the last one the GPU finished,
+ * as FrameScheduler counts them.
+ */
+void AssetStreamer::update(uint64_t frameValue, uint64_t completedValue) {
+    this->frameValue = frameValue;
+
+    for (size_t i = 0; i < uploads.size();) {
+        Upload upload = uploads[i];
+        if (vkGetFenceStatus(device.getDevice(), upload.fence) != VK_SUCCESS) {
+            i++;
+            continue;
+        }
+        Asset &asset = *assets[upload.asset];
+        releaseStaging(asset);
+        asset.file = MeshFile();
+        asset.residency = Residency::Resident;
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() -
+                                                            asset.requestTime).count();
+        LOG_INFO("Streamed %s: %.0f KiB in %.1f ms", asset.path.c_str(),
+                 asset.mesh->getMemorySize() / 1024.0, ms);
+
+        VK_CHECK(vkResetFences(device.getDevice(), 1, &upload.fence));
+        freeUploads.push_back(upload);
+        uploads[i] = uploads.back();
+        uploads.pop_back();
+    }
+
+    for (size_t i = 0; i < retired.size();) {
+        if (retired[i].frameValue <= completedValue) {
+            retired[i] = std::move(retired.back());
+            retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        waiting.insert(waiting.end(), loaded.begin(), loaded.end());
+        loaded.clear();
+    }
+    std::stable_sort(waiting.begin(), waiting.end(), [](const Asset *a, const Asset *b) {
+        return a->priority.load(std::memory_order_relaxed) >
+               b->priority.load(std::memory_order_relaxed);
+    });
+    std::vector<Asset *> stillWaiting;
+    for (Asset *asset : waiting) {
+        if (asset->failed) {
+            LOG_ERR("Failed to stream %s", asset->path.c_str());
+            asset->file = MeshFile();
+            asset->residency = Residency::Failed;
+            continue;
+        }
+        asset->residency = Residency::Uploading;
+        VkDeviceSize size = asset->file.getSection(MESH_SECTION_VERTICES).size +
+                            asset->file.getSection(MESH_SECTION_INDICES).size;
+        if (makeRoom(size)) {
+            startUpload(*asset);
+        } else if (asset->lastRequested + 1 < frameValue) {
+            // Nobody wants it any more; free its staging memory.
+            releaseStaging(*asset);
+            asset->file = MeshFile();
+            asset->meshData = nullptr;
+            asset->residency = Residency::Unloaded;
+        } else {
+            stillWaiting.push_back(asset);
+        }
+    }
+    waiting = std::move(stillWaiting);
+}
+
+/*
+ * Takes a mesh the caller stopped drawing, e.g. one a streamed asset
+ * replaced, and destroys it along with the evicted meshes once the GPU has
+ * completed lastFrameValue, the last frame that may draw it.
+ */
+void AssetStreamer::retire(std::unique_ptr<Mesh> mesh, uint64_t lastFrameValue) {
+    retired.push_back({std::move(mesh), lastFrameValue});
+}
+
+StreamingStats AssetStreamer::getStats() const {
+    StreamingStats stats;
+    stats.assetCount = static_cast<uint32_t>(assets.size());
+    for (const auto &asset : assets) {
+        stats.residentCount += asset->residency == Residency::Resident;
+        stats.loadingCount += asset->residency == Residency::Loading;
+        stats.uploadingCount += asset->residency == Residency::Uploading;
+        stats.failedCount += asset->residency == Residency::Failed;
+    }
+    stats.residentBytes = residentBytes;
+    stats.budget = budget;
+    stats.evictionCount = evictionCount;
+    return stats;
+}
+
+void AssetStreamer::logStats() const {
+    StreamingStats stats = getStats();
+    LOG_INFO("Streaming: %u of %u assets resident, %u loading, %u uploading, %u failed, "
+             "%.1f of %.1f MiB, %llu evictions", stats.residentCount, stats.assetCount,
+             stats.loadingCount, stats.uploadingCount, stats.failedCount,
+             stats.residentBytes / (1024.0 * 1024.0), stats.budget / (1024.0 * 1024.0),
+             static_cast<unsigned long long>(stats.evictionCount));
+}
+
+AssetStreamer::Asset *AssetStreamer::popHighestPriority(std::vector<Asset *> &queue) {
+    auto highest = std::max_element(queue.begin(), queue.end(), [](const Asset *a, const Asset *b) {
+        return a->priority.load(std::memory_order_relaxed) <
+               b->priority.load(std::memory_order_relaxed);
+    });
+    Asset *asset = *highest;
+    *highest = queue.back();
+    queue.pop_back();
+    return asset;
+}
+
+void AssetStreamer::ioLoop() {
+    while (true) {
+        Asset *asset;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            ioCondition.wait(lock, [this] { return stopping || !readQueue.empty(); });
+            if (stopping) {
+                return;
+            }
+            asset = popHighestPriority(readQueue);
+        }
+
+        asset->file = MeshFile::open(fileSystem, asset->path);
+        if (asset->file) {
+            // Touch every page so decode threads never wait on storage.
+            volatile uint8_t sink = 0;
+            for (MeshFileSection section : {MESH_SECTION_VERTICES, MESH_SECTION_INDICES}) {
+                ByteSpan bytes = asset->file.getSection(section);
+                for (size_t offset = 0; offset < bytes.size; offset += 4096) {
+                    sink = sink + bytes.data[offset];
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (asset->file) {
+            decodeQueue.push_back(asset);
+            decodeCondition.notify_one();
+        } else {
+            asset->failed = true;
+            loaded.push_back(asset);
+        }
+    }
+}
+
+void AssetStreamer::decodeLoop() {
+    while (true) {
+        Asset *asset;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            decodeCondition.wait(lock, [this] { return stopping || !decodeQueue.empty(); });
+            if (stopping) {
+                return;
+            }
+            asset = popHighestPriority(decodeQueue);
+        }
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = Mesh::getStagingSize(asset->file);
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr,
+                                &asset->stagingBuffer));
+        asset->staging = allocator.allocateBuffer(
+                asset->stagingBuffer,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+                AllocationStrategy::Linear);
+        Mesh::writeStaging(asset->file, asset->staging.mapped);
+        if (asset->keepMeshData) {
+            asset->meshData = std::make_unique<MeshData>(asset->file.decode());
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        loaded.push_back(asset);
+    }
+}
+
+/*
+ * Evicts least recently requested assets until size more bytes fit in the
+ * budget. Assets requested in the current or the previous frame stay.
+ */
+bool AssetStreamer::makeRoom(VkDeviceSize size) {
+    while (residentBytes + size > budget) {
+        Asset *victim = nullptr;
+        for (const auto &asset : assets) {
+            if (asset->residency == Residency::Resident && asset->lastRequested + 1 < frameValue &&
+                (!victim || asset->lastRequested < victim->lastRequested)) {
+                victim = asset.get();
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        residentBytes -= victim->mesh->getMemorySize();
+        retired.push_back({std::move(victim->mesh), victim->lastRequested});
+        victim->meshData = nullptr;
+        victim->residency = Residency::Unloaded;
+        evictionCount++;
+    }
+    return true;
+}
+
+void AssetStreamer::startUpload(Asset &asset) {
+    Upload upload{};
+    if (!freeUploads.empty()) {
+        upload = freeUploads.back();
+        freeUploads.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device.getDevice(), &allocInfo,
+                                          &upload.commandBuffer));
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK(vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &upload.fence));
+    }
+    upload.asset = asset.index;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(upload.commandBuffer, &beginInfo));
+    asset.mesh = std::make_unique<Mesh>(device, allocator, asset.file, upload.commandBuffer,
+                                        asset.stagingBuffer);
+    VK_CHECK(vkEndCommandBuffer(upload.commandBuffer));
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &upload.commandBuffer;
+    VK_CHECK(vkQueueSubmit(device.getGraphicsQueue(), 1, &submitInfo, upload.fence));
+
+    residentBytes += asset.mesh->getMemorySize();
+    asset.residency = Residency::Uploading;
+    uploads.push_back(upload);
+}
+
+void AssetStreamer::releaseStaging(Asset &asset) {
+    if (asset.stagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device.getDevice(), asset.stagingBuffer, nullptr);
+        allocator.free(asset.staging);
+        asset.stagingBuffer = VK_NULL_HANDLE;
+    }
+}
+
+AssetStreamer::~AssetStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    ioCondition.notify_all();
+    decodeCondition.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (const auto &upload : uploads) {
+        VK_CHECK(vkWaitForFences(device.getDevice(), 1, &upload.fence, VK_TRUE, UINT64_MAX));
+    }
+    uploads.insert(uploads.end(), freeUploads.begin(), freeUploads.end());
+    for (const auto &upload : uploads) {
+        vkDestroyFence(device.getDevice(), upload.fence, nullptr);
+    }
+    // Jobs the threads had started are finished, the rest were dropped. The
+    // frames that drew the meshes must have completed.
+    for (auto &asset : assets) {
+        releaseStaging(*asset);
+        asset->mesh = nullptr;
+    }
+    retired.clear();
+    vkDestroyCommandPool(device.getDevice(), commandPool, nullptr);
+}
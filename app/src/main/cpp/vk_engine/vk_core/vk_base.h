@@ -1,17 +1,35 @@
+#pragma once
+
+#ifdef __ANDROID__
+#include "android/asset_manager.h"
 #include "android/log.h"
 #include "android/native_window.h"
 #include "android/native_window_jni.h"
+#endif
 
 #include "assert.h"
 #include "vulkan/vulkan.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
 namespace vkt
 {
 #define LOG_TAG "yavcp"
+#ifdef __ANDROID__
 #define LOG_INFO(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOG_ERR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+// Host tools (see tools/mesh_converter) share the CPU-side headers.
+#define LOG_INFO(...) (fprintf(stdout, __VA_ARGS__), fputc('\n', stdout))
+#define LOG_ERR(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#endif
 #define VK_CHECK(x)                           \
   do {                                        \
     VkResult err = x;                         \
@@ -21,7 +39,15 @@ namespace vkt
     }                                         \
   } while (0)
 
-    const int MAX_FRAMES_IN_FLIGHT = 2;
+    /*
+     * Number of frames the CPU is allowed to record ahead of the GPU. This is a
+     * runtime setting (see VKCore::setFramesInFlight) clamped to the range
+     * below; every per-frame ring (uniform buffers, descriptor sets, command
+     * buffers) is sized from the active value rather than from these bounds.
+     */
+    const uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+    const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+    const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
 
     struct UniformBufferObject {
         glm::mat4 model;
@@ -29,6 +55,19 @@ namespace vkt
         glm::mat4 proj;
     };
 
+    /*
+     * A single indexed draw of the scene mesh, laid out like
+     * VkDrawIndexedIndirectCommand. The draw list is what gets split across
+     * threads when recording in parallel.
+     */
+    struct DrawCommand {
+        uint32_t indexCount;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t firstInstance;
+    };
+
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
@@ -44,24 +83,11 @@ namespace vkt
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+#ifdef __ANDROID__
     struct ANativeWindowDeleter {
         void operator()(ANativeWindow *window) { ANativeWindow_release(window); }
     };
-
-    std::vector<uint8_t> LoadBinaryFileToVector(const char *file_path,
-                                                AAssetManager *assetManager) {
-        std::vector<uint8_t> file_content;
-        assert(assetManager);
-        AAsset *file =
-                AAssetManager_open(assetManager, file_path, AASSET_MODE_BUFFER);
-        size_t file_length = AAsset_getLength(file);
-
-        file_content.resize(file_length);
-
-        AAsset_read(file, file_content.data(), file_length);
-        AAsset_close(file);
-        return file_content;
-    }
+#endif
 
     const char *toStringMessageSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT s) {
         switch (s) {
@@ -111,7 +137,7 @@ namespace vkt
         return VK_FALSE;
     }
 
-    static void populateDebugMessengerCreateInfo(
+    inline void populateDebugMessengerCreateInfo(
             VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
         createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -124,7 +150,7 @@ namespace vkt
         createInfo.pfnUserCallback = debugCallback;
     }
 
-    static VkResult CreateDebugUtilsMessengerEXT(
+    inline VkResult CreateDebugUtilsMessengerEXT(
             VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
             const VkAllocationCallbacks *pAllocator,
             VkDebugUtilsMessengerEXT *pDebugMessenger) {
@@ -137,7 +163,7 @@ namespace vkt
         }
     }
 
-    static void DestroyDebugUtilsMessengerEXT(
+    inline void DestroyDebugUtilsMessengerEXT(
             VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
             const VkAllocationCallbacks *pAllocator) {
         auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
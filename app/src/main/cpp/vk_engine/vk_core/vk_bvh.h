@@ -0,0 +1,480 @@
+#pragma once
+
+#include "vk_frustum.h"
+
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include "glm/gtx/intersect.hpp"
+
+#include <functional>
+
+/*
+ * Half a cache line: two siblings share one 64-byte line. An interior node
+ * stores the index of its left child in first, with the right child right
+ * after it; a leaf stores the start of its range in the primitive order and a
+ * non-zero count.
+ */
+struct alignas(32) BvhNode {
+    glm::vec3 minimum;
+    uint32_t first;
+    glm::vec3 maximum;
+    uint32_t count;
+
+    bool isLeaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay half a cache line");
+
+struct RayHit {
+    uint32_t primitive;
+    float distance;
+};
+
+/*
+ * Bounding volume hierarchy over the AABBs of a set of primitives, addressed
+ * by their index in the vector passed to build().
+ *
+ * build() (and rebuild()) runs a binned SAH build. Moving primitives are
+ * handled incrementally instead: update() records the new bounds, and refit()
+ * grows or shrinks just the nodes above them while keeping the topology. A
+ * refitted tree degrades as primitives drift away from their original
+ * neighbours, which needsRebuild() reports by comparing its SAH cost to the
+ * cost right after the last build.
+ *
+ * Children are always stored after their parent, which refit() relies on.
+ */
+class Bvh {
+public:
+    using HitTest = std::function<bool(uint32_t primitive, float &distance)>;
+
+    void build(const std::vector<Aabb> &bounds);
+    void rebuild();
+    void update(uint32_t primitive, const Aabb &bounds);
+    void refit();
+    bool needsRebuild() const { return getCost() > buildCost * REBUILD_COST_RATIO; }
+
+    uint32_t getPrimitiveCount() const { return static_cast<uint32_t>(primitiveBounds.size()); }
+    uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+    float getCost() const;
+
+    uint32_t cullFrustum(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                 const HitTest &hitTest = nullptr) const;
+
+private:
+    static constexpr uint32_t BIN_COUNT = 12;
+    static constexpr uint32_t MAX_LEAF_SIZE = 8;
+    static constexpr float TRAVERSAL_COST = 1.0f;
+    static constexpr float INTERSECTION_COST = 1.0f;
+    static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> primitiveLeaves;
+    std::vector<Aabb> primitiveBounds;
+
+    // Sum of every node's surface area weighted by the work it costs to
+    // visit, kept up to date by refit() so the SAH cost stays O(1) to read.
+    float weightedArea = 0.0f;
+    float buildCost = 0.0f;
+
+    std::vector<uint8_t> dirtyNodes;
+    std::vector<uint32_t> dirtyList;
+
+    uint32_t allocateNode(uint32_t parent);
+    void setNodeBounds(uint32_t node, const Aabb &bounds);
+    float getNodeWeight(const BvhNode &node) const;
+    void split(uint32_t node, const std::vector<glm::vec3> &centroids,
+               std::vector<uint32_t> &pending);
+};
+
+inline Aabb getNodeBounds(const BvhNode &node) {
+    return {node.minimum, node.maximum};
+}
+
+/*
+ * Distance along the ray at which it enters box, or INFINITY when it misses.
+ * inverseDirection is 1 / direction per axis; infinities for axis-parallel
+ * rays are handled by the min/max ordering.
+ */
+inline float intersectRayAabb(const glm::vec3 &origin, const glm::vec3 &inverseDirection,
+                              const glm::vec3 &minimum, const glm::vec3 &maximum) {
+    glm::vec3 near = (minimum - origin) * inverseDirection;
+    glm::vec3 far = (maximum - origin) * inverseDirection;
+    glm::vec3 entry = glm::min(near, far);
+    glm::vec3 exit = glm::max(near, far);
+    float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.0f));
+    float leave = std::min(std::min(exit.x, exit.y), exit.z);
+    return enter <= leave ? enter : INFINITY;
+}
+
+void Bvh::build(const std::vector<Aabb> &bounds) {
+    primitiveBounds = bounds;
+    rebuild();
+}
+
+/*
+ * Rebuilds the tree from the current primitive bounds, including any updates
+ * not refitted yet.
+ */
+void Bvh::rebuild() {
+    uint32_t count = getPrimitiveCount();
+    nodes.clear();
+    parents.clear();
+    dirtyList.clear();
+    order.resize(count);
+    primitiveLeaves.resize(count);
+    weightedArea = 0.0f;
+    buildCost = 0.0f;
+    if (count == 0) {
+        dirtyNodes.clear();
+        return;
+    }
+
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+        centroids[i] = primitiveBounds[i].getCenter();
+    }
+
+    // A binary tree with at most one primitive per leaf has 2n - 1 nodes.
+    nodes.reserve(2 * count - 1);
+    parents.reserve(2 * count - 1);
+
+    uint32_t root = allocateNode(UINT32_MAX);
+    nodes[root].first = 0;
+    nodes[root].count = count;
+
+    std::vector<uint32_t> pending{root};
+    while (!pending.empty()) {
+        uint32_t node = pending.back();
+        pending.pop_back();
+        split(node, centroids, pending);
+    }
+
+    for (uint32_t index = 0; index < nodes.size(); index++) {
+        const BvhNode &node = nodes[index];
+        weightedArea += getNodeWeight(node) * getNodeBounds(node).getSurfaceArea();
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            primitiveLeaves[order[i]] = index;
+        }
+    }
+    dirtyNodes.assign(nodes.size(), 0);
+    buildCost = getCost();
+}
+
+uint32_t Bvh::allocateNode(uint32_t parent) {
+    nodes.push_back({});
+    parents.push_back(parent);
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void Bvh::setNodeBounds(uint32_t node, const Aabb &bounds) {
+    nodes[node].minimum = bounds.minimum;
+    nodes[node].maximum = bounds.maximum;
+}
+
+float Bvh::getNodeWeight(const BvhNode &node) const {
+    return node.isLeaf() ? INTERSECTION_COST * node.count : TRAVERSAL_COST;
+}
+
+/*
+ * Bounds the node's primitive range and splits it at the cheapest of
+ * BIN_COUNT candidate planes per axis, or keeps it as a leaf when no split is
+ * cheaper than testing every primitive. Ranges above MAX_LEAF_SIZE are always
+ * split, down the middle when every centroid coincides.
+ */
+void Bvh::split(uint32_t node, const std::vector<glm::vec3> &centroids,
+                std::vector<uint32_t> &pending) {
+    uint32_t first = nodes[node].first;
+    uint32_t count = nodes[node].count;
+
+    Aabb bounds = Aabb::empty();
+    Aabb centroidBounds = Aabb::empty();
+    for (uint32_t i = first; i < first + count; i++) {
+        bounds.grow(primitiveBounds[order[i]]);
+        centroidBounds.grow(centroids[order[i]]);
+    }
+    setNodeBounds(node, bounds);
+    if (count <= 1) {
+        return;
+    }
+
+    float bestCost = INFINITY;
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+    glm::vec3 centroidSize = centroidBounds.maximum - centroidBounds.minimum;
+    for (int axis = 0; axis < 3; axis++) {
+        if (centroidSize[axis] <= 0.0f) {
+            continue;
+        }
+        Aabb binBounds[BIN_COUNT];
+        uint32_t binCounts[BIN_COUNT] = {};
+        std::fill(std::begin(binBounds), std::end(binBounds), Aabb::empty());
+        float scale = BIN_COUNT / centroidSize[axis];
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t bin = std::min(BIN_COUNT - 1, static_cast<uint32_t>(
+                    (centroids[order[i]][axis] - centroidBounds.minimum[axis]) * scale));
+            binBounds[bin].grow(primitiveBounds[order[i]]);
+            binCounts[bin]++;
+        }
+
+        // Sweep from the right to get the cost of everything past each plane,
+        // then from the left to combine it with everything before it.
+        float rightCosts[BIN_COUNT];
+        Aabb right = Aabb::empty();
+        uint32_t rightCount = 0;
+        for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--) {
+            right.grow(binBounds[bin]);
+            rightCount += binCounts[bin];
+            rightCosts[bin] = rightCount ? right.getSurfaceArea() * rightCount : 0.0f;
+        }
+        Aabb left = Aabb::empty();
+        uint32_t leftCount = 0;
+        for (uint32_t bin = 0; bin < BIN_COUNT - 1; bin++) {
+            left.grow(binBounds[bin]);
+            leftCount += binCounts[bin];
+            if (leftCount == 0 || leftCount == count) {
+                continue;
+            }
+            float cost = left.getSurfaceArea() * leftCount + rightCosts[bin + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0) {
+        float leafCost = INTERSECTION_COST * count;
+        float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / bounds.getSurfaceArea();
+        if (splitCost >= leafCost && count <= MAX_LEAF_SIZE) {
+            return;
+        }
+        float scale = BIN_COUNT / centroidSize[bestAxis];
+        float minimum = centroidBounds.minimum[bestAxis];
+        auto *splitPoint = std::partition(
+                order.data() + first, order.data() + first + count, [&](uint32_t primitive) {
+                    uint32_t bin = std::min(BIN_COUNT - 1, static_cast<uint32_t>(
+                            (centroids[primitive][bestAxis] - minimum) * scale));
+                    return bin <= bestBin;
+                });
+        middle = static_cast<uint32_t>(splitPoint - order.data());
+    } else {
+        if (count <= MAX_LEAF_SIZE) {
+            return;
+        }
+        middle = first + count / 2;
+    }
+
+    uint32_t left = allocateNode(node);
+    uint32_t right = allocateNode(node);
+    nodes[left].first = first;
+    nodes[left].count = middle - first;
+    nodes[right].first = middle;
+    nodes[right].count = first + count - middle;
+    nodes[node].first = left;
+    nodes[node].count = 0;
+    pending.push_back(right);
+    pending.push_back(left);
+}
+
+/*
+ * Records new bounds for a primitive. The tree only reflects them after the
+ * next refit() or rebuild().
+ */
+void Bvh::update(uint32_t primitive, const Aabb &bounds) {
+    primitiveBounds[primitive] = bounds;
+    for (uint32_t node = primitiveLeaves[primitive]; node != UINT32_MAX; node = parents[node]) {
+        if (dirtyNodes[node]) {
+            break;
+        }
+        dirtyNodes[node] = 1;
+        dirtyList.push_back(node);
+    }
+}
+
+/*
+ * Recomputes the bounds of the nodes above updated primitives. Children have
+ * higher indices than their parent, so walking the dirty nodes from the
+ * highest index down always refits children first.
+ */
+void Bvh::refit() {
+    if (dirtyList.empty()) {
+        return;
+    }
+    std::sort(dirtyList.begin(), dirtyList.end(), std::greater<uint32_t>());
+    for (uint32_t index : dirtyList) {
+        BvhNode &node = nodes[index];
+        Aabb bounds = Aabb::empty();
+        if (node.isLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                bounds.grow(primitiveBounds[order[i]]);
+            }
+        } else {
+            bounds.grow(getNodeBounds(nodes[node.first]));
+            bounds.grow(getNodeBounds(nodes[node.first + 1]));
+        }
+        float weight = getNodeWeight(node);
+        weightedArea += weight * (bounds.getSurfaceArea() - getNodeBounds(node).getSurfaceArea());
+        setNodeBounds(index, bounds);
+        dirtyNodes[index] = 0;
+    }
+    dirtyList.clear();
+}
+
+/*
+ * Expected cost of a query relative to the root's surface area, as estimated
+ * by the surface area heuristic.
+ */
+float Bvh::getCost() const {
+    if (nodes.empty()) {
+        return 0.0f;
+    }
+    float rootArea = getNodeBounds(nodes[0]).getSurfaceArea();
+    return rootArea > 0.0f ? weightedArea / rootArea : 0.0f;
+}
+
+/*
+ * Collects the primitives whose bounds intersect the frustum, in no
+ * particular order. A plane is dropped from the tests below a node that lies
+ * entirely on its inner side, so subtrees fully inside the frustum are
+ * accepted without testing their primitives.
+ */
+uint32_t Bvh::cullFrustum(const Frustum &frustum, std::vector<uint32_t> &visible) const {
+    visible.clear();
+    if (nodes.empty()) {
+        return 0;
+    }
+
+    glm::vec3 planeNormals[Frustum::PLANE_COUNT];
+    glm::vec3 planeReach[Frustum::PLANE_COUNT];
+    for (uint32_t plane = 0; plane < Frustum::PLANE_COUNT; plane++) {
+        planeNormals[plane] = glm::vec3(frustum.planes[plane]);
+        planeReach[plane] = glm::abs(planeNormals[plane]);
+    }
+    const uint32_t allPlanes = (1u << Frustum::PLANE_COUNT) - 1;
+
+    // Tests box against the planes in mask. Returns false if it is outside
+    // one of them, otherwise clears the planes it is entirely inside of.
+    auto testBox = [&](const glm::vec3 &minimum, const glm::vec3 &maximum, uint32_t &mask) {
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        glm::vec3 extent = (maximum - minimum) * 0.5f;
+        for (uint32_t plane = 0; plane < Frustum::PLANE_COUNT; plane++) {
+            if (!(mask & (1u << plane))) {
+                continue;
+            }
+            float distance = glm::dot(planeNormals[plane], center) + frustum.planes[plane].w;
+            float reach = glm::dot(planeReach[plane], extent);
+            if (distance < -reach) {
+                return false;
+            }
+            if (distance >= reach) {
+                mask &= ~(1u << plane);
+            }
+        }
+        return true;
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{0, allPlanes}};
+    while (!stack.empty()) {
+        uint32_t index = stack.back().first;
+        uint32_t mask = stack.back().second;
+        stack.pop_back();
+
+        const BvhNode &node = nodes[index];
+        if (mask && !testBox(node.minimum, node.maximum, mask)) {
+            continue;
+        }
+        if (!node.isLeaf()) {
+            stack.emplace_back(node.first + 1, mask);
+            stack.emplace_back(node.first, mask);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t primitive = order[i];
+            uint32_t primitiveMask = mask;
+            const Aabb &bounds = primitiveBounds[primitive];
+            if (!mask || testBox(bounds.minimum, bounds.maximum, primitiveMask)) {
+                visible.push_back(primitive);
+            }
+        }
+    }
+    return static_cast<uint32_t>(visible.size());
+}
+
+/*
+ * Finds the closest primitive along the ray. Without hitTest a primitive is
+ * hit where the ray enters its bounds; with it, hitTest decides for every
+ * primitive whose bounds the ray enters before the closest hit so far,
+ * returning the distance along the ray in the units of direction.
+ *
+ * Nodes are visited nearest first, so most of the tree behind the first hit
+ * is never touched.
+ */
+bool Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                  const HitTest &hitTest) const {
+    hit = {UINT32_MAX, INFINITY};
+    if (nodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    std::vector<std::pair<uint32_t, float>> stack;
+    float rootDistance = intersectRayAabb(origin, inverseDirection, nodes[0].minimum,
+                                          nodes[0].maximum);
+    if (rootDistance < INFINITY) {
+        stack.emplace_back(0, rootDistance);
+    }
+    while (!stack.empty()) {
+        uint32_t index = stack.back().first;
+        float distance = stack.back().second;
+        stack.pop_back();
+        if (distance >= hit.distance) {
+            continue;
+        }
+
+        const BvhNode &node = nodes[index];
+        if (node.isLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t primitive = order[i];
+                const Aabb &bounds = primitiveBounds[primitive];
+                float primitiveDistance = intersectRayAabb(origin, inverseDirection,
+                                                           bounds.minimum, bounds.maximum);
+                if (primitiveDistance >= hit.distance) {
+                    continue;
+                }
+                if (hitTest && !hitTest(primitive, primitiveDistance)) {
+                    continue;
+                }
+                if (primitiveDistance < hit.distance) {
+                    hit = {primitive, primitiveDistance};
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.first;
+        uint32_t farChild = node.first + 1;
+        float nearDistance = intersectRayAabb(origin, inverseDirection, nodes[nearChild].minimum,
+                                              nodes[nearChild].maximum);
+        float farDistance = intersectRayAabb(origin, inverseDirection, nodes[farChild].minimum,
+                                             nodes[farChild].maximum);
+        if (nearDistance > farDistance) {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+        // Push the farther child first so the nearer one is popped next.
+        if (farDistance < hit.distance) {
+            stack.emplace_back(farChild, farDistance);
+        }
+        if (nearDistance < hit.distance) {
+            stack.emplace_back(nearChild, nearDistance);
+        }
+    }
+    return hit.primitive != UINT32_MAX;
+}
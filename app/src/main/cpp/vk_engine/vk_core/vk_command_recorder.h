@@ -0,0 +1,207 @@
+#pragma once
+
+#include "vk_device.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * CommandRecorder splits the draws of a render pass across a pool of worker
+ * threads. Every worker owns one command pool per frame slot and records a
+ * secondary command buffer for a contiguous range of the draw list. The
+ * secondaries are returned in worker order so the primary executes them
+ * deterministically regardless of which thread finished first.
+ *
+ * Pools are reset as a whole once per frame instead of resetting individual
+ * command buffers; the frame slot has been retired by the FrameScheduler by
+ * the time record() is called for it again.
+ */
+class CommandRecorder {
+public:
+    using RecordFunction = std::function<void(VkCommandBuffer, uint32_t first, uint32_t count)>;
+
+    CommandRecorder(Device& device, uint32_t framesInFlight, uint32_t workerCount = 0);
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder&) = delete;
+    CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+    uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    const std::vector<VkCommandBuffer>& record(uint32_t frameSlot,
+                                               const VkCommandBufferInheritanceInfo &inheritance,
+                                               uint32_t drawCount, const RecordFunction &recordDraws);
+
+private:
+    // Below this many draws per thread the dispatch overhead outweighs the
+    // recording time saved.
+    static constexpr uint32_t MIN_DRAWS_PER_WORKER = 32;
+
+    struct Job {
+        uint32_t frameSlot = 0;
+        const VkCommandBufferInheritanceInfo *inheritance = nullptr;
+        uint32_t drawCount = 0;
+        uint32_t activeWorkers = 0;
+        const RecordFunction *recordDraws = nullptr;
+    };
+
+    Device& device;
+    uint32_t framesInFlight;
+
+    // Indexed by [frameSlot * workerCount + worker].
+    std::vector<VkCommandPool> commandPools;
+    std::vector<VkCommandBuffer> secondaryBuffers;
+    std::vector<VkCommandBuffer> recordedBuffers;
+
+    std::vector<std::thread> workers;
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::condition_variable doneCondition;
+    Job currentJob;
+    uint64_t jobGeneration = 0;
+    uint32_t pendingWorkers = 0;
+    bool stopping = false;
+
+    void createCommandPools();
+    void workerLoop(uint32_t workerIndex);
+    void recordRange(uint32_t workerIndex, const Job &job);
+};
+
+CommandRecorder::CommandRecorder(Device &device, uint32_t framesInFlight, uint32_t workerCount)
+        : device(device), framesInFlight(framesInFlight) {
+    if (workerCount == 0) {
+        // Leave one core for the render thread itself.
+        uint32_t cores = std::max(std::thread::hardware_concurrency(), 2u);
+        workerCount = std::clamp(cores - 1, 1u, 8u);
+    }
+    workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&CommandRecorder::workerLoop, this, i);
+    }
+    createCommandPools();
+
+    LOG_INFO("Command recorder: %u worker threads", workerCount);
+}
+
+void CommandRecorder::createCommandPools() {
+    QueueFamilyIndices queueFamilyIndices = device.findQueueFamilies(device.getPhysicalDevice());
+    uint32_t workerCount = getWorkerCount();
+
+    commandPools.resize(framesInFlight * workerCount);
+    secondaryBuffers.resize(framesInFlight * workerCount);
+    for (size_t i = 0; i < commandPools.size(); i++) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        VK_CHECK(vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPools[i]));
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPools[i];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &secondaryBuffers[i]));
+    }
+}
+
+/*
+ * Records drawCount draws for the given frame slot and blocks until every
+ * worker involved is done. The returned secondaries are meant to be passed
+ * to vkCmdExecuteCommands in order.
+ */
+const std::vector<VkCommandBuffer>& CommandRecorder::record(
+        uint32_t frameSlot, const VkCommandBufferInheritanceInfo &inheritance,
+        uint32_t drawCount, const RecordFunction &recordDraws) {
+    uint32_t activeWorkers = std::clamp(drawCount / MIN_DRAWS_PER_WORKER, 1u, getWorkerCount());
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        currentJob.frameSlot = frameSlot;
+        currentJob.inheritance = &inheritance;
+        currentJob.drawCount = drawCount;
+        currentJob.activeWorkers = activeWorkers;
+        currentJob.recordDraws = &recordDraws;
+        pendingWorkers = activeWorkers;
+        jobGeneration++;
+    }
+    jobCondition.notify_all();
+
+    {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        doneCondition.wait(lock, [this] { return pendingWorkers == 0; });
+    }
+
+    uint32_t workerCount = getWorkerCount();
+    recordedBuffers.assign(secondaryBuffers.begin() + frameSlot * workerCount,
+                           secondaryBuffers.begin() + frameSlot * workerCount + activeWorkers);
+    return recordedBuffers;
+}
+
+void CommandRecorder::workerLoop(uint32_t workerIndex) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCondition.wait(lock, [this, seenGeneration] {
+                return stopping || jobGeneration != seenGeneration;
+            });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = jobGeneration;
+            job = currentJob;
+        }
+
+        if (workerIndex >= job.activeWorkers) {
+            continue;
+        }
+
+        recordRange(workerIndex, job);
+
+        std::lock_guard<std::mutex> lock(jobMutex);
+        if (--pendingWorkers == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
+
+void CommandRecorder::recordRange(uint32_t workerIndex, const Job &job) {
+    size_t index = job.frameSlot * getWorkerCount() + workerIndex;
+    VK_CHECK(vkResetCommandPool(device.getDevice(), commandPools[index], 0));
+
+    // Contiguous ranges keep the draw order identical to single-threaded
+    // recording once the secondaries are executed in worker order.
+    uint32_t first = job.drawCount * workerIndex / job.activeWorkers;
+    uint32_t last = job.drawCount * (workerIndex + 1) / job.activeWorkers;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                      VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = job.inheritance;
+
+    VkCommandBuffer commandBuffer = secondaryBuffers[index];
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    (*job.recordDraws)(commandBuffer, first, last - first);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+CommandRecorder::~CommandRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobCondition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (VkCommandPool pool : commandPools) {
+        vkDestroyCommandPool(device.getDevice(), pool, nullptr);
+    }
+}
@@ -0,0 +1,468 @@
+#pragma once
+
+#include "vk_frustum.h"
+
+#include <vector>
+
+/*
+ * CPU frustum culling over batches of bounding volumes.
+ *
+ * Bounds are stored as structure of arrays so that one SIMD register holds
+ * the same component of 4 (SSE, NEON) or 8 (AVX) objects, and every plane
+ * test is a handful of vertical multiply-adds with no shuffles. The result
+ * is a compact list of visible indices, written branchlessly.
+ *
+ * The instruction sets available follow glm's own detection (GLM_ARCH in
+ * glm/simd/platform.h), which the build enables with GLM_FORCE_INTRINSICS:
+ * NEON on arm64-v8a, SSE on the x86 ABIs, AVX when the compiler targets it.
+ * Every compiled variant can be selected explicitly so they can be compared
+ * against each other and against the scalar reference.
+ */
+enum class CullingIsa {
+    Scalar,
+    Sse,
+    Avx,
+    Neon
+};
+
+const char *getCullingIsaName(CullingIsa isa) {
+    switch (isa) {
+        case CullingIsa::Scalar: return "scalar";
+        case CullingIsa::Sse: return "SSE";
+        case CullingIsa::Avx: return "AVX";
+        case CullingIsa::Neon: return "NEON";
+    }
+    return "unknown";
+}
+
+/*
+ * The variants compiled into this build, scalar first and the widest last.
+ */
+std::vector<CullingIsa> getCullingIsas() {
+    std::vector<CullingIsa> isas = {CullingIsa::Scalar};
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    isas.push_back(CullingIsa::Sse);
+#endif
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    isas.push_back(CullingIsa::Avx);
+#endif
+#if GLM_ARCH & GLM_ARCH_NEON_BIT
+    isas.push_back(CullingIsa::Neon);
+#endif
+    return isas;
+}
+
+CullingIsa getBestCullingIsa() {
+    return getCullingIsas().back();
+}
+
+/*
+ * Bounding spheres, one array per component.
+ */
+struct SphereBounds {
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    size_t size() const { return radius.size(); }
+
+    void resize(size_t count) {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        radius.resize(count);
+    }
+
+    void set(size_t index, const glm::vec4 &sphere) {
+        centerX[index] = sphere.x;
+        centerY[index] = sphere.y;
+        centerZ[index] = sphere.z;
+        radius[index] = sphere.w;
+    }
+};
+
+/*
+ * Axis-aligned boxes as centre and half extent, one array per component.
+ */
+struct BoxBounds {
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+
+    size_t size() const { return centerX.size(); }
+
+    void resize(size_t count) {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        extentX.resize(count);
+        extentY.resize(count);
+        extentZ.resize(count);
+    }
+
+    void set(size_t index, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        glm::vec3 extent = (maximum - minimum) * 0.5f;
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = extent.x;
+        extentY[index] = extent.y;
+        extentZ[index] = extent.z;
+    }
+};
+
+/*
+ * Appends base + lane for every lane set in visibleMask. Each lane is written
+ * unconditionally and only kept by advancing count, which avoids a branch per
+ * object. count never exceeds base + lane, so this stays inside a list sized
+ * for every object.
+ */
+inline uint32_t appendVisible(uint32_t *visible, uint32_t count, uint32_t base,
+                              uint32_t visibleMask, uint32_t width) {
+    for (uint32_t lane = 0; lane < width; lane++) {
+        visible[count] = base + lane;
+        count += (visibleMask >> lane) & 1u;
+    }
+    return count;
+}
+
+static uint32_t cullSpheresScalar(const Frustum &frustum, const SphereBounds &bounds,
+                                  uint32_t begin, uint32_t end, uint32_t *visible,
+                                  uint32_t count) {
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t inside = 1;
+        for (const auto &plane : frustum.planes) {
+            float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] +
+                             plane.z * bounds.centerZ[i] + plane.w;
+            inside &= distance >= -bounds.radius[i];
+        }
+        visible[count] = i;
+        count += inside;
+    }
+    return count;
+}
+
+static uint32_t cullBoxesScalar(const Frustum &frustum, const BoxBounds &bounds, uint32_t begin,
+                                uint32_t end, uint32_t *visible, uint32_t count) {
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t inside = 1;
+        for (const auto &plane : frustum.planes) {
+            float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] +
+                             plane.z * bounds.centerZ[i] + plane.w;
+            // Projection of the half extent on the plane normal.
+            float reach = std::abs(plane.x) * bounds.extentX[i] +
+                          std::abs(plane.y) * bounds.extentY[i] +
+                          std::abs(plane.z) * bounds.extentZ[i];
+            inside &= distance >= -reach;
+        }
+        visible[count] = i;
+        count += inside;
+    }
+    return count;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+static uint32_t cullSpheresSse(const Frustum &frustum, const SphereBounds &bounds,
+                               uint32_t *visible) {
+    __m128 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    __m128 planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+                    _mm_mul_ps(planeZ[p], centerZ)), planeW[p]);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+        }
+        uint32_t visibleMask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xfu;
+        count = appendVisible(visible, count, i, visibleMask, 4);
+    }
+    return cullSpheresScalar(frustum, bounds, i, size, visible, count);
+}
+
+static uint32_t cullBoxesSse(const Frustum &frustum, const BoxBounds &bounds, uint32_t *visible) {
+    __m128 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    __m128 planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    __m128 absX[Frustum::PLANE_COUNT], absY[Frustum::PLANE_COUNT], absZ[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        absX[p] = _mm_set1_ps(std::abs(frustum.planes[p].x));
+        absY[p] = _mm_set1_ps(std::abs(frustum.planes[p].y));
+        absZ[p] = _mm_set1_ps(std::abs(frustum.planes[p].z));
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+                    _mm_mul_ps(planeZ[p], centerZ)), planeW[p]);
+            __m128 reach = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(absX[p], extentX), _mm_mul_ps(absY[p], extentY)),
+                    _mm_mul_ps(absZ[p], extentZ));
+            outside = _mm_or_ps(outside,
+                                _mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), reach)));
+        }
+        uint32_t visibleMask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xfu;
+        count = appendVisible(visible, count, i, visibleMask, 4);
+    }
+    return cullBoxesScalar(frustum, bounds, i, size, visible, count);
+}
+#endif
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+static uint32_t cullSpheresAvx(const Frustum &frustum, const SphereBounds &bounds,
+                               uint32_t *visible) {
+    __m256 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    __m256 planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256 centerX = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 centerY = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 centerZ = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.radius[i]));
+
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(planeX[p], centerX), _mm256_mul_ps(planeY[p], centerY)),
+                    _mm256_mul_ps(planeZ[p], centerZ)), planeW[p]);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+        }
+        uint32_t visibleMask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xffu;
+        count = appendVisible(visible, count, i, visibleMask, 8);
+    }
+    return cullSpheresScalar(frustum, bounds, i, size, visible, count);
+}
+
+static uint32_t cullBoxesAvx(const Frustum &frustum, const BoxBounds &bounds, uint32_t *visible) {
+    __m256 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    __m256 planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    __m256 absX[Frustum::PLANE_COUNT], absY[Frustum::PLANE_COUNT], absZ[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+        absX[p] = _mm256_set1_ps(std::abs(frustum.planes[p].x));
+        absY[p] = _mm256_set1_ps(std::abs(frustum.planes[p].y));
+        absZ[p] = _mm256_set1_ps(std::abs(frustum.planes[p].z));
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256 centerX = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 centerY = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 centerZ = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 extentX = _mm256_loadu_ps(&bounds.extentX[i]);
+        __m256 extentY = _mm256_loadu_ps(&bounds.extentY[i]);
+        __m256 extentZ = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(planeX[p], centerX), _mm256_mul_ps(planeY[p], centerY)),
+                    _mm256_mul_ps(planeZ[p], centerZ)), planeW[p]);
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(absX[p], extentX), _mm256_mul_ps(absY[p], extentY)),
+                    _mm256_mul_ps(absZ[p], extentZ));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(
+                    distance, _mm256_sub_ps(_mm256_setzero_ps(), reach), _CMP_LT_OQ));
+        }
+        uint32_t visibleMask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xffu;
+        count = appendVisible(visible, count, i, visibleMask, 8);
+    }
+    return cullBoxesScalar(frustum, bounds, i, size, visible, count);
+}
+#endif
+
+#if GLM_ARCH & GLM_ARCH_NEON_BIT
+/*
+ * NEON has no movemask; comparison lanes are all ones or all zeros, so one
+ * bit of each is enough.
+ */
+static uint32_t neonVisibleMask(uint32x4_t outside) {
+    return (~vgetq_lane_u32(outside, 0) & 1u) |
+           ((~vgetq_lane_u32(outside, 1) & 1u) << 1) |
+           ((~vgetq_lane_u32(outside, 2) & 1u) << 2) |
+           ((~vgetq_lane_u32(outside, 3) & 1u) << 3);
+}
+
+static uint32_t cullSpheresNeon(const Frustum &frustum, const SphereBounds &bounds,
+                                uint32_t *visible) {
+    float32x4_t planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    float32x4_t planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = vdupq_n_f32(frustum.planes[p].x);
+        planeY[p] = vdupq_n_f32(frustum.planes[p].y);
+        planeZ[p] = vdupq_n_f32(frustum.planes[p].z);
+        planeW[p] = vdupq_n_f32(frustum.planes[p].w);
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        float32x4_t centerX = vld1q_f32(&bounds.centerX[i]);
+        float32x4_t centerY = vld1q_f32(&bounds.centerY[i]);
+        float32x4_t centerZ = vld1q_f32(&bounds.centerZ[i]);
+        float32x4_t negRadius = vnegq_f32(vld1q_f32(&bounds.radius[i]));
+
+        uint32x4_t outside = vdupq_n_u32(0);
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(
+                    vmulq_f32(planeX[p], centerX), vmulq_f32(planeY[p], centerY)),
+                    vmulq_f32(planeZ[p], centerZ)), planeW[p]);
+            outside = vorrq_u32(outside, vcltq_f32(distance, negRadius));
+        }
+        count = appendVisible(visible, count, i, neonVisibleMask(outside), 4);
+    }
+    return cullSpheresScalar(frustum, bounds, i, size, visible, count);
+}
+
+static uint32_t cullBoxesNeon(const Frustum &frustum, const BoxBounds &bounds,
+                              uint32_t *visible) {
+    float32x4_t planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT];
+    float32x4_t planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+    float32x4_t absX[Frustum::PLANE_COUNT], absY[Frustum::PLANE_COUNT];
+    float32x4_t absZ[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        planeX[p] = vdupq_n_f32(frustum.planes[p].x);
+        planeY[p] = vdupq_n_f32(frustum.planes[p].y);
+        planeZ[p] = vdupq_n_f32(frustum.planes[p].z);
+        planeW[p] = vdupq_n_f32(frustum.planes[p].w);
+        absX[p] = vdupq_n_f32(std::abs(frustum.planes[p].x));
+        absY[p] = vdupq_n_f32(std::abs(frustum.planes[p].y));
+        absZ[p] = vdupq_n_f32(std::abs(frustum.planes[p].z));
+    }
+
+    uint32_t size = static_cast<uint32_t>(bounds.size());
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        float32x4_t centerX = vld1q_f32(&bounds.centerX[i]);
+        float32x4_t centerY = vld1q_f32(&bounds.centerY[i]);
+        float32x4_t centerZ = vld1q_f32(&bounds.centerZ[i]);
+        float32x4_t extentX = vld1q_f32(&bounds.extentX[i]);
+        float32x4_t extentY = vld1q_f32(&bounds.extentY[i]);
+        float32x4_t extentZ = vld1q_f32(&bounds.extentZ[i]);
+
+        uint32x4_t outside = vdupq_n_u32(0);
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(
+                    vmulq_f32(planeX[p], centerX), vmulq_f32(planeY[p], centerY)),
+                    vmulq_f32(planeZ[p], centerZ)), planeW[p]);
+            float32x4_t reach = vaddq_f32(vaddq_f32(
+                    vmulq_f32(absX[p], extentX), vmulq_f32(absY[p], extentY)),
+                    vmulq_f32(absZ[p], extentZ));
+            outside = vorrq_u32(outside, vcltq_f32(distance, vnegq_f32(reach)));
+        }
+        count = appendVisible(visible, count, i, neonVisibleMask(outside), 4);
+    }
+    return cullBoxesScalar(frustum, bounds, i, size, visible, count);
+}
+#endif
+
+/*
+ * Fills visible with the indices of the spheres intersecting the frustum, in
+ * ascending order, and returns how many there are. An ISA that is not
+ * compiled in falls back to the scalar path.
+ */
+uint32_t cullSpheres(const Frustum &frustum, const SphereBounds &bounds,
+                     std::vector<uint32_t> &visible, CullingIsa isa = getBestCullingIsa()) {
+    visible.resize(bounds.size());
+    uint32_t count;
+    switch (isa) {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        case CullingIsa::Sse:
+            count = cullSpheresSse(frustum, bounds, visible.data());
+            break;
+#endif
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+        case CullingIsa::Avx:
+            count = cullSpheresAvx(frustum, bounds, visible.data());
+            break;
+#endif
+#if GLM_ARCH & GLM_ARCH_NEON_BIT
+        case CullingIsa::Neon:
+            count = cullSpheresNeon(frustum, bounds, visible.data());
+            break;
+#endif
+        default:
+            count = cullSpheresScalar(frustum, bounds, 0, static_cast<uint32_t>(bounds.size()),
+                                      visible.data(), 0);
+            break;
+    }
+    visible.resize(count);
+    return count;
+}
+
+/*
+ * Box counterpart of cullSpheres. Boxes are tested against each plane
+ * separately, so a box straddling a frustum corner may be kept although it
+ * is outside; it is never the other way round.
+ */
+uint32_t cullBoxes(const Frustum &frustum, const BoxBounds &bounds,
+                   std::vector<uint32_t> &visible, CullingIsa isa = getBestCullingIsa()) {
+    visible.resize(bounds.size());
+    uint32_t count;
+    switch (isa) {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        case CullingIsa::Sse:
+            count = cullBoxesSse(frustum, bounds, visible.data());
+            break;
+#endif
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+        case CullingIsa::Avx:
+            count = cullBoxesAvx(frustum, bounds, visible.data());
+            break;
+#endif
+#if GLM_ARCH & GLM_ARCH_NEON_BIT
+        case CullingIsa::Neon:
+            count = cullBoxesNeon(frustum, bounds, visible.data());
+            break;
+#endif
+        default:
+            count = cullBoxesScalar(frustum, bounds, 0, static_cast<uint32_t>(bounds.size()),
+                                    visible.data(), 0);
+            break;
+    }
+    visible.resize(count);
+    return count;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vk_culling.h"
+
+#include <random>
+
+/*
+ * Measures CPU culling throughput of every ISA compiled into this build and
+ * logs it in objects/ms, for spheres and for boxes. The objects are scattered
+ * through a cube of the given half size around the origin so that the
+ * frustum keeps a realistic share of them. Whether the variants agree with
+ * the scalar reference is left to the host tests (tools/engine_tests).
+ */
+void benchmarkCulling(const Frustum &frustum, uint32_t objectCount = 100000,
+                      uint32_t iterations = 50, float halfSize = 3.0f) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-halfSize, halfSize);
+    std::uniform_real_distribution<float> size(0.01f, 0.2f);
+
+    SphereBounds spheres;
+    BoxBounds boxes;
+    spheres.resize(objectCount);
+    boxes.resize(objectCount);
+    for (uint32_t i = 0; i < objectCount; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extent(size(random), size(random), size(random));
+        spheres.set(i, glm::vec4(center, glm::length(extent)));
+        boxes.set(i, center - extent, center + extent);
+    }
+
+    std::vector<uint32_t> visible;
+    for (int volume = 0; volume < 2; volume++) {
+        auto cull = [&](CullingIsa isa) {
+            return volume == 0 ? cullSpheres(frustum, spheres, visible, isa)
+                               : cullBoxes(frustum, boxes, visible, isa);
+        };
+        const char *volumeName = volume == 0 ? "spheres" : "boxes";
+
+        for (CullingIsa isa : getCullingIsas()) {
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < iterations; i++) {
+                cull(isa);
+            }
+            float elapsedMs = std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+            LOG_INFO("Culling benchmark: %-6s %-7s %8.0f objects/ms (%zu of %u visible)",
+                     getCullingIsaName(isa), volumeName,
+                     static_cast<float>(objectCount) * iterations / elapsedMs, visible.size(),
+                     objectCount);
+        }
+    }
+}
@@ -1,94 +1,141 @@
+#pragma once
+
+#include "vk_instance_buffer.h"
 #include "vk_swapchain.h"
 
+#include <array>
+
+/*
+ * The scene uniforms live in the UniformRing and the instances in the
+ * InstanceBuffer, both with one region per frame in flight, so a single
+ * descriptor set with two dynamic bindings serves every frame; the frame's
+ * regions are selected with dynamic offsets at bind time.
+ */
 class Descriptor {
 public:
-    Descriptor(Device& device, std::vector<VkBuffer>& uniformBuffers);
+    Descriptor(Device& device, VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+               VkDeviceSize instanceRange);
     ~Descriptor();
 
     VkDescriptorSetLayout& getDescriptorSetLayout() { return descriptorSetLayout; }
-    std::vector<VkDescriptorSet> getDescriptorSets() const { return  descriptorSets; }
+    VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+
+    void updateDescriptorSet(VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+                             VkDeviceSize instanceRange);
 
 private:
     Device& device;
 
     VkDescriptorSetLayout descriptorSetLayout;
     VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
+    VkDescriptorSet descriptorSet;
 
     void createDescriptorSetLayout();
     void createDescriptorPool();
-    void createDescriptorSets(std::vector<VkBuffer>& uniformBuffer);
+    void createDescriptorSet();
 };
 
-Descriptor::Descriptor(Device& device, std::vector<VkBuffer>& uniformBuffers) : device(device) {
+Descriptor::Descriptor(Device& device, VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+                       VkDeviceSize instanceRange) : device(device) {
     createDescriptorSetLayout();
     createDescriptorPool();
-    createDescriptorSets(uniformBuffers);
+    createDescriptorSet();
+    updateDescriptorSet(uniformBuffer, instanceBuffer, instanceRange);
 }
 
 void Descriptor::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 1;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding,
+                                                            instanceLayoutBinding};
+
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
 
     VK_CHECK(vkCreateDescriptorSetLayout(device.getDevice(), &layoutInfo, nullptr,
                                          &descriptorSetLayout));
 }
 
 void Descriptor::createDescriptorPool() {
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
 
     VK_CHECK(vkCreateDescriptorPool(device.getDevice(), &poolInfo, nullptr, &descriptorPool));
 }
 
-void Descriptor::createDescriptorSets(std::vector<VkBuffer>& uniformBuffers) {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-                                               descriptorSetLayout);
+void Descriptor::createDescriptorSet() {
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
-
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-    VK_CHECK(vkAllocateDescriptorSets(device.getDevice(), &allocInfo, descriptorSets.data()));
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = descriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
-
-        vkUpdateDescriptorSets(device.getDevice(), 1, &descriptorWrite, 0, nullptr);
-    }
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device.getDevice(), &allocInfo, &descriptorSet));
+}
+
+/*
+ * Points the bindings at (re)created buffers. The uniform range covers one
+ * UniformBufferObject and the instance range one frame's worth of instances;
+ * the offsets are supplied per bind. Must not be called while the set is
+ * referenced by a pending command buffer.
+ */
+void Descriptor::updateDescriptorSet(VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+                                     VkDeviceSize instanceRange) {
+    VkDescriptorBufferInfo uniformInfo{};
+    uniformInfo.buffer = uniformBuffer;
+    uniformInfo.offset = 0;
+    uniformInfo.range = sizeof(UniformBufferObject);
+
+    VkDescriptorBufferInfo instanceInfo{};
+    instanceInfo.buffer = instanceBuffer;
+    instanceInfo.offset = 0;
+    instanceInfo.range = instanceRange;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &uniformInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &instanceInfo;
+
+    vkUpdateDescriptorSets(device.getDevice(), static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
 }
 
 Descriptor::~Descriptor() {
     vkDestroyDescriptorPool(device.getDevice(), descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device.getDevice(), descriptorSetLayout, nullptr);
-}
\ No newline at end of file
+}
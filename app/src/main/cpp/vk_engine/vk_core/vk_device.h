@@ -1,3 +1,5 @@
+#pragma once
+
 #include "vk_base.h"
 
 #include <stdexcept>
@@ -8,6 +10,28 @@
 
 using namespace vkt;
 
+#ifdef VK_EXT_swapchain_maintenance1
+// Instance extensions VK_EXT_swapchain_maintenance1 depends on. VKCore
+// enables them whenever the instance supports them all.
+const std::vector<const char*> SURFACE_MAINTENANCE_EXTENSIONS = {
+        VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
+        VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME
+};
+#endif
+
+inline bool areInstanceExtensionsSupported(const std::vector<const char*> &extensionNames) {
+    uint32_t extensionCount;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> missingExtensions(extensionNames.begin(), extensionNames.end());
+    for (const auto& extension : availableExtensions) {
+        missingExtensions.erase(extension.extensionName);
+    }
+    return missingExtensions.empty();
+}
+
 class Device {
 public:
     Device(VkInstance instance, VkSurfaceKHR surface);
@@ -23,10 +47,26 @@ public:
     VkQueue getGraphicsQueue() const { return graphicsQueue; }
     VkQueue getPresentQueue() const { return presentQueue; }
 
+    bool isExtensionEnabled(const char *extensionName) const;
+    bool supportsTimelineSemaphore() const { return timelineSemaphoreSupported; }
+    bool supportsMultiDrawIndirect() const { return multiDrawIndirectSupported; }
+    // Fences signaled when the presentation engine is done with a present,
+    // from VK_EXT_swapchain_maintenance1.
+    bool supportsPresentFence() const { return presentFenceSupported; }
+    // Scheduled presents and past present times, from VK_GOOGLE_display_timing.
+    bool supportsDisplayTiming() const {
+        return isExtensionEnabled(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    }
+    bool supportsDedicatedAllocation() const {
+        return isExtensionEnabled(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME) &&
+               isExtensionEnabled(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+    }
+
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     VkFormat findDepthFormat();
+    VkSampleCountFlagBits findSampleCount(VkSampleCountFlagBits requested);
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
 private:
@@ -42,10 +82,26 @@ private:
             VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    // Enabled when the physical device exposes them, features depending on
+    // them fall back gracefully otherwise.
+    const std::vector<const char*> optionalDeviceExtensions = {
+            VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+            VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+            VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
+            VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+            VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME
+    };
+
+    std::vector<const char*> enabledDeviceExtensions;
+    bool timelineSemaphoreSupported = false;
+    bool multiDrawIndirectSupported = false;
+    bool presentFenceSupported = false;
+
     void pickPhysicalDevice();
     void createLogicalDevice();
     bool isDeviceSuitable(VkPhysicalDevice device);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool isExtensionSupported(VkPhysicalDevice device, const char *extensionName);
 
     VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
                                  VkFormatFeatureFlags features);
@@ -100,15 +156,72 @@ void Device::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // GPU-driven rendering writes one indirect draw per object, addressing
+    // the object's instance through firstInstance.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
     VkPhysicalDeviceFeatures deviceFeatures{};
+    multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE &&
+                                 supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+    deviceFeatures.multiDrawIndirect = multiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
+    deviceFeatures.drawIndirectFirstInstance = multiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
+
+    enabledDeviceExtensions.assign(deviceExtensions.begin(), deviceExtensions.end());
+    for (const char* extension : optionalDeviceExtensions) {
+        if (isExtensionSupported(physicalDevice, extension)) {
+            enabledDeviceExtensions.push_back(extension);
+        }
+    }
+
+    // Extension features have to be queried through vkGetPhysicalDeviceFeatures2,
+    // which is only available on Vulkan 1.1 devices.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    if (properties.apiVersion >= VK_API_VERSION_1_1 &&
+        isExtensionEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+    timelineSemaphoreSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+
+    void *enabledFeatures = nullptr;
+    if (timelineSemaphoreSupported) {
+        enabledFeatures = &timelineFeatures;
+    }
+
+#ifdef VK_EXT_swapchain_maintenance1
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenanceFeatures{};
+    swapchainMaintenanceFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+    if (properties.apiVersion >= VK_API_VERSION_1_1 &&
+        isExtensionSupported(physicalDevice, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) &&
+        areInstanceExtensionsSupported(SURFACE_MAINTENANCE_EXTENSIONS)) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &swapchainMaintenanceFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+    presentFenceSupported = swapchainMaintenanceFeatures.swapchainMaintenance1 == VK_TRUE;
+    if (presentFenceSupported) {
+        enabledDeviceExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+        swapchainMaintenanceFeatures.pNext = enabledFeatures;
+        enabledFeatures = &swapchainMaintenanceFeatures;
+    }
+#endif
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = enabledFeatures;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledDeviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
 
     if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &_device) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create logical device!");
@@ -145,6 +258,29 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool Device::isExtensionSupported(VkPhysicalDevice device, const char *extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Device::isExtensionEnabled(const char *extensionName) const {
+    for (const char* extension : enabledDeviceExtensions) {
+        if (strcmp(extension, extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
     QueueFamilyIndices indices;
 
@@ -204,6 +340,23 @@ VkFormat Device::findDepthFormat() {
     );
 }
 
+/*
+ * Returns the highest sample count up to requested that color and depth
+ * framebuffer attachments both support.
+ */
+VkSampleCountFlagBits Device::findSampleCount(VkSampleCountFlagBits requested) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts &
+                                   properties.limits.framebufferDepthSampleCounts;
+    for (uint32_t samples = requested; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1) {
+        if (supported & samples) {
+            return static_cast<VkSampleCountFlagBits>(samples);
+        }
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
 VkFormat Device::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
     for (VkFormat format : candidates) {
         VkFormatProperties props;
@@ -0,0 +1,194 @@
+#pragma once
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+/*
+ * Read-only view of bytes owned by someone else.
+ */
+struct ByteSpan {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
+
+/*
+ * Owns the mapping behind a file opened through FileSystem. The bytes stay
+ * valid, and are never copied, until the view is destroyed or reassigned.
+ */
+class FileView {
+public:
+    FileView() = default;
+    ~FileView() { release(); }
+
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    FileView(FileView &&other) noexcept { *this = std::move(other); }
+    FileView& operator=(FileView &&other) noexcept {
+        if (this != &other) {
+            release();
+            bytes = other.bytes;
+            mapping = other.mapping;
+            mappingSize = other.mappingSize;
+            valid = other.valid;
+#ifdef __ANDROID__
+            asset = other.asset;
+            other.asset = nullptr;
+#endif
+            other.bytes = ByteSpan();
+            other.mapping = nullptr;
+            other.mappingSize = 0;
+            other.valid = false;
+        }
+        return *this;
+    }
+
+    explicit operator bool() const { return valid; }
+    ByteSpan span() const { return bytes; }
+    const uint8_t *data() const { return bytes.data; }
+    size_t size() const { return bytes.size; }
+
+private:
+    friend class FileSystem;
+
+    ByteSpan bytes;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    bool valid = false;
+#ifdef __ANDROID__
+    // Keeps an AAsset_getBuffer pointer alive.
+    AAsset *asset = nullptr;
+#endif
+
+    void release() {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        }
+#ifdef __ANDROID__
+        if (asset != nullptr) {
+            AAsset_close(asset);
+        }
+#endif
+    }
+};
+
+/*
+ * FileSystem opens read-only files as FileViews without copying them to the
+ * heap.
+ *
+ * On Android paths are APK assets. Uncompressed assets are mapped straight
+ * from the APK through AAsset_openFileDescriptor64; compressed ones fall back
+ * to AAsset_getBuffer, where the asset manager inflates them once and the
+ * view keeps the asset open. Elsewhere paths are relative to a root directory
+ * and files are mapped with mmap, so load paths can be measured off-device
+ * with the same code.
+ */
+class FileSystem {
+public:
+#ifdef __ANDROID__
+    explicit FileSystem(AAssetManager *assetManager) : assetManager(assetManager) {}
+#else
+    explicit FileSystem(std::string root) : root(std::move(root)) {}
+#endif
+
+    FileView open(const std::string &path) const;
+
+private:
+#ifdef __ANDROID__
+    AAssetManager *assetManager;
+#else
+    std::string root;
+#endif
+
+    static bool mapFile(int fd, off_t offset, size_t length, FileView &view);
+};
+
+/*
+ * Returns a view that converts to false if the file cannot be opened.
+ */
+inline FileView FileSystem::open(const std::string &path) const {
+    FileView view;
+#ifdef __ANDROID__
+    AAsset *asset = AAssetManager_open(assetManager, path.c_str(), AASSET_MODE_STREAMING);
+    if (asset == nullptr) {
+        return view;
+    }
+
+    off64_t start = 0;
+    off64_t length = 0;
+    int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+    if (fd >= 0) {
+        bool mapped = mapFile(fd, start, static_cast<size_t>(length), view);
+        close(fd);
+        if (mapped) {
+            AAsset_close(asset);
+            return view;
+        }
+    }
+
+    // Compressed asset: let the asset manager inflate it.
+    AAsset_close(asset);
+    asset = AAssetManager_open(assetManager, path.c_str(), AASSET_MODE_BUFFER);
+    if (asset == nullptr) {
+        return view;
+    }
+    const void *buffer = AAsset_getBuffer(asset);
+    if (buffer == nullptr) {
+        AAsset_close(asset);
+        return view;
+    }
+    view.asset = asset;
+    view.bytes.data = static_cast<const uint8_t *>(buffer);
+    view.bytes.size = static_cast<size_t>(AAsset_getLength64(asset));
+    view.valid = true;
+#else
+    std::string fullPath = root.empty() ? path : root + "/" + path;
+    int fd = ::open(fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return view;
+    }
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) == 0) {
+        mapFile(fd, 0, static_cast<size_t>(fileStat.st_size), view);
+    }
+    close(fd);
+#endif
+    return view;
+}
+
+/*
+ * mmap offsets must be page aligned, asset offsets inside the APK are not;
+ * map from the enclosing page and point the span past the slack.
+ */
+inline bool FileSystem::mapFile(int fd, off_t offset, size_t length, FileView &view) {
+    if (length == 0) {
+        view.valid = true;
+        return true;
+    }
+
+    off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t alignedOffset = offset & ~(pageSize - 1);
+    size_t slack = static_cast<size_t>(offset - alignedOffset);
+
+    void *mapping = mmap(nullptr, length + slack, PROT_READ, MAP_PRIVATE, fd, alignedOffset);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    view.mapping = mapping;
+    view.mappingSize = length + slack;
+    view.bytes.data = static_cast<const uint8_t *>(mapping) + slack;
+    view.bytes.size = length;
+    view.valid = true;
+    return true;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+
+/*
+ * Schedule of the next frame, as steady clock (CLOCK_MONOTONIC) nanoseconds.
+ */
+struct FramePlan {
+    // When to start recording so that the frame is ready for targetVsync.
+    uint64_t wakeTime;
+    // Vsync the frame is meant to be shown on.
+    uint64_t targetVsync;
+    // For VkPresentTimeGOOGLE: half a refresh ahead of targetVsync, so that
+    // rounding in the presentation engine cannot push it a vsync later.
+    uint64_t desiredPresentTime;
+    uint32_t swapInterval;
+};
+
+/*
+ * The pacer's time base. steady_clock is CLOCK_MONOTONIC on Android, the
+ * clock VK_GOOGLE_display_timing reports and schedules presents in.
+ */
+inline uint64_t toPacerTime(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline std::chrono::steady_clock::time_point fromPacerTime(uint64_t time) {
+    return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::nanoseconds(time)));
+}
+
+/*
+ * FramePacer locks frame delivery to an integer fraction of the refresh rate
+ * (60/30/20 fps on a 60 Hz display) so that a renderer that cannot hold
+ * every vsync shows frames at an even 33 ms rather than alternating between
+ * 16 and 33 ms.
+ *
+ * It keeps a model of the display's vsync grid, fed either with exact
+ * present times from VK_GOOGLE_display_timing through onPresentTiming or,
+ * without it, with CPU timestamps of when the presentation engine handed
+ * out an image through onFrameAcquired; under FIFO back-pressure those
+ * follow vsync, and a phase-locked loop keeps the grid on them. Until an
+ * acquire has blocked, frames keep their cadence on an unaligned grid.
+ * Every frame then targets the vsync swapInterval refreshes after the
+ * previous one and sleeps until the slowest recent frame's work fits right
+ * before it.
+ *
+ * The swap interval goes up as soon as presents miss their vsync
+ * repeatedly or the work no longer fits, and comes back down only after
+ * the work has fit comfortably into fewer refreshes for a while, which
+ * keeps it from oscillating.
+ *
+ * The pacer makes no Vulkan calls and takes all times as arguments, so it
+ * runs unchanged against synthetic timestamps.
+ */
+class FramePacer {
+public:
+    static constexpr uint64_t DEFAULT_REFRESH_DURATION = 16666667;
+    static constexpr uint32_t MAX_SWAP_INTERVAL = 3;
+    // Presents looked at for misses, and how many of them may miss.
+    static constexpr uint32_t MISS_WINDOW = 20;
+    static constexpr uint32_t MISS_LIMIT = 2;
+    // Frames averaged for the expected work.
+    static constexpr uint32_t WORK_WINDOW = 16;
+    // Fractions of the frame budget above which the interval goes up, and
+    // below which it may come down after DOWN_FRAMES presents.
+    static constexpr float UP_LOAD = 0.9f;
+    static constexpr float DOWN_LOAD = 0.6f;
+    static constexpr uint32_t DOWN_FRAMES = 120;
+    // Acquires taking longer than this waited for the presentation engine.
+    static constexpr uint64_t BLOCKED_ACQUIRE = 500000;
+    // Inverse gains of the vsync phase-locked loop, see onFrameAcquired.
+    static constexpr int64_t LOCKED_GAIN = 8;
+    static constexpr int64_t UNLOCKED_GAIN = 32;
+
+    explicit FramePacer(uint64_t refreshDuration = DEFAULT_REFRESH_DURATION)
+            : refreshDuration(refreshDuration) {}
+
+    void setRefreshDuration(uint64_t duration) { refreshDuration = duration; }
+    void setMinSwapInterval(uint32_t interval);
+
+    uint64_t getRefreshDuration() const { return refreshDuration; }
+    uint32_t getSwapInterval() const { return swapInterval; }
+    bool hasDisplayTiming() const { return displayTiming; }
+    uint64_t getMissedCount() const { return missedCount; }
+    uint64_t getExpectedWork() const;
+    uint64_t getWorstWork() const;
+
+    FramePlan planFrame(uint64_t now);
+    void onFrameWork(uint64_t duration);
+    void onPresentTiming(uint64_t desiredPresentTime, uint64_t actualPresentTime);
+    void onFrameAcquired(uint64_t called, uint64_t time);
+    void reset();
+
+    // Predicted vsync at or after time; time itself before any timing came in.
+    uint64_t nextVsyncAtOrAfter(uint64_t time) const;
+
+private:
+    uint64_t refreshDuration;
+    uint32_t swapInterval = 1;
+    uint32_t minSwapInterval = 1;
+
+    // Some vsync; the others lie whole refreshes away from it.
+    uint64_t vsyncAnchor = 0;
+    bool anchored = false;
+    bool displayTiming = false;
+
+    uint64_t lastTarget = 0;
+    uint64_t lastAcquire = 0;
+    // Last vsync targeted before the swap interval changed; presents up to
+    // it were planned for the old interval and say nothing about the new one.
+    uint64_t settleTarget = 0;
+
+    std::deque<uint64_t> workSamples;
+    uint64_t workTotal = 0;
+    std::deque<bool> missHistory;
+    uint32_t recentMisses = 0;
+    uint64_t missedCount = 0;
+    uint32_t underloadedFrames = 0;
+
+    uint64_t getMargin() const { return refreshDuration / 4; }
+    void recordPresent(bool missed);
+    void setSwapInterval(uint32_t interval);
+};
+
+/*
+ * E.g. 2 for a 30 fps cap on a 60 Hz display. Clamped to MAX_SWAP_INTERVAL.
+ */
+void FramePacer::setMinSwapInterval(uint32_t interval) {
+    minSwapInterval = std::clamp(interval, 1u, MAX_SWAP_INTERVAL);
+    if (swapInterval < minSwapInterval) {
+        setSwapInterval(minSwapInterval);
+    }
+}
+
+uint64_t FramePacer::getExpectedWork() const {
+    return workSamples.empty() ? 0 : workTotal / workSamples.size();
+}
+
+/*
+ * Frames are scheduled for the slowest of the recent ones rather than the
+ * average, which lags behind a rising load by half the window.
+ */
+uint64_t FramePacer::getWorstWork() const {
+    return workSamples.empty() ? 0 : *std::max_element(workSamples.begin(), workSamples.end());
+}
+
+/*
+ * Called at the start of every frame. Targets the vsync one swap interval
+ * after the previous target, or the first one the frame can still make if
+ * it is running late, which restarts the cadence from there.
+ */
+FramePlan FramePacer::planFrame(uint64_t now) {
+    uint64_t work = getWorstWork();
+    uint64_t earliest = nextVsyncAtOrAfter(now + work + getMargin());
+    uint64_t target = earliest;
+    if (lastTarget != 0) {
+        target = std::max(nextVsyncAtOrAfter(lastTarget + swapInterval * refreshDuration),
+                          earliest);
+    }
+    lastTarget = target;
+
+    FramePlan plan{};
+    plan.targetVsync = target;
+    plan.wakeTime = std::max(now, target - work - getMargin());
+    plan.desiredPresentTime = target - refreshDuration / 2;
+    plan.swapInterval = swapInterval;
+    return plan;
+}
+
+/*
+ * How long the last frame took from its start to being handed to the
+ * presentation engine.
+ */
+void FramePacer::onFrameWork(uint64_t duration) {
+    workSamples.push_back(duration);
+    workTotal += duration;
+    if (workSamples.size() > WORK_WINDOW) {
+        workTotal -= workSamples.front();
+        workSamples.pop_front();
+    }
+    if (getExpectedWork() > UP_LOAD * swapInterval * refreshDuration &&
+        swapInterval < MAX_SWAP_INTERVAL) {
+        setSwapInterval(swapInterval + 1);
+    }
+}
+
+/*
+ * A VkPastPresentationTimingGOOGLE entry for a frame planned by planFrame.
+ * actualPresentTime is an exact vsync.
+ */
+void FramePacer::onPresentTiming(uint64_t desiredPresentTime, uint64_t actualPresentTime) {
+    displayTiming = true;
+    vsyncAnchor = actualPresentTime;
+    anchored = true;
+    if (desiredPresentTime <= settleTarget) {
+        return;
+    }
+    // On time, the present lands half a refresh after desiredPresentTime.
+    recordPresent(actualPresentTime > desiredPresentTime + refreshDuration);
+}
+
+/*
+ * Without display timing: when vkAcquireNextImageKHR was called for a frame
+ * and when it returned. Only an acquire that blocked says when vsync is,
+ * as the presentation engine releases images on vsync; one that returned
+ * at once merely echoes the pacer's own wake time. Those that blocked pull
+ * the predicted grid's phase towards them, the ones close to the grid
+ * harder than the rest, which pull it in from a poor first guess. A gap of
+ * more than half a refresh over the swap interval counts as a miss.
+ */
+void FramePacer::onFrameAcquired(uint64_t called, uint64_t time) {
+    if (displayTiming) {
+        return;
+    }
+    if (time - called < BLOCKED_ACQUIRE) {
+        // Nothing to learn about vsync.
+    } else if (!anchored) {
+        vsyncAnchor = time;
+        anchored = true;
+    } else {
+        uint64_t next = nextVsyncAtOrAfter(time);
+        int64_t error = static_cast<int64_t>(time) - static_cast<int64_t>(next);
+        if (-error > static_cast<int64_t>(refreshDuration / 2)) {
+            error += static_cast<int64_t>(refreshDuration);
+        }
+        bool locked = std::abs(error) < static_cast<int64_t>(refreshDuration / 4);
+        vsyncAnchor = static_cast<uint64_t>(static_cast<int64_t>(next) +
+                                            error / (locked ? LOCKED_GAIN : UNLOCKED_GAIN));
+    }
+
+    if (lastAcquire != 0 && time > settleTarget) {
+        uint64_t expected = swapInterval * refreshDuration;
+        recordPresent(time - lastAcquire > expected + refreshDuration / 2);
+    }
+    lastAcquire = time;
+}
+
+/*
+ * Forgets the timing history, e.g. after the swapchain changed. The swap
+ * interval is kept.
+ */
+void FramePacer::reset() {
+    anchored = false;
+    displayTiming = false;
+    lastTarget = 0;
+    lastAcquire = 0;
+    settleTarget = 0;
+    missHistory.clear();
+    recentMisses = 0;
+    underloadedFrames = 0;
+}
+
+uint64_t FramePacer::nextVsyncAtOrAfter(uint64_t time) const {
+    if (!anchored) {
+        return time;
+    }
+    if (time <= vsyncAnchor) {
+        return vsyncAnchor - (vsyncAnchor - time) / refreshDuration * refreshDuration;
+    }
+    uint64_t refreshes = (time - vsyncAnchor + refreshDuration - 1) / refreshDuration;
+    return vsyncAnchor + refreshes * refreshDuration;
+}
+
+void FramePacer::recordPresent(bool missed) {
+    missedCount += missed;
+    missHistory.push_back(missed);
+    recentMisses += missed;
+    if (missHistory.size() > MISS_WINDOW) {
+        recentMisses -= missHistory.front();
+        missHistory.pop_front();
+    }
+
+    if (recentMisses >= MISS_LIMIT && swapInterval < MAX_SWAP_INTERVAL) {
+        setSwapInterval(swapInterval + 1);
+        return;
+    }
+
+    bool underloaded = swapInterval > minSwapInterval && recentMisses == 0 &&
+                       getExpectedWork() < DOWN_LOAD * (swapInterval - 1) * refreshDuration;
+    underloadedFrames = underloaded ? underloadedFrames + 1 : 0;
+    if (underloadedFrames >= DOWN_FRAMES) {
+        setSwapInterval(swapInterval - 1);
+    }
+}
+
+void FramePacer::setSwapInterval(uint32_t interval) {
+    swapInterval = std::clamp(interval, minSwapInterval, MAX_SWAP_INTERVAL);
+    settleTarget = lastTarget;
+    missHistory.clear();
+    recentMisses = 0;
+    underloadedFrames = 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "vk_device.h"
+
+#include <algorithm>
+
+/*
+ * FrameScheduler paces the CPU against the GPU with a single monotonically
+ * increasing frame value. Frame N signals the value N on completion, so the
+ * CPU may start frame N as soon as the GPU has reached N - framesInFlight.
+ *
+ * When VK_KHR_timeline_semaphore is available the value lives in one timeline
+ * semaphore. Otherwise every frame slot keeps a fence and the value it was
+ * submitted with, which gives the same observable behaviour.
+ *
+ * The binary semaphores needed by the presentation engine are owned here as
+ * well, one pair per frame slot.
+ */
+class FrameScheduler {
+public:
+    FrameScheduler(Device& device, uint32_t framesInFlight);
+    ~FrameScheduler();
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    uint32_t getFramesInFlight() const { return framesInFlight; }
+    uint32_t getFrameSlot() const { return static_cast<uint32_t>(frameValue % framesInFlight); }
+    uint64_t getFrameValue() const { return frameValue + 1; }
+    // Value of the newest frame submitted so far.
+    uint64_t getSubmittedValue() const { return submittedValue; }
+    bool usesTimelineSemaphore() const { return timelineSemaphore != VK_NULL_HANDLE; }
+
+    VkSemaphore getImageAvailableSemaphore() const { return imageAvailableSemaphores[getFrameSlot()]; }
+    VkSemaphore getRenderFinishedSemaphore() const { return renderFinishedSemaphores[getFrameSlot()]; }
+
+    uint64_t getCompletedValue();
+    void waitForValue(uint64_t value);
+    void beginFrame();
+    void submit(VkQueue queue, VkCommandBuffer commandBuffer);
+    void endFrame();
+    void waitIdle();
+
+private:
+    Device& device;
+    uint32_t framesInFlight;
+
+    // Number of frames begun so far. The frame being recorded signals
+    // frameValue + 1.
+    uint64_t frameValue = 0;
+    uint64_t submittedValue = 0;
+
+    VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+    PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+
+    std::vector<VkFence> inFlightFences;
+    std::vector<uint64_t> slotValues;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+
+    void createTimelineSemaphore();
+    void createFences();
+};
+
+FrameScheduler::FrameScheduler(Device &device, uint32_t framesInFlight)
+        : device(device),
+          framesInFlight(std::clamp(framesInFlight, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT)) {
+    if (device.supportsTimelineSemaphore()) {
+        createTimelineSemaphore();
+    } else {
+        createFences();
+    }
+
+    imageAvailableSemaphores.resize(this->framesInFlight);
+    renderFinishedSemaphores.resize(this->framesInFlight);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (size_t i = 0; i < this->framesInFlight; i++) {
+        VK_CHECK(vkCreateSemaphore(device.getDevice(), &semaphoreInfo, nullptr,
+                                   &imageAvailableSemaphores[i]));
+        VK_CHECK(vkCreateSemaphore(device.getDevice(), &semaphoreInfo, nullptr,
+                                   &renderFinishedSemaphores[i]));
+    }
+
+    LOG_INFO("Frame scheduler: %u frames in flight, %s", this->framesInFlight,
+             usesTimelineSemaphore() ? "timeline semaphore" : "fences");
+}
+
+void FrameScheduler::createTimelineSemaphore() {
+    waitSemaphores = (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(
+            device.getDevice(), "vkWaitSemaphoresKHR");
+    getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr(
+            device.getDevice(), "vkGetSemaphoreCounterValueKHR");
+    if (waitSemaphores == nullptr || getSemaphoreCounterValue == nullptr) {
+        createFences();
+        return;
+    }
+
+    VkSemaphoreTypeCreateInfoKHR typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    VK_CHECK(vkCreateSemaphore(device.getDevice(), &semaphoreInfo, nullptr, &timelineSemaphore));
+}
+
+void FrameScheduler::createFences() {
+    inFlightFences.resize(framesInFlight);
+    slotValues.assign(framesInFlight, 0);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    for (size_t i = 0; i < framesInFlight; i++) {
+        VK_CHECK(vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &inFlightFences[i]));
+    }
+}
+
+/*
+ * Returns the value of the newest frame the GPU has finished executing.
+ */
+uint64_t FrameScheduler::getCompletedValue() {
+    if (usesTimelineSemaphore()) {
+        uint64_t value = 0;
+        VK_CHECK(getSemaphoreCounterValue(device.getDevice(), timelineSemaphore, &value));
+        return value;
+    }
+
+    // Everything submitted has completed except the frames whose fence is
+    // still pending; the oldest of those bounds the progress.
+    uint64_t completed = submittedValue;
+    for (size_t i = 0; i < framesInFlight; i++) {
+        if (slotValues[i] != 0 &&
+            vkGetFenceStatus(device.getDevice(), inFlightFences[i]) == VK_NOT_READY) {
+            completed = std::min(completed, slotValues[i] - 1);
+        }
+    }
+    return completed;
+}
+
+void FrameScheduler::waitForValue(uint64_t value) {
+    if (value == 0 || value > submittedValue) {
+        return;
+    }
+
+    if (usesTimelineSemaphore()) {
+        VkSemaphoreWaitInfoKHR waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timelineSemaphore;
+        waitInfo.pValues = &value;
+        VK_CHECK(waitSemaphores(device.getDevice(), &waitInfo, UINT64_MAX));
+        return;
+    }
+
+    for (size_t i = 0; i < framesInFlight; i++) {
+        if (slotValues[i] != 0 && slotValues[i] <= value) {
+            VK_CHECK(vkWaitForFences(device.getDevice(), 1, &inFlightFences[i], VK_TRUE,
+                                     UINT64_MAX));
+        }
+    }
+}
+
+/*
+ * Blocks until the slot about to be reused has been retired by the GPU, i.e.
+ * until no more than framesInFlight - 1 frames are still executing.
+ */
+void FrameScheduler::beginFrame() {
+    if (frameValue >= framesInFlight) {
+        waitForValue(frameValue + 1 - framesInFlight);
+    }
+}
+
+/*
+ * Submits the frame's command buffer. It waits for the slot's acquire
+ * semaphore and signals both the slot's present semaphore and the frame value.
+ */
+void FrameScheduler::submit(VkQueue queue, VkCommandBuffer commandBuffer) {
+    uint32_t slot = getFrameSlot();
+
+    VkSemaphore waitSemaphoreHandles[] = {imageAvailableSemaphores[slot]};
+    VkPipelineStageFlags waitStages[] = {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[slot], timelineSemaphore};
+    uint64_t signalValues[] = {0, getFrameValue()};
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = waitSemaphoreHandles;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    VkFence fence = VK_NULL_HANDLE;
+    if (usesTimelineSemaphore()) {
+        // Binary semaphores ignore their entry in pSignalSemaphoreValues.
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 2;
+    } else {
+        fence = inFlightFences[slot];
+        VK_CHECK(vkResetFences(device.getDevice(), 1, &fence));
+        slotValues[slot] = getFrameValue();
+    }
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
+    submittedValue = getFrameValue();
+}
+
+void FrameScheduler::endFrame() {
+    frameValue++;
+}
+
+void FrameScheduler::waitIdle() {
+    waitForValue(submittedValue);
+}
+
+FrameScheduler::~FrameScheduler() {
+    waitIdle();
+
+    for (size_t i = 0; i < framesInFlight; i++) {
+        vkDestroySemaphore(device.getDevice(), imageAvailableSemaphores[i], nullptr);
+        vkDestroySemaphore(device.getDevice(), renderFinishedSemaphores[i], nullptr);
+    }
+    for (VkFence fence : inFlightFences) {
+        vkDestroyFence(device.getDevice(), fence, nullptr);
+    }
+    if (timelineSemaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device.getDevice(), timelineSemaphore, nullptr);
+    }
+}
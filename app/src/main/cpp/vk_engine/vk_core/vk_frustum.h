@@ -0,0 +1,114 @@
+#pragma once
+
+#include "vk_base.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+ * View frustum as six planes facing inwards, extracted from a clip matrix
+ * (Gribb & Hartmann). Plane i is (normal.xyz, distance.w) and a point p is on
+ * its inner side when dot(normal, p) + distance >= 0. Planes are normalised,
+ * so the same expression gives the signed distance used by sphere tests.
+ *
+ * The sphere test here is the reference the GPU culling shader (cull.comp)
+ * mirrors; keep the two in sync.
+ */
+struct Frustum {
+    enum Plane { Left, Right, Bottom, Top, Near, Far, PLANE_COUNT };
+
+    glm::vec4 planes[PLANE_COUNT];
+
+    static Frustum fromMatrix(const glm::mat4 &clip);
+    bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
+
+/*
+ * Planes are expressed in the space clip transforms from: pass proj * view
+ * for world space, or proj * view * model for the model's space. The near
+ * plane is taken as z >= -w, which is what glm::perspective targets and
+ * conservative for Vulkan's 0..w depth range.
+ */
+inline Frustum Frustum::fromMatrix(const glm::mat4 &clip) {
+    // glm is column-major: clip[column][row].
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(clip[0][row], clip[1][row], clip[2][row], clip[3][row]);
+    }
+
+    Frustum frustum;
+    frustum.planes[Left] = rows[3] + rows[0];
+    frustum.planes[Right] = rows[3] - rows[0];
+    frustum.planes[Bottom] = rows[3] + rows[1];
+    frustum.planes[Top] = rows[3] - rows[1];
+    frustum.planes[Near] = rows[3] + rows[2];
+    frustum.planes[Far] = rows[3] - rows[2];
+    for (auto &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+inline bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const {
+    for (const auto &plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Moves a bounding sphere (center.xyz, radius.w) through model. The radius
+ * grows with the largest axis scale, so the result stays conservative under
+ * non-uniform scaling.
+ */
+inline glm::vec4 transformSphere(const glm::mat4 &model, const glm::vec4 &sphere) {
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+    float scaleSquared = std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                           glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))),
+                                  glm::dot(glm::vec3(model[2]), glm::vec3(model[2])));
+    return glm::vec4(center, sphere.w * std::sqrt(scaleSquared));
+}
+
+/*
+ * Axis-aligned bounding box. empty() starts inverted so that growing it by
+ * the first point or box yields that point or box.
+ */
+struct Aabb {
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+
+    static Aabb empty() { return {glm::vec3(INFINITY), glm::vec3(-INFINITY)}; }
+
+    glm::vec3 getCenter() const { return (minimum + maximum) * 0.5f; }
+    glm::vec3 getExtent() const { return (maximum - minimum) * 0.5f; }
+
+    float getSurfaceArea() const {
+        glm::vec3 size = glm::max(maximum - minimum, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void grow(const glm::vec3 &point) {
+        minimum = glm::min(minimum, point);
+        maximum = glm::max(maximum, point);
+    }
+
+    void grow(const Aabb &box) {
+        minimum = glm::min(minimum, box.minimum);
+        maximum = glm::max(maximum, box.maximum);
+    }
+};
+
+/*
+ * Smallest box holding box moved through model (Arvo): the extent is carried
+ * through the absolute value of the linear part.
+ */
+inline Aabb transformAabb(const glm::mat4 &model, const Aabb &box) {
+    glm::vec3 center = glm::vec3(model * glm::vec4(box.getCenter(), 1.0f));
+    glm::vec3 extent = box.getExtent();
+    glm::vec3 reach = glm::abs(glm::vec3(model[0])) * extent.x +
+                      glm::abs(glm::vec3(model[1])) * extent.y +
+                      glm::abs(glm::vec3(model[2])) * extent.z;
+    return {center - reach, center + reach};
+}
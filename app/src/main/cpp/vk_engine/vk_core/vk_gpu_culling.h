@@ -0,0 +1,484 @@
+#pragma once
+
+#include "vk_gpu_object.h"
+#include "vk_instance_buffer.h"
+#include "vk_pipeline_cache.h"
+#include "vk_pipeline_manager.h"
+
+#include <array>
+
+/*
+ * Per-frame input of the culling shader, suballocated from the UniformRing.
+ * Must match CullUniforms in cull.comp (std140).
+ */
+struct CullUniforms {
+    glm::vec4 planes[Frustum::PLANE_COUNT];
+    // In the same space as the planes.
+    glm::vec4 cameraPosition;
+    uint32_t objectCount;
+    uint32_t padding[3];
+};
+
+/*
+ * GpuCuller moves draw submission to the GPU. A compute pass tests every
+ * object's bounding sphere against the frustum, and its normal cone against
+ * the camera position when it has one, and appends one
+ * VkDrawIndexedIndirectCommand per visible object; the draws are then issued
+ * with a single vkCmdDrawIndexedIndirectCount. Recording is the same handful
+ * of commands whatever the object count, so the CPU cost per frame no longer
+ * grows with the scene.
+ *
+ * Without VK_KHR_draw_indirect_count the command buffer is zeroed first and
+ * a fixed number of draws (the object capacity) is issued with
+ * vkCmdDrawIndexedIndirect; the culled tail is made of empty draws.
+ *
+ * The object, draw and count buffers have one region per frame in flight,
+ * bound with dynamic offsets, so their offsets only depend on the frame slot.
+ * Like InstanceBuffer, setObjects() only queues the new objects for every
+ * slot and sync() copies them into the mapped region of the slot about to be
+ * recorded, so replacing the objects never waits for frames in flight. The
+ * count buffer is host-visible: once a slot has been retired,
+ * readDrawCount() returns what the GPU produced for it, which can be checked
+ * against countVisible() on the CPU.
+ */
+class GpuCuller {
+public:
+    GpuCuller(Device& device, MemoryAllocator& allocator, PipelineManager& pipelineManager,
+              PipelineCache& pipelineCache, const FileSystem& fileSystem, uint32_t framesInFlight);
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    bool isReady() const { return pipeline.isReady(); }
+    uint32_t getObjectCount() const { return static_cast<uint32_t>(objects.size()); }
+    uint32_t getCapacity() const { return capacity; }
+
+    void setObjects(const std::vector<GpuObject> &newObjects);
+    void sync(uint32_t frameSlot);
+    void setFramesInFlight(uint32_t count);
+    void updateDescriptorSet(VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+                             VkDeviceSize instanceRange);
+
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frameSlot, uint32_t uniformOffset,
+                    uint32_t instanceOffset);
+    void recordDraw(VkCommandBuffer commandBuffer, uint32_t frameSlot) const;
+
+    uint32_t readDrawCount(uint32_t frameSlot) const;
+    uint32_t countVisible(const Frustum &frustum, const glm::vec3 &cameraPosition,
+                          const InstanceBuffer &instances) const;
+
+private:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    Device& device;
+    MemoryAllocator& allocator;
+    PipelineManager& pipelineManager;
+    PipelineCache& pipelineCache;
+    const FileSystem& fileSystem;
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+    uint32_t maxDrawCount;
+    VkDeviceSize storageAlignment;
+    VkDeviceSize atomSize;
+
+    std::vector<GpuObject> objects;
+    uint32_t capacity = 0;
+    uint32_t framesInFlight;
+
+    VkBuffer objectBuffer = VK_NULL_HANDLE;
+    MemoryAllocation objectMemory;
+    VkDeviceSize objectSlotSize = 0;
+    // Bit s is set while slot s's region lags behind objects.
+    uint32_t staleSlots = 0;
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    MemoryAllocation drawMemory;
+    VkDeviceSize drawSlotSize = 0;
+    VkBuffer countBuffer = VK_NULL_HANDLE;
+    MemoryAllocation countMemory;
+    VkDeviceSize countSlotSize = 0;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout pipelineLayout;
+    PipelineHandle pipeline;
+
+    void createDescriptorSet();
+    VkPipeline createPipeline();
+    void createObjectBuffer();
+    void createFrameBuffers();
+    void destroyBuffer(VkBuffer &buffer, MemoryAllocation &memory);
+    void writeStorageBuffers();
+};
+
+GpuCuller::GpuCuller(Device &device, MemoryAllocator &allocator, PipelineManager &pipelineManager,
+                     PipelineCache &pipelineCache, const FileSystem &fileSystem,
+                     uint32_t framesInFlight)
+        : device(device), allocator(allocator), pipelineManager(pipelineManager),
+          pipelineCache(pipelineCache), fileSystem(fileSystem), framesInFlight(framesInFlight) {
+    if (device.isExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+        drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(
+                device.getDevice(), "vkCmdDrawIndexedIndirectCountKHR");
+    }
+    LOG_INFO("GPU culling: %s", drawIndexedIndirectCount != nullptr
+                                ? "vkCmdDrawIndexedIndirectCount"
+                                : "vkCmdDrawIndexedIndirect with a fixed draw count");
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
+    maxDrawCount = properties.limits.maxDrawIndirectCount;
+    storageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 4);
+    atomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+    createDescriptorSet();
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    VK_CHECK(vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr,
+                                    &pipelineLayout));
+    pipeline = pipelineManager.compile("cull", [this] { return createPipeline(); });
+
+    capacity = 1;
+    createObjectBuffer();
+    createFrameBuffers();
+}
+
+void GpuCuller::createDescriptorSet() {
+    // Cull uniforms, objects, instances, draw commands, draw count.
+    const std::array<VkDescriptorType, 5> types = {
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
+    };
+
+    std::array<VkDescriptorSetLayoutBinding, types.size()> bindings{};
+    for (uint32_t i = 0; i < types.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    VK_CHECK(vkCreateDescriptorSetLayout(device.getDevice(), &layoutInfo, nullptr,
+                                         &descriptorSetLayout));
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 4};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    VK_CHECK(vkCreateDescriptorPool(device.getDevice(), &poolInfo, nullptr, &descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+    VK_CHECK(vkAllocateDescriptorSets(device.getDevice(), &allocInfo, &descriptorSet));
+}
+
+/*
+ * Runs on a PipelineManager worker.
+ */
+VkPipeline GpuCuller::createPipeline() {
+    FileView shaderCode = fileSystem.open("shaders/cull.comp.spv");
+    if (!shaderCode) {
+        throw std::runtime_error("Failed to load the culling shader!");
+    }
+    VkShaderModule shaderModule = createShaderModule(device, shaderCode.span());
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline computePipeline;
+    VK_CHECK(vkCreateComputePipelines(device.getDevice(), pipelineCache.getCache(), 1,
+                                      &pipelineInfo, nullptr, &computePipeline));
+    vkDestroyShaderModule(device.getDevice(), shaderModule, nullptr);
+    return computePipeline;
+}
+
+/*
+ * One mapped region per frame slot, each filled in by sync() before the
+ * slot's next frame.
+ */
+void GpuCuller::createObjectBuffer() {
+    objectSlotSize = alignUp(alignUp(sizeof(GpuObject) * capacity, storageAlignment), atomSize);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = objectSlotSize * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &objectBuffer));
+    // On unified memory architectures host-visible memory is usually
+    // device-local as well.
+    objectMemory = allocator.allocateBuffer(objectBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    staleSlots = (1u << framesInFlight) - 1;
+}
+
+/*
+ * The draw and count buffers, one region per frame slot. The count is read
+ * back by the CPU, so it lives in host-visible memory.
+ */
+void GpuCuller::createFrameBuffers() {
+    drawSlotSize = alignUp(sizeof(VkDrawIndexedIndirectCommand) * capacity, storageAlignment);
+    countSlotSize = alignUp(sizeof(uint32_t), storageAlignment);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = drawSlotSize * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &drawBuffer));
+    drawMemory = allocator.allocateBuffer(drawBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    bufferInfo.size = countSlotSize * framesInFlight;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &countBuffer));
+    countMemory = allocator.allocateBuffer(
+            countBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    memset(countMemory.mapped, 0, bufferInfo.size);
+}
+
+void GpuCuller::destroyBuffer(VkBuffer &buffer, MemoryAllocation &memory) {
+    if (buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device.getDevice(), buffer, nullptr);
+        allocator.free(memory);
+        buffer = VK_NULL_HANDLE;
+    }
+}
+
+/*
+ * Replaces the object list; every slot picks it up in its next sync().
+ * Growing past getCapacity() reallocates every buffer, so then the GPU must
+ * be idle and recorded command buffers are stale, as the dispatch size
+ * changes.
+ */
+void GpuCuller::setObjects(const std::vector<GpuObject> &newObjects) {
+    objects = newObjects;
+    staleSlots = (1u << framesInFlight) - 1;
+    if (objects.size() > capacity) {
+        while (capacity < objects.size()) {
+            capacity *= 2;
+        }
+        if (capacity > maxDrawCount) {
+            LOG_ERR("GPU culling: %u objects exceed maxDrawIndirectCount (%u), the rest are not drawn",
+                    capacity, maxDrawCount);
+        }
+        destroyBuffer(objectBuffer, objectMemory);
+        destroyBuffer(drawBuffer, drawMemory);
+        destroyBuffer(countBuffer, countMemory);
+        createObjectBuffer();
+        createFrameBuffers();
+        writeStorageBuffers();
+    }
+}
+
+/*
+ * Brings the frame slot's object region up to date. The slot must have been
+ * retired by the FrameScheduler.
+ */
+void GpuCuller::sync(uint32_t frameSlot) {
+    uint32_t bit = 1u << frameSlot;
+    if (!(staleSlots & bit)) {
+        return;
+    }
+    staleSlots &= ~bit;
+    if (objects.empty()) {
+        return;
+    }
+
+    VkDeviceSize slotOffset = objectSlotSize * frameSlot;
+    VkDeviceSize size = sizeof(GpuObject) * objects.size();
+    memcpy(static_cast<uint8_t *>(objectMemory.mapped) + slotOffset, objects.data(), size);
+    if (!(objectMemory.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = objectMemory.memory;
+        range.offset = objectMemory.offset + slotOffset;
+        range.size = std::min(alignUp(size, atomSize), objectSlotSize);
+        VK_CHECK(vkFlushMappedMemoryRanges(device.getDevice(), 1, &range));
+    }
+}
+
+/*
+ * Resizes the per-slot regions. The GPU must be idle.
+ */
+void GpuCuller::setFramesInFlight(uint32_t count) {
+    framesInFlight = count;
+    destroyBuffer(objectBuffer, objectMemory);
+    destroyBuffer(drawBuffer, drawMemory);
+    destroyBuffer(countBuffer, countMemory);
+    createObjectBuffer();
+    createFrameBuffers();
+    writeStorageBuffers();
+}
+
+/*
+ * Points the set at the UniformRing and the InstanceBuffer after either was
+ * (re)created; the culler's own buffers are written as well.
+ */
+void GpuCuller::updateDescriptorSet(VkBuffer uniformBuffer, VkBuffer instanceBuffer,
+                                    VkDeviceSize instanceRange) {
+    VkDescriptorBufferInfo uniformInfo{uniformBuffer, 0, sizeof(CullUniforms)};
+    VkDescriptorBufferInfo instanceInfo{instanceBuffer, 0, instanceRange};
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    for (auto &write : descriptorWrites) {
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.descriptorCount = 1;
+    }
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].pBufferInfo = &uniformInfo;
+    descriptorWrites[1].dstBinding = 2;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[1].pBufferInfo = &instanceInfo;
+    vkUpdateDescriptorSets(device.getDevice(), static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
+
+    writeStorageBuffers();
+}
+
+void GpuCuller::writeStorageBuffers() {
+    VkDescriptorBufferInfo objectInfo{objectBuffer, 0, sizeof(GpuObject) * capacity};
+    VkDescriptorBufferInfo drawInfo{drawBuffer, 0, sizeof(VkDrawIndexedIndirectCommand) * capacity};
+    VkDescriptorBufferInfo countInfo{countBuffer, 0, sizeof(uint32_t)};
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+    for (auto &write : descriptorWrites) {
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.descriptorCount = 1;
+    }
+    descriptorWrites[0].dstBinding = 1;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[0].pBufferInfo = &objectInfo;
+    descriptorWrites[1].dstBinding = 3;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[1].pBufferInfo = &drawInfo;
+    descriptorWrites[2].dstBinding = 4;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[2].pBufferInfo = &countInfo;
+    vkUpdateDescriptorSets(device.getDevice(), static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
+}
+
+/*
+ * Records the culling pass. Must be outside a render pass and before
+ * recordDraw() in the same command buffer. uniformOffset locates this
+ * frame's CullUniforms in the UniformRing.
+ */
+void GpuCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frameSlot,
+                           uint32_t uniformOffset, uint32_t instanceOffset) {
+    uint32_t objectOffset = static_cast<uint32_t>(objectSlotSize * frameSlot);
+    uint32_t drawOffset = static_cast<uint32_t>(drawSlotSize * frameSlot);
+    uint32_t countOffset = static_cast<uint32_t>(countSlotSize * frameSlot);
+
+    vkCmdFillBuffer(commandBuffer, countBuffer, countOffset, sizeof(uint32_t), 0);
+    if (drawIndexedIndirectCount == nullptr) {
+        // Every slot up to the fixed draw count is issued, so culled ones
+        // must be empty draws.
+        vkCmdFillBuffer(commandBuffer, drawBuffer, drawOffset,
+                        sizeof(VkDrawIndexedIndirectCommand) * capacity, 0);
+    }
+
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr,
+                         0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+    // In binding order: uniforms, objects, instances, draws, count.
+    uint32_t dynamicOffsets[] = {uniformOffset, objectOffset, instanceOffset, drawOffset,
+                                 countOffset};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &descriptorSet, 5, dynamicOffsets);
+    // Sized by capacity rather than count, so the objects can change without
+    // re-recording; the shader skips indices past the count.
+    vkCmdDispatch(commandBuffer, (capacity + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    // The count is also read back on the host once the frame has retired.
+    VkMemoryBarrier cullBarrier{};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                         &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+/*
+ * Issues the draws produced by recordCull() for the same frame slot. The
+ * graphics pipeline, mesh and descriptor sets must already be bound.
+ */
+void GpuCuller::recordDraw(VkCommandBuffer commandBuffer, uint32_t frameSlot) const {
+    VkDeviceSize drawOffset = drawSlotSize * frameSlot;
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (drawIndexedIndirectCount != nullptr) {
+        drawIndexedIndirectCount(commandBuffer, drawBuffer, drawOffset, countBuffer,
+                                 countSlotSize * frameSlot, std::min(capacity, maxDrawCount),
+                                 stride);
+    } else {
+        vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset,
+                                 std::min(capacity, maxDrawCount), stride);
+    }
+}
+
+/*
+ * Number of draws the GPU emitted the last time the slot was culled. Only
+ * meaningful once the FrameScheduler has retired the slot.
+ */
+uint32_t GpuCuller::readDrawCount(uint32_t frameSlot) const {
+    uint32_t drawCount;
+    memcpy(&drawCount, static_cast<uint8_t *>(countMemory.mapped) + countSlotSize * frameSlot,
+           sizeof(drawCount));
+    return drawCount;
+}
+
+/*
+ * CPU reference of the culling shader for the current objects, see
+ * countVisibleObjects.
+ */
+uint32_t GpuCuller::countVisible(const Frustum &frustum, const glm::vec3 &cameraPosition,
+                                 const InstanceBuffer &instances) const {
+    return countVisibleObjects(objects, frustum, cameraPosition,
+                               [&](uint32_t index) -> const glm::mat4 & {
+                                   return instances.get(index).model;
+                               });
+}
+
+GpuCuller::~GpuCuller() {
+    // The build function references this object.
+    pipelineManager.wait(pipeline);
+    destroyBuffer(countBuffer, countMemory);
+    destroyBuffer(drawBuffer, drawMemory);
+    destroyBuffer(objectBuffer, objectMemory);
+    vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device.getDevice(), descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device.getDevice(), descriptorSetLayout, nullptr);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vk_frustum.h"
+#include "vk_meshlet.h"
+
+/*
+ * One cullable draw: a mesh range, a whole mesh or a meshlet, and the
+ * instance it is drawn with. Must match the GpuObject struct in cull.comp
+ * (std430).
+ */
+struct GpuObject {
+    // Local-space (center.xyz, radius.w), see Mesh::getBoundingSphere.
+    glm::vec4 boundingSphere;
+    // Local-space normal cone, see Meshlet::cone. Zero for ranges that are
+    // only frustum culled.
+    glm::vec4 cone;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t instanceIndex;
+};
+
+/*
+ * CPU reference of the culling shader: how many of objects it should emit
+ * for the frustum, where modelOf(instanceIndex) is the model matrix of an
+ * object's instance. Kept free of Vulkan objects so the host tests can run
+ * it (see tools/engine_tests).
+ */
+template <typename ModelOf>
+uint32_t countVisibleObjects(const std::vector<GpuObject> &objects, const Frustum &frustum,
+                             const glm::vec3 &cameraPosition, ModelOf modelOf) {
+    uint32_t visibleCount = 0;
+    for (const auto &object : objects) {
+        const glm::mat4 &model = modelOf(object.instanceIndex);
+        glm::vec4 sphere = transformSphere(model, object.boundingSphere);
+        glm::vec4 cone = transformCone(model, object.cone);
+        if (frustum.intersectsSphere(glm::vec3(sphere), sphere.w) &&
+            !isConeBackfacing(cone, glm::vec3(sphere), sphere.w, cameraPosition)) {
+            visibleCount++;
+        }
+    }
+    return visibleCount;
+}
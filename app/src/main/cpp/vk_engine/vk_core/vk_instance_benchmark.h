@@ -0,0 +1,74 @@
+#pragma once
+
+#include "vk_base.h"
+
+using namespace vkt;
+
+/*
+ * Steps the instance count through a list of sizes and logs how frame time
+ * scales with it. Each step renders a few warm-up frames, which absorb the
+ * cost of streaming the new instances to every frame slot, before measuring.
+ *
+ * Frame time is the interval between frames, so it is capped by the present
+ * mode's refresh rate; CPU time only covers recording and submission and
+ * shows how the CPU side scales independently of vsync.
+ */
+class InstanceBenchmark {
+public:
+    explicit InstanceBenchmark(std::vector<uint32_t> counts = {1, 1000, 10000, 25000, 50000, 100000},
+                               uint32_t warmupFrames = 30, uint32_t measuredFrames = 240)
+            : counts(std::move(counts)), warmupFrames(warmupFrames),
+              measuredFrames(measuredFrames) {}
+
+    bool isRunning() const { return step < counts.size(); }
+    uint32_t getInstanceCount() const { return counts[step]; }
+
+    bool frame(float frameMs, float cpuMs, uint32_t streamedInstances);
+
+private:
+    std::vector<uint32_t> counts;
+    uint32_t warmupFrames;
+    uint32_t measuredFrames;
+
+    size_t step = 0;
+    uint32_t frameIndex = 0;
+    double frameMsSum = 0.0;
+    double cpuMsSum = 0.0;
+    float frameMsMax = 0.0f;
+    uint64_t streamedSum = 0;
+};
+
+/*
+ * Records one frame. Returns true when the benchmark moved on to the next
+ * instance count, which the caller then has to apply.
+ */
+bool InstanceBenchmark::frame(float frameMs, float cpuMs, uint32_t streamedInstances) {
+    if (!isRunning()) {
+        return false;
+    }
+
+    if (frameIndex++ < warmupFrames) {
+        return false;
+    }
+    frameMsSum += frameMs;
+    cpuMsSum += cpuMs;
+    frameMsMax = std::max(frameMsMax, frameMs);
+    streamedSum += streamedInstances;
+
+    if (frameIndex < warmupFrames + measuredFrames) {
+        return false;
+    }
+
+    LOG_INFO("Instance benchmark: %6u instances, frame %.2f ms (max %.2f), CPU %.3f ms, "
+             "%llu instances streamed/frame",
+             counts[step], frameMsSum / measuredFrames, frameMsMax, cpuMsSum / measuredFrames,
+             (unsigned long long) (streamedSum / measuredFrames));
+
+    step++;
+    frameIndex = 0;
+    frameMsSum = 0.0;
+    cpuMsSum = 0.0;
+    frameMsMax = 0.0f;
+    streamedSum = 0;
+    return isRunning();
+}
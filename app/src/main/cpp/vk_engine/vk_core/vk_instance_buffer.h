@@ -0,0 +1,211 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+/*
+ * Per-instance data read by the vertex shader through gl_InstanceIndex. Must
+ * match the InstanceData struct in shader.vert (std430).
+ */
+struct InstanceData {
+    glm::mat4 model;
+};
+
+/*
+ * InstanceBuffer keeps the authoritative copy of every instance on the CPU
+ * and mirrors it into one region of a mapped storage buffer per frame in
+ * flight, bound with a dynamic offset.
+ *
+ * Only instances that changed are streamed: set() queues the index for every
+ * frame slot, and sync() copies the queued instances into the region of the
+ * slot about to be recorded. A static scene therefore costs nothing per
+ * frame once each slot has caught up.
+ */
+class InstanceBuffer {
+public:
+    InstanceBuffer(Device& device, MemoryAllocator& allocator, uint32_t capacity,
+                   uint32_t framesInFlight);
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    VkBuffer getBuffer() const { return buffer; }
+    VkDeviceSize getRange() const { return sizeof(InstanceData) * capacity; }
+    uint32_t getCapacity() const { return capacity; }
+    uint32_t getCount() const { return static_cast<uint32_t>(instances.size()); }
+    uint32_t getStreamedCount() const { return streamedCount; }
+    const InstanceData& get(uint32_t index) const { return instances[index]; }
+
+    void reallocate(uint32_t capacity, uint32_t framesInFlight);
+    void assign(const std::vector<InstanceData> &data);
+    void set(uint32_t index, const InstanceData &data);
+    uint32_t sync(uint32_t frameSlot);
+
+private:
+    Device& device;
+    MemoryAllocator& allocator;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+    uint32_t capacity = 0;
+    uint32_t framesInFlight = 0;
+    VkDeviceSize slotSize = 0;
+    VkDeviceSize atomSize = 1;
+
+    std::vector<InstanceData> instances;
+    // Bit s of dirtyMask[i] is set while instance i is queued in dirtyLists[s].
+    std::vector<uint8_t> dirtyMask;
+    std::vector<std::vector<uint32_t>> dirtyLists;
+    uint32_t streamedCount = 0;
+
+    void createBuffer();
+    void destroyBuffer();
+    void markAllDirty();
+};
+
+InstanceBuffer::InstanceBuffer(Device &device, MemoryAllocator &allocator, uint32_t capacity,
+                               uint32_t framesInFlight)
+        : device(device), allocator(allocator) {
+    reallocate(capacity, framesInFlight);
+}
+
+/*
+ * Recreates the GPU side for a new capacity or number of frame slots. The
+ * buffer must not be in use by the GPU; the instances are kept and streamed
+ * again.
+ */
+void InstanceBuffer::reallocate(uint32_t capacity, uint32_t framesInFlight) {
+    destroyBuffer();
+    this->capacity = std::max(capacity, 1u);
+    this->framesInFlight = framesInFlight;
+    createBuffer();
+
+    dirtyLists.assign(framesInFlight, {});
+    markAllDirty();
+}
+
+void InstanceBuffer::createBuffer() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
+    atomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    slotSize = alignUp(alignUp(getRange(), std::max<VkDeviceSize>(
+            properties.limits.minStorageBufferOffsetAlignment, 1)), atomSize);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = slotSize * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &buffer));
+
+    // On unified memory architectures host-visible memory is usually
+    // device-local as well.
+    allocation = allocator.allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void InstanceBuffer::destroyBuffer() {
+    if (buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device.getDevice(), buffer, nullptr);
+        allocator.free(allocation);
+        buffer = VK_NULL_HANDLE;
+    }
+}
+
+void InstanceBuffer::markAllDirty() {
+    dirtyMask.assign(instances.size(), static_cast<uint8_t>((1u << framesInFlight) - 1));
+    for (auto &dirtyList : dirtyLists) {
+        dirtyList.resize(instances.size());
+        for (uint32_t i = 0; i < instances.size(); i++) {
+            dirtyList[i] = i;
+        }
+    }
+}
+
+/*
+ * Replaces every instance. data must fit in the current capacity.
+ */
+void InstanceBuffer::assign(const std::vector<InstanceData> &data) {
+    if (data.size() > capacity) {
+        throw std::runtime_error("Instance buffer capacity exceeded!");
+    }
+    instances = data;
+    markAllDirty();
+}
+
+void InstanceBuffer::set(uint32_t index, const InstanceData &data) {
+    instances[index] = data;
+    for (uint32_t slot = 0; slot < framesInFlight; slot++) {
+        uint8_t bit = static_cast<uint8_t>(1u << slot);
+        if (!(dirtyMask[index] & bit)) {
+            dirtyMask[index] |= bit;
+            dirtyLists[slot].push_back(index);
+        }
+    }
+}
+
+/*
+ * Brings the frame slot's region up to date and returns its dynamic offset.
+ * The slot must have been retired by the FrameScheduler.
+ */
+uint32_t InstanceBuffer::sync(uint32_t frameSlot) {
+    VkDeviceSize slotOffset = slotSize * frameSlot;
+    auto *slotData = reinterpret_cast<InstanceData *>(
+            static_cast<uint8_t *>(allocation.mapped) + slotOffset);
+
+    std::vector<uint32_t> &dirtyList = dirtyLists[frameSlot];
+    streamedCount = static_cast<uint32_t>(dirtyList.size());
+    if (dirtyList.empty()) {
+        return static_cast<uint32_t>(slotOffset);
+    }
+
+    uint8_t bit = static_cast<uint8_t>(1u << frameSlot);
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (uint32_t index : dirtyList) {
+        slotData[index] = instances[index];
+        dirtyMask[index] &= ~bit;
+        first = std::min(first, index);
+        last = std::max(last, index);
+    }
+    dirtyList.clear();
+
+    if (!(allocation.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        VkDeviceSize begin = sizeof(InstanceData) * first / atomSize * atomSize;
+        VkDeviceSize end = std::min(alignUp(sizeof(InstanceData) * (last + 1), atomSize), slotSize);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = allocation.offset + slotOffset + begin;
+        range.size = end - begin;
+        VK_CHECK(vkFlushMappedMemoryRanges(device.getDevice(), 1, &range));
+    }
+    return static_cast<uint32_t>(slotOffset);
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    destroyBuffer();
+}
+
+/*
+ * Lays count unit cubes out on a cubic grid spanning [-1, 1]. A single
+ * instance gets the identity transform.
+ */
+std::vector<InstanceData> createInstanceGrid(uint32_t count) {
+    uint32_t side = 1;
+    while (side * side * side < count) {
+        side++;
+    }
+    float spacing = 2.0f / side;
+    float scale = spacing * 0.5f;
+
+    std::vector<InstanceData> instances(count);
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 cell(i % side, (i / side) % side, i / (side * side));
+        glm::vec3 position = (cell + 0.5f) * spacing - 1.0f;
+        instances[i].model = glm::scale(glm::translate(glm::mat4(1.0f), position),
+                                        glm::vec3(scale));
+    }
+    return instances;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded single-producer/single-consumer queue. Neither side ever blocks or
+ * takes a lock: push fails when the ring is full and pop fails when it is
+ * empty, leaving the retry policy to the caller.
+ *
+ * Head and tail live on separate cache lines so the producer and the
+ * consumer do not false-share.
+ */
+template <typename T, size_t Capacity>
+class LockFreeQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    bool push(const T& value) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[tail & (Capacity - 1)] = value;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[head & (Capacity - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return headIndex.load(std::memory_order_acquire) ==
+               tailIndex.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, Capacity> slots{};
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "vk_mesh_data.h"
+
+#include <unordered_map>
+
+/*
+ * Simplifies a triangle list by vertex clustering: vertices are binned into a
+ * grid of cellSize cubes and every vertex of a cell is replaced by the one
+ * closest to the cell's average position. Triangles collapsing to a line or
+ * a point are dropped.
+ *
+ * Representatives are existing vertices, so every level keeps indexing the
+ * original vertex buffer and its attributes. error receives the largest
+ * distance any vertex was moved.
+ */
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> &vertices,
+                                   const uint32_t *indices, uint32_t indexCount,
+                                   float cellSize, float &error) {
+    Aabb bounds = Aabb::empty();
+    for (const auto &vertex : vertices) {
+        bounds.grow(vertex.position);
+    }
+
+    struct Cluster {
+        glm::vec3 sum{0.0f};
+        uint32_t count = 0;
+        uint32_t representative = UINT32_MAX;
+        float representativeDistance = INFINITY;
+    };
+    std::unordered_map<uint64_t, uint32_t> cellClusters;
+    std::vector<Cluster> clusters;
+    std::vector<uint32_t> vertexClusters(vertices.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        glm::uvec3 cell = glm::uvec3((vertices[i].position - bounds.minimum) / cellSize);
+        uint64_t key = (uint64_t(cell.x) & 0x1FFFFF) | (uint64_t(cell.y) & 0x1FFFFF) << 21 |
+                       (uint64_t(cell.z) & 0x1FFFFF) << 42;
+        auto inserted = cellClusters.emplace(key, static_cast<uint32_t>(clusters.size()));
+        if (inserted.second) {
+            clusters.emplace_back();
+        }
+        Cluster &cluster = clusters[inserted.first->second];
+        cluster.sum += vertices[i].position;
+        cluster.count++;
+        vertexClusters[i] = inserted.first->second;
+    }
+
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        Cluster &cluster = clusters[vertexClusters[i]];
+        glm::vec3 offset = vertices[i].position - cluster.sum / float(cluster.count);
+        float distance = glm::dot(offset, offset);
+        if (distance < cluster.representativeDistance) {
+            cluster.representative = i;
+            cluster.representativeDistance = distance;
+        }
+    }
+
+    error = 0.0f;
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        uint32_t representative = clusters[vertexClusters[i]].representative;
+        error = std::max(error, glm::length(vertices[i].position -
+                                            vertices[representative].position));
+    }
+
+    std::vector<uint32_t> simplified;
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        uint32_t a = clusters[vertexClusters[indices[i]]].representative;
+        uint32_t b = clusters[vertexClusters[indices[i + 1]]].representative;
+        uint32_t c = clusters[vertexClusters[indices[i + 2]]].representative;
+        if (a != b && b != c && c != a) {
+            simplified.insert(simplified.end(), {a, b, c});
+        }
+    }
+    return simplified;
+}
+
+/*
+ * Appends a level of detail chain to mesh, meant to run once when the mesh is
+ * imported. Each level aims for half the triangles of the previous one by
+ * growing the clustering grid until it gets there; the chain stops early once
+ * a level would lose every triangle or fail to get any simpler. Any existing
+ * chain is replaced, keeping its finest level; meshlets are dropped and have
+ * to be built again.
+ */
+void generateLods(MeshData &mesh, uint32_t maxLodCount = 4) {
+    uint32_t baseCount = mesh.lods.empty() ? static_cast<uint32_t>(mesh.indices.size())
+                                           : mesh.lods[0].indexCount;
+    uint32_t baseFirst = mesh.lods.empty() ? 0 : mesh.lods[0].firstIndex;
+    std::vector<uint32_t> baseIndices(mesh.indices.begin() + baseFirst,
+                                      mesh.indices.begin() + baseFirst + baseCount);
+    mesh.indices = baseIndices;
+    mesh.lods = {{0, baseCount, 0.0f}};
+    mesh.meshlets.clear();
+    if (mesh.vertices.empty() || baseCount == 0) {
+        return;
+    }
+
+    Aabb bounds = computeBounds(mesh);
+    float size = glm::length(bounds.maximum - bounds.minimum);
+    float cellSize = size / 256.0f;
+    while (mesh.lods.size() < maxLodCount) {
+        uint32_t previousCount = mesh.lods.back().indexCount;
+        uint32_t targetCount = previousCount / 2;
+
+        std::vector<uint32_t> lodIndices;
+        float error = 0.0f;
+        do {
+            lodIndices = simplifyMesh(mesh.vertices, baseIndices.data(), baseCount, cellSize,
+                                      error);
+            cellSize *= 1.25f;
+        } while (lodIndices.size() > targetCount && cellSize < size);
+
+        if (lodIndices.empty() || lodIndices.size() >= previousCount) {
+            break;
+        }
+        // Coarser levels cluster the original mesh, so error only grows.
+        error = std::max(error, mesh.lods.back().error);
+        mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()),
+                             static_cast<uint32_t>(lodIndices.size()), error});
+        mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+}
+
+/*
+ * Picks a level of detail per object from its screen-space error: the error
+ * of a level projected at the object's nearest distance to the camera, in
+ * pixels. The coarsest level under maxPixelError wins.
+ *
+ * Every object remembers its level. A coarser level is only taken once it is
+ * under maxPixelError by the hysteresis margin, so objects sitting at a
+ * threshold distance do not pop between levels every frame.
+ */
+class LodSelector {
+public:
+    explicit LodSelector(float maxPixelError = 1.0f, float hysteresis = 0.25f)
+            : maxPixelError(maxPixelError), hysteresis(hysteresis) {}
+
+    void setView(const glm::mat4 &proj, const glm::mat4 &modelView, uint32_t viewportHeight);
+    void resize(uint32_t objectCount);
+    uint32_t select(uint32_t object, const std::vector<MeshLod> &lods,
+                    const glm::vec3 &center, float radius, float scale);
+
+private:
+    float maxPixelError;
+    float hysteresis;
+    glm::vec3 eye{0.0f};
+    float pixelsPerUnit = 0.0f;
+    std::vector<uint8_t> objectLods;
+};
+
+/*
+ * proj is the projection updateUniformBuffers builds; modelView maps the
+ * space objects are given in to view space.
+ */
+void LodSelector::setView(const glm::mat4 &proj, const glm::mat4 &modelView,
+                          uint32_t viewportHeight) {
+    eye = glm::vec3(glm::inverse(modelView)[3]);
+    // Pixels covered by one unit one unit in front of the camera.
+    pixelsPerUnit = std::abs(proj[1][1]) * 0.5f * viewportHeight;
+}
+
+/*
+ * Objects start at the finest level.
+ */
+void LodSelector::resize(uint32_t objectCount) {
+    objectLods.assign(objectCount, 0);
+}
+
+/*
+ * center and radius bound the object in the space given to setView; scale is
+ * how much larger the object is than its mesh, applied to the level errors.
+ */
+uint32_t LodSelector::select(uint32_t object, const std::vector<MeshLod> &lods,
+                             const glm::vec3 &center, float radius, float scale) {
+    float distance = std::max(glm::length(center - eye) - radius, 1e-3f);
+    float pixelScale = scale * pixelsPerUnit / distance;
+
+    uint32_t lod = std::min<uint32_t>(objectLods[object], lods.size() - 1);
+    while (lod > 0 && lods[lod].error * pixelScale > maxPixelError) {
+        lod--;
+    }
+    while (lod + 1 < lods.size() &&
+           lods[lod + 1].error * pixelScale < maxPixelError * (1.0f - hysteresis)) {
+        lod++;
+    }
+    objectLods[object] = static_cast<uint8_t>(lod);
+    return lod;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "vk_mesh_data.h"
+#include "vk_mesh_file.h"
+#include "vk_staging.h"
+
+/*
+ * A MeshData uploaded to device-local vertex and index buffers. Vertices are
+ * encoded in the given VertexFormat; indices are stored as 16 bits whenever
+ * the vertex count allows it. Meshes loaded from a MeshFile keep the file's
+ * vertex format and index size and are uploaded straight from its mapping.
+ */
+class Mesh {
+public:
+    Mesh(Device& device, MemoryAllocator& allocator, StagingUploader& uploader,
+         const MeshData& data, const VertexFormat& format = {});
+    Mesh(Device& device, MemoryAllocator& allocator, StagingUploader& uploader,
+         const MeshFile& file);
+    Mesh(Device& device, MemoryAllocator& allocator, const MeshFile& file,
+         VkCommandBuffer commandBuffer, VkBuffer stagingBuffer);
+
+    static VkDeviceSize getStagingSize(const MeshFile& file);
+    static void writeStaging(const MeshFile& file, void *staging);
+    ~Mesh();
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // Index count of the finest level of detail.
+    uint32_t getIndexCount() const { return lods[0].indexCount; }
+    const std::vector<MeshLod>& getLods() const { return lods; }
+    const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+    uint32_t getVertexCount() const { return vertexCount; }
+    // Local-space bounds as (center.xyz, radius.w), used for culling.
+    glm::vec4 getBoundingSphere() const { return boundingSphere; }
+    const Aabb& getBounds() const { return bounds; }
+
+    const VertexFormat& getVertexFormat() const { return format; }
+    VkDeviceSize getMemorySize() const { return vertexMemory.size + indexMemory.size; }
+
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+private:
+    Device& device;
+    MemoryAllocator& allocator;
+
+    VkBuffer vertexBuffer;
+    MemoryAllocation vertexMemory;
+    VkBuffer indexBuffer;
+    MemoryAllocation indexMemory;
+    VkIndexType indexType;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    VertexFormat format;
+    VertexConstants vertexConstants;
+    glm::vec4 boundingSphere;
+    Aabb bounds;
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+                      MemoryAllocation &memory);
+};
+
+Mesh::Mesh(Device &device, MemoryAllocator &allocator, StagingUploader &uploader,
+           const MeshData &data, const VertexFormat &format)
+        : device(device), allocator(allocator), format(format) {
+    vertexCount = static_cast<uint32_t>(data.vertices.size());
+    indexCount = static_cast<uint32_t>(data.indices.size());
+    boundingSphere = computeBoundingSphere(data);
+    bounds = computeBounds(data);
+    lods = data.lods;
+    meshlets = data.meshlets;
+    if (lods.empty()) {
+        lods.push_back({0, indexCount, 0.0f});
+    }
+
+    EncodedVertices encoded = encodeVertices(format, data.vertices);
+    vertexConstants = encoded.constants;
+    createBuffer(encoded.data.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer,
+                 vertexMemory);
+    uploader.upload(vertexBuffer, encoded.data.data(), encoded.data.size());
+
+    if (vertexCount <= UINT16_MAX + 1) {
+        std::vector<uint16_t> shortIndices(data.indices.begin(), data.indices.end());
+        indexType = VK_INDEX_TYPE_UINT16;
+        createBuffer(sizeof(uint16_t) * indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                     indexBuffer, indexMemory);
+        uploader.upload(indexBuffer, shortIndices.data(), sizeof(uint16_t) * indexCount);
+    } else {
+        indexType = VK_INDEX_TYPE_UINT32;
+        createBuffer(sizeof(uint32_t) * indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                     indexBuffer, indexMemory);
+        uploader.upload(indexBuffer, data.indices.data(), sizeof(uint32_t) * indexCount);
+    }
+}
+
+Mesh::Mesh(Device &device, MemoryAllocator &allocator, StagingUploader &uploader,
+           const MeshFile &file)
+        : device(device), allocator(allocator), format(file.getVertexFormat()) {
+    const MeshFileHeader &header = file.getHeader();
+    vertexCount = header.vertexCount;
+    indexCount = header.indexCount;
+    indexType = file.getIndexType();
+    vertexConstants = header.vertexConstants;
+    MeshFileBounds fileBounds = file.getBounds();
+    boundingSphere = fileBounds.boundingSphere;
+    bounds = fileBounds.box;
+    lods = file.getLods();
+    meshlets = file.getMeshlets();
+
+    ByteSpan vertices = file.getSection(MESH_SECTION_VERTICES);
+    createBuffer(vertices.size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMemory);
+    uploader.upload(vertexBuffer, vertices.data, vertices.size);
+
+    ByteSpan indices = file.getSection(MESH_SECTION_INDICES);
+    createBuffer(indices.size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMemory);
+    uploader.upload(indexBuffer, indices.data, indices.size);
+}
+
+/*
+ * Creates the buffers for file and records their upload from stagingBuffer,
+ * filled by writeStaging, into commandBuffer. The mesh may only be drawn
+ * once commandBuffer has executed; see AssetStreamer.
+ */
+Mesh::Mesh(Device &device, MemoryAllocator &allocator, const MeshFile &file,
+           VkCommandBuffer commandBuffer, VkBuffer stagingBuffer)
+        : device(device), allocator(allocator), format(file.getVertexFormat()) {
+    const MeshFileHeader &header = file.getHeader();
+    vertexCount = header.vertexCount;
+    indexCount = header.indexCount;
+    indexType = file.getIndexType();
+    vertexConstants = header.vertexConstants;
+    MeshFileBounds fileBounds = file.getBounds();
+    boundingSphere = fileBounds.boundingSphere;
+    bounds = fileBounds.box;
+    lods = file.getLods();
+    meshlets = file.getMeshlets();
+
+    VkDeviceSize vertexSize = file.getSection(MESH_SECTION_VERTICES).size;
+    VkDeviceSize indexSize = file.getSection(MESH_SECTION_INDICES).size;
+    createBuffer(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMemory);
+    createBuffer(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMemory);
+
+    VkBufferCopy vertexCopy{0, 0, vertexSize};
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &vertexCopy);
+    VkBufferCopy indexCopy{(vertexSize + 3) & ~VkDeviceSize(3), 0, indexSize};
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, indexBuffer, 1, &indexCopy);
+
+    // Later submissions to the queue read the buffers without waiting on the
+    // upload's fence.
+    VkBufferMemoryBarrier barriers[2]{};
+    for (auto &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.size = VK_WHOLE_SIZE;
+    }
+    barriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barriers[0].buffer = vertexBuffer;
+    barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+    barriers[1].buffer = indexBuffer;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 2, barriers, 0,
+                         nullptr);
+}
+
+/*
+ * Staging bytes the streaming constructor uploads from: the vertex section,
+ * then the index section 4-byte aligned.
+ */
+VkDeviceSize Mesh::getStagingSize(const MeshFile &file) {
+    VkDeviceSize vertexSize = file.getSection(MESH_SECTION_VERTICES).size;
+    return ((vertexSize + 3) & ~VkDeviceSize(3)) + file.getSection(MESH_SECTION_INDICES).size;
+}
+
+void Mesh::writeStaging(const MeshFile &file, void *staging) {
+    ByteSpan vertices = file.getSection(MESH_SECTION_VERTICES);
+    ByteSpan indices = file.getSection(MESH_SECTION_INDICES);
+    memcpy(staging, vertices.data, vertices.size);
+    memcpy(static_cast<uint8_t *>(staging) + ((vertices.size + 3) & ~size_t(3)), indices.data,
+           indices.size);
+}
+
+void Mesh::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+                        MemoryAllocation &memory) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &buffer));
+
+    memory = allocator.allocateBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+/*
+ * Binds the buffers and pushes the constants decoding this mesh's vertex
+ * format, which pipelineLayout must declare for the vertex stage.
+ */
+void Mesh::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(VertexConstants), &vertexConstants);
+}
+
+Mesh::~Mesh() {
+    vkDestroyBuffer(device.getDevice(), indexBuffer, nullptr);
+    allocator.free(indexMemory);
+    vkDestroyBuffer(device.getDevice(), vertexBuffer, nullptr);
+    allocator.free(vertexMemory);
+}
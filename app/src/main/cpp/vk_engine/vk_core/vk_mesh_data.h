@@ -0,0 +1,97 @@
+#pragma once
+
+#include "vk_frustum.h"
+#include "vk_vertex_format.h"
+
+/*
+ * One level of detail: a range of the mesh's index buffer over the shared
+ * vertices. error is the largest distance, in mesh units, between a vertex
+ * and where this level draws it.
+ */
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+/*
+ * A small cluster of neighbouring triangles, drawn as a range of the mesh's
+ * index buffer and culled on its own, see buildMeshlets.
+ */
+struct Meshlet {
+    // Local-space (center.xyz, radius.w).
+    glm::vec4 boundingSphere;
+    // Normal cone (axis.xyz, cos(half angle).w) bounding the triangle
+    // normals; w <= 0 when the cone is too wide to ever cull.
+    glm::vec4 cone;
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+};
+
+/*
+ * CPU-side indexed triangle list. lods lists the index ranges of the level of
+ * detail chain from the finest; when empty, every index belongs to one level.
+ * meshlets, when built, split the finest level into clusters whose triangles
+ * follow every level in indices.
+ */
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+};
+
+/*
+ * Unit cube centred on the origin. Its eight corners are shared by the three
+ * faces meeting there and coloured by position, with normals pointing away
+ * from the centre. The triangles keep the winding of the cube formerly
+ * hardcoded in shader.vert.
+ */
+MeshData createCubeMesh() {
+    MeshData mesh;
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f);
+        mesh.vertices.push_back({corner, corner + 0.5f, glm::normalize(corner),
+                                 glm::vec2(corner) + 0.5f});
+    }
+    // Corner i sits at +x when bit 0 is set, +y for bit 1 and +z for bit 2.
+    mesh.indices = {
+            4, 5, 7,  4, 7, 6,  // Front
+            0, 2, 3,  0, 3, 1,  // Back
+            2, 6, 7,  2, 7, 3,  // Top
+            0, 1, 5,  0, 5, 4,  // Bottom
+            1, 3, 7,  1, 7, 5,  // Right
+            0, 4, 6,  0, 6, 2   // Left
+    };
+    return mesh;
+}
+
+Aabb computeBounds(const MeshData &mesh) {
+    if (mesh.vertices.empty()) {
+        return {glm::vec3(0.0f), glm::vec3(0.0f)};
+    }
+    Aabb bounds = Aabb::empty();
+    for (const auto &vertex : mesh.vertices) {
+        bounds.grow(vertex.position);
+    }
+    return bounds;
+}
+
+/*
+ * Sphere around the centre of the mesh's bounding box. Not minimal, but
+ * cheap and tight enough for culling boxy meshes.
+ */
+glm::vec4 computeBoundingSphere(const MeshData &mesh) {
+    if (mesh.vertices.empty()) {
+        return glm::vec4(0.0f);
+    }
+    glm::vec3 center = computeBounds(mesh).getCenter();
+
+    float radiusSquared = 0.0f;
+    for (const auto &vertex : mesh.vertices) {
+        glm::vec3 offset = vertex.position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    return glm::vec4(center, std::sqrt(radiusSquared));
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "vk_filesystem.h"
+#include "vk_mesh_data.h"
+
+#include <type_traits>
+
+/*
+ * Binary mesh container, written by tools/mesh_converter and by
+ * writeMeshFile. A MeshFileHeader at offset 0 is followed by one section per
+ * MeshFileSection, each starting at a multiple of MESH_FILE_ALIGNMENT:
+ *
+ * 	- Vertices: vertexCount vertices already encoded in the header's vertex
+ * 	  format, exactly as the vertex buffer holds them.
+ * 	- Indices: indexCount indices of indexSize bytes, exactly as the index
+ * 	  buffer holds them; the levels of detail and meshlets index into them.
+ * 	- Lods and Meshlets: arrays of MeshLod and Meshlet.
+ * 	- Bounds: one MeshFileBounds.
+ *
+ * Everything is stored little endian with the in-memory layout of the
+ * engine's structs, so a mapped file is used in place: buffers are filled
+ * with one copy from the mapping into staging memory and nothing is parsed.
+ * Files are bound to the struct layouts; any change to them must bump
+ * MESH_FILE_VERSION.
+ */
+constexpr uint32_t MESH_FILE_MAGIC = 0x48534D59;  // "YMSH"
+constexpr uint32_t MESH_FILE_VERSION = 2;
+// Enough for every struct stored, and for the staging copies to start on a
+// cache line. APK assets are only 4-byte aligned, which the structs tolerate.
+constexpr uint32_t MESH_FILE_ALIGNMENT = 64;
+
+enum MeshFileSection : uint32_t {
+    MESH_SECTION_VERTICES,
+    MESH_SECTION_INDICES,
+    MESH_SECTION_LODS,
+    MESH_SECTION_MESHLETS,
+    MESH_SECTION_BOUNDS,
+    MESH_SECTION_COUNT
+};
+
+struct MeshFileRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    // VertexFormat of the vertex section.
+    uint32_t vertexAttributes;
+    uint32_t positionEncoding;
+    uint32_t packed;
+    VertexConstants vertexConstants;
+    MeshFileRange sections[MESH_SECTION_COUNT];
+};
+
+struct MeshFileBounds {
+    // Local-space (center.xyz, radius.w).
+    glm::vec4 boundingSphere;
+    Aabb box;
+};
+
+static_assert(std::is_trivially_copyable<MeshFileHeader>::value &&
+              std::is_trivially_copyable<MeshLod>::value &&
+              std::is_trivially_copyable<Meshlet>::value &&
+              std::is_trivially_copyable<MeshFileBounds>::value,
+              "Mesh file structs are stored as raw bytes");
+static_assert(sizeof(MeshFileHeader) == 144 && sizeof(MeshLod) == 12 && sizeof(Meshlet) == 44 &&
+              sizeof(MeshFileBounds) == 40, "Mesh file layout changed; bump MESH_FILE_VERSION");
+
+/*
+ * Encodes mesh in format and lays it out as a mesh file. Indices are stored
+ * as 16 bits whenever the vertex count allows it.
+ */
+std::vector<uint8_t> writeMeshFile(const MeshData &mesh, const VertexFormat &format) {
+    MeshFileHeader header{};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.indexSize = header.vertexCount <= UINT16_MAX + 1 ? 2 : 4;
+    header.vertexAttributes = format.attributes;
+    header.positionEncoding = static_cast<uint32_t>(format.position);
+    header.packed = format.packed;
+
+    EncodedVertices encoded = encodeVertices(format, mesh.vertices);
+    header.vertexConstants = encoded.constants;
+    std::vector<MeshLod> lods = mesh.lods;
+    if (lods.empty()) {
+        lods.push_back({0, header.indexCount, 0.0f});
+    }
+    MeshFileBounds bounds{computeBoundingSphere(mesh), computeBounds(mesh)};
+
+    const size_t sizes[MESH_SECTION_COUNT] = {
+            encoded.data.size(),
+            size_t(header.indexCount) * header.indexSize,
+            lods.size() * sizeof(MeshLod),
+            mesh.meshlets.size() * sizeof(Meshlet),
+            sizeof(MeshFileBounds)};
+    uint64_t offset = sizeof(MeshFileHeader);
+    for (uint32_t i = 0; i < MESH_SECTION_COUNT; i++) {
+        offset = (offset + MESH_FILE_ALIGNMENT - 1) & ~uint64_t(MESH_FILE_ALIGNMENT - 1);
+        header.sections[i] = {offset, sizes[i]};
+        offset += sizes[i];
+    }
+
+    std::vector<uint8_t> file(offset, 0);
+    memcpy(file.data(), &header, sizeof(header));
+    auto section = [&](MeshFileSection section) {
+        return file.data() + header.sections[section].offset;
+    };
+    memcpy(section(MESH_SECTION_VERTICES), encoded.data.data(), encoded.data.size());
+    if (header.indexSize == 2) {
+        auto *indices = reinterpret_cast<uint16_t *>(section(MESH_SECTION_INDICES));
+        std::copy(mesh.indices.begin(), mesh.indices.end(), indices);
+    } else {
+        memcpy(section(MESH_SECTION_INDICES), mesh.indices.data(), sizes[MESH_SECTION_INDICES]);
+    }
+    memcpy(section(MESH_SECTION_LODS), lods.data(), sizes[MESH_SECTION_LODS]);
+    memcpy(section(MESH_SECTION_MESHLETS), mesh.meshlets.data(), sizes[MESH_SECTION_MESHLETS]);
+    memcpy(section(MESH_SECTION_BOUNDS), &bounds, sizeof(bounds));
+    return file;
+}
+
+/*
+ * A mesh file opened through FileSystem, read in place from its mapping.
+ * Opening checks that the header is sound, every section lies within the
+ * file and every index range and index is in bounds, since the GPU trusts
+ * them; the vertices themselves are never parsed.
+ */
+class MeshFile {
+public:
+    MeshFile() = default;
+
+    static MeshFile open(const FileSystem &fileSystem, const std::string &path);
+
+    explicit operator bool() const { return valid; }
+    const MeshFileHeader& getHeader() const { return header; }
+    ByteSpan getSection(MeshFileSection section) const;
+
+    VertexFormat getVertexFormat() const;
+    VkIndexType getIndexType() const {
+        return header.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    }
+    std::vector<MeshLod> getLods() const { return getArray<MeshLod>(MESH_SECTION_LODS); }
+    std::vector<Meshlet> getMeshlets() const { return getArray<Meshlet>(MESH_SECTION_MESHLETS); }
+    MeshFileBounds getBounds() const { return getArray<MeshFileBounds>(MESH_SECTION_BOUNDS)[0]; }
+
+    MeshData decode() const;
+
+private:
+    FileView view;
+    // Copied out of the mapping, which is not always 8-byte aligned.
+    MeshFileHeader header{};
+    bool valid = false;
+
+    bool hasValidIndices() const;
+
+    template<typename T>
+    std::vector<T> getArray(MeshFileSection section) const {
+        ByteSpan bytes = getSection(section);
+        std::vector<T> array(bytes.size / sizeof(T));
+        memcpy(array.data(), bytes.data, array.size() * sizeof(T));
+        return array;
+    }
+};
+
+/*
+ * Returns a file that converts to false, after logging why, if path cannot
+ * be opened or does not hold a mesh file of this version.
+ */
+MeshFile MeshFile::open(const FileSystem &fileSystem, const std::string &path) {
+    MeshFile file;
+    file.view = fileSystem.open(path);
+    if (!file.view) {
+        return file;
+    }
+    if (file.view.size() < sizeof(MeshFileHeader)) {
+        LOG_ERR("Mesh file %s: truncated", path.c_str());
+        return file;
+    }
+    memcpy(&file.header, file.view.data(), sizeof(MeshFileHeader));
+    const MeshFileHeader &header = file.header;
+    if (header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION) {
+        LOG_ERR("Mesh file %s: not a version %u mesh file", path.c_str(), MESH_FILE_VERSION);
+        return file;
+    }
+
+    VertexFormat format = file.getVertexFormat();
+    const uint64_t expectedSizes[MESH_SECTION_COUNT] = {
+            uint64_t(header.vertexCount) * format.getStride(),
+            uint64_t(header.indexCount) * header.indexSize,
+            header.sections[MESH_SECTION_LODS].size / sizeof(MeshLod) * sizeof(MeshLod),
+            header.sections[MESH_SECTION_MESHLETS].size / sizeof(Meshlet) * sizeof(Meshlet),
+            sizeof(MeshFileBounds)};
+    bool valid = header.vertexCount > 0 && header.indexCount > 0;
+    valid &= header.indexSize == 2 || header.indexSize == 4;
+    valid &= header.positionEncoding <= static_cast<uint32_t>(PositionEncoding::Snorm16);
+    valid &= header.sections[MESH_SECTION_LODS].size >= sizeof(MeshLod);
+    for (uint32_t i = 0; i < MESH_SECTION_COUNT; i++) {
+        const MeshFileRange &range = header.sections[i];
+        valid &= range.size == expectedSizes[i] && range.offset <= file.view.size() &&
+                 range.size <= file.view.size() - range.offset;
+    }
+    if (!valid) {
+        LOG_ERR("Mesh file %s: sections do not match the header", path.c_str());
+        return file;
+    }
+
+    // Small enough to check every range; the draws trust them. The sums are
+    // taken in 64 bits so that no count wraps into range.
+    for (const auto &lod : file.getLods()) {
+        valid &= uint64_t(lod.firstIndex) + lod.indexCount <= header.indexCount;
+    }
+    for (const auto &meshlet : file.getMeshlets()) {
+        valid &= uint64_t(meshlet.firstIndex) + uint64_t(meshlet.triangleCount) * 3 <=
+                 header.indexCount;
+    }
+    if (!valid) {
+        LOG_ERR("Mesh file %s: index ranges out of bounds", path.c_str());
+        return file;
+    }
+
+    // Nor does the GPU check the indices themselves. The I/O thread faults
+    // the whole mapping in anyway, so this is one more pass over memory.
+    if (!file.hasValidIndices()) {
+        LOG_ERR("Mesh file %s: indices out of bounds", path.c_str());
+        return file;
+    }
+    file.valid = true;
+    return file;
+}
+
+/*
+ * Whether every index refers to one of the file's vertices.
+ */
+bool MeshFile::hasValidIndices() const {
+    ByteSpan indices = getSection(MESH_SECTION_INDICES);
+    uint32_t largest = 0;
+    if (header.indexSize == 2) {
+        for (uint32_t i = 0; i < header.indexCount; i++) {
+            uint16_t index;
+            memcpy(&index, indices.data + i * 2, sizeof(index));
+            largest = std::max<uint32_t>(largest, index);
+        }
+    } else {
+        for (uint32_t i = 0; i < header.indexCount; i++) {
+            uint32_t index;
+            memcpy(&index, indices.data + i * 4, sizeof(index));
+            largest = std::max(largest, index);
+        }
+    }
+    return largest < header.vertexCount;
+}
+
+ByteSpan MeshFile::getSection(MeshFileSection section) const {
+    const MeshFileRange &range = header.sections[section];
+    return {view.data() + range.offset, static_cast<size_t>(range.size)};
+}
+
+VertexFormat MeshFile::getVertexFormat() const {
+    return {header.vertexAttributes, static_cast<PositionEncoding>(header.positionEncoding),
+            header.packed != 0};
+}
+
+/*
+ * Decodes the file back into a MeshData, for CPU-side work such as picking.
+ * Drawing does not need it. Quantized attributes come back with their
+ * quantization error.
+ */
+MeshData MeshFile::decode() const {
+    MeshData mesh;
+    EncodedVertices encoded;
+    ByteSpan vertices = getSection(MESH_SECTION_VERTICES);
+    encoded.data.assign(vertices.data, vertices.data + vertices.size);
+    encoded.constants = header.vertexConstants;
+    VertexFormat format = getVertexFormat();
+    mesh.vertices.reserve(header.vertexCount);
+    for (uint32_t i = 0; i < header.vertexCount; i++) {
+        mesh.vertices.push_back(decodeVertex(format, encoded, i));
+    }
+
+    ByteSpan indices = getSection(MESH_SECTION_INDICES);
+    mesh.indices.resize(header.indexCount);
+    for (uint32_t i = 0; i < header.indexCount; i++) {
+        if (header.indexSize == 2) {
+            uint16_t index;
+            memcpy(&index, indices.data + i * 2, sizeof(index));
+            mesh.indices[i] = index;
+        } else {
+            memcpy(&mesh.indices[i], indices.data + i * 4, sizeof(uint32_t));
+        }
+    }
+    mesh.lods = getLods();
+    mesh.meshlets = getMeshlets();
+    return mesh;
+}
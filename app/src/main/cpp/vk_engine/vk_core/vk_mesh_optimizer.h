@@ -0,0 +1,373 @@
+#pragma once
+
+#include "vk_mesh_data.h"
+
+#include <atomic>
+#include <thread>
+
+// Post-transform cache entries assumed when ordering triangles. Mobile GPUs
+// vary and some batch vertices instead, but a small FIFO models them well
+// enough that orders tuned for it help everywhere.
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+/*
+ * Vertex shader cost of a triangle order on a FIFO post-transform cache.
+ * ACMR is the average number of vertices transformed per triangle (0.5 at
+ * best for large regular grids, 3 at worst); ATVR the number of
+ * transforms per vertex referenced (1 at best).
+ */
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+struct MeshOptimizationReport {
+    // Finest level of detail, before and after optimizeMesh.
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t clusterCount = 0;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, uint32_t indexCount,
+                                    uint32_t vertexCount,
+                                    uint32_t cacheSize = VERTEX_CACHE_SIZE) {
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    std::vector<uint8_t> referenced(vertexCount, 0);
+    // Time starts past the cache size so no vertex begins cached.
+    uint32_t time = cacheSize + 1;
+    uint32_t transformCount = 0;
+    uint32_t referencedCount = 0;
+    for (uint32_t i = 0; i < indexCount; i++) {
+        uint32_t vertex = indices[i];
+        if (time - cacheTimes[vertex] > cacheSize) {
+            cacheTimes[vertex] = time++;
+            transformCount++;
+        }
+        referencedCount += !referenced[vertex];
+        referenced[vertex] = 1;
+    }
+
+    VertexCacheStats stats;
+    if (indexCount >= 3) {
+        stats.acmr = float(transformCount) / float(indexCount / 3);
+    }
+    if (referencedCount > 0) {
+        stats.atvr = float(transformCount) / float(referencedCount);
+    }
+    return stats;
+}
+
+/*
+ * Reorders a triangle list for the post-transform cache with Tipsify (Sander,
+ * Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+ * Reduced Overdraw"). Triangles are emitted as fans around one vertex at a
+ * time; the next fan is the neighbour that will still be cached once its
+ * remaining triangles are emitted, and the one that entered the cache first
+ * among those.
+ *
+ * When no neighbour qualifies the walk jumps elsewhere and the cache
+ * effectively starts over. The first triangle of every such jump is appended
+ * to clusters, which optimizeOverdraw reorders around.
+ */
+void optimizeVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t vertexCount,
+                         std::vector<uint32_t> *clusters = nullptr,
+                         uint32_t cacheSize = VERTEX_CACHE_SIZE) {
+    uint32_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Triangles around every vertex, in compressed rows.
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        adjacencyOffsets[indices[i] + 1]++;
+    }
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    // Triangles left to emit around every vertex.
+    std::vector<uint32_t> liveCounts(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        liveCounts[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+    }
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> ordered;
+    ordered.reserve(triangleCount * 3);
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    // Most recently touched vertex with triangles left, else the next one in
+    // input order. Either way the cache has moved on.
+    auto skipDeadEnd = [&]() -> uint32_t {
+        while (!deadEnds.empty()) {
+            uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveCounts[vertex] > 0) {
+                return vertex;
+            }
+        }
+        while (cursor < vertexCount) {
+            if (liveCounts[cursor] > 0) {
+                return cursor;
+            }
+            cursor++;
+        }
+        return UINT32_MAX;
+    };
+
+    uint32_t fan = skipDeadEnd();
+    if (clusters) {
+        clusters->push_back(0);
+    }
+    while (fan != UINT32_MAX) {
+        candidates.clear();
+        for (uint32_t i = adjacencyOffsets[fan]; i < adjacencyOffsets[fan + 1]; i++) {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = 1;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                ordered.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCounts[vertex]--;
+                if (time - cacheTimes[vertex] > cacheSize) {
+                    cacheTimes[vertex] = time++;
+                }
+            }
+        }
+
+        uint32_t next = UINT32_MAX;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates) {
+            if (liveCounts[vertex] == 0) {
+                continue;
+            }
+            // Emitting the fan pushes at most two new vertices per triangle.
+            int64_t priority = 0;
+            if (time - cacheTimes[vertex] + 2 * liveCounts[vertex] <= cacheSize) {
+                priority = time - cacheTimes[vertex];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        if (next == UINT32_MAX) {
+            next = skipDeadEnd();
+            if (clusters && next != UINT32_MAX) {
+                clusters->push_back(static_cast<uint32_t>(ordered.size() / 3));
+            }
+        }
+        fan = next;
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+/*
+ * Reorders the clusters of a cache-optimized triangle list so that triangles
+ * likely to occlude the rest of the mesh are drawn first, following the same
+ * paper. Clusters facing away from the mesh's centroid (by the dot product
+ * of their area-weighted normal and their offset from the centroid) sit on
+ * the outside and come first; their order is independent of the viewpoint.
+ *
+ * Tipsify's clusters are long, so they are first split wherever the running
+ * ACMR of a cluster falls under threshold times the ACMR of the whole list:
+ * a split there costs little vertex reuse. Triangles within a cluster keep
+ * their order.
+ */
+uint32_t optimizeOverdraw(uint32_t *indices, uint32_t indexCount,
+                          const std::vector<Vertex> &vertices,
+                          const std::vector<uint32_t> &hardClusters, float threshold = 1.05f,
+                          uint32_t cacheSize = VERTEX_CACHE_SIZE) {
+    uint32_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || hardClusters.empty()) {
+        return 0;
+    }
+    auto vertexCount = static_cast<uint32_t>(vertices.size());
+    float meshAcmr = analyzeVertexCache(indices, indexCount, vertexCount, cacheSize).acmr;
+
+    std::vector<uint32_t> clusters;
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    for (size_t hard = 0; hard < hardClusters.size(); hard++) {
+        uint32_t end = hard + 1 < hardClusters.size() ? hardClusters[hard + 1] : triangleCount;
+        uint32_t start = hardClusters[hard];
+        uint32_t misses = 0;
+        // Each cluster may follow any other once sorted, so it starts cold.
+        time += cacheSize + 1;
+        clusters.push_back(start);
+        for (uint32_t triangle = start; triangle < end; triangle++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                if (time - cacheTimes[vertex] > cacheSize) {
+                    cacheTimes[vertex] = time++;
+                    misses++;
+                }
+            }
+            uint32_t clusterTriangles = triangle + 1 - clusters.back();
+            if (triangle + 1 < end &&
+                float(misses) / float(clusterTriangles) <= threshold * meshAcmr) {
+                clusters.push_back(triangle + 1);
+                misses = 0;
+                time += cacheSize + 1;
+            }
+        }
+    }
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.0f));
+    for (size_t cluster = 0; cluster < clusters.size(); cluster++) {
+        uint32_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangleCount;
+        float clusterArea = 0.0f;
+        for (uint32_t triangle = clusters[cluster]; triangle < end; triangle++) {
+            glm::vec3 a = vertices[indices[triangle * 3]].position;
+            glm::vec3 b = vertices[indices[triangle * 3 + 1]].position;
+            glm::vec3 c = vertices[indices[triangle * 3 + 2]].position;
+            // Twice the area, along the face normal.
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            clusterCentroids[cluster] += (a + b + c) * (area / 3.0f);
+            clusterNormals[cluster] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroids[cluster];
+        meshArea += clusterArea;
+        clusterCentroids[cluster] /= clusterArea > 0.0f ? clusterArea : 1.0f;
+    }
+    meshCentroid /= meshArea > 0.0f ? meshArea : 1.0f;
+
+    std::vector<float> sortKeys(clusters.size());
+    for (size_t cluster = 0; cluster < clusters.size(); cluster++) {
+        float length = glm::length(clusterNormals[cluster]);
+        glm::vec3 normal = length > 0.0f ? clusterNormals[cluster] / length : glm::vec3(0.0f);
+        sortKeys[cluster] = glm::dot(clusterCentroids[cluster] - meshCentroid, normal);
+    }
+    std::vector<uint32_t> order(clusters.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indexCount);
+    for (uint32_t cluster : order) {
+        uint32_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangleCount;
+        ordered.insert(ordered.end(), indices + clusters[cluster] * 3, indices + end * 3);
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+    return static_cast<uint32_t>(clusters.size());
+}
+
+/*
+ * Renumbers mesh.vertices in the order mesh.indices first reference them, so
+ * that consecutive draws walk the vertex buffer forwards and vertex fetch
+ * hits the same cache lines. Vertices no index references are dropped.
+ */
+void optimizeVertexFetch(MeshData &mesh) {
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (auto &index : mesh.indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+/*
+ * Import-time triangle and vertex ordering for every index range of mesh:
+ * each level of detail is ordered for the post-transform cache and then
+ * for overdraw, each meshlet for the cache only so that it keeps its
+ * triangles, and finally the vertices for fetch. What is drawn is unchanged,
+ * as are the meshlet bounds.
+ */
+MeshOptimizationReport optimizeMesh(MeshData &mesh) {
+    MeshOptimizationReport report;
+    auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    uint32_t *indices = mesh.indices.data();
+    std::vector<MeshLod> lods = mesh.lods;
+    if (lods.empty()) {
+        lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+    }
+    report.before = analyzeVertexCache(indices + lods[0].firstIndex, lods[0].indexCount,
+                                       vertexCount);
+
+    std::vector<uint32_t> clusters;
+    for (const auto &lod : lods) {
+        clusters.clear();
+        optimizeVertexCache(indices + lod.firstIndex, lod.indexCount, vertexCount, &clusters);
+        uint32_t clusterCount = optimizeOverdraw(indices + lod.firstIndex, lod.indexCount,
+                                                 mesh.vertices, clusters);
+        if (&lod == &lods[0]) {
+            report.clusterCount = clusterCount;
+        }
+    }
+    for (const auto &meshlet : mesh.meshlets) {
+        optimizeVertexCache(indices + meshlet.firstIndex, meshlet.triangleCount * 3,
+                            vertexCount);
+    }
+    optimizeVertexFetch(mesh);
+
+    report.after = analyzeVertexCache(mesh.indices.data() + lods[0].firstIndex,
+                                      lods[0].indexCount,
+                                      static_cast<uint32_t>(mesh.vertices.size()));
+    return report;
+}
+
+/*
+ * Runs optimizeMesh over meshes on up to threadCount threads (by default one
+ * per core), each taking the next mesh left. Reports follow the order of
+ * meshes.
+ */
+std::vector<MeshOptimizationReport> optimizeMeshes(const std::vector<MeshData *> &meshes,
+                                                   uint32_t threadCount = 0) {
+    std::vector<MeshOptimizationReport> reports(meshes.size());
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threadCount = std::min<uint32_t>(threadCount, static_cast<uint32_t>(meshes.size()));
+
+    std::atomic<size_t> nextMesh{0};
+    auto work = [&]() {
+        for (size_t i = nextMesh++; i < meshes.size(); i = nextMesh++) {
+            reports[i] = optimizeMesh(*meshes[i]);
+        }
+    };
+    if (threadCount <= 1) {
+        work();
+        return reports;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back(work);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return reports;
+}
+
+void logMeshOptimizationReport(const char *name, const MeshOptimizationReport &report) {
+    LOG_INFO("Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u overdraw clusters", name,
+             report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr,
+             report.clusterCount);
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "vk_mesh_data.h"
+
+// Limits commonly recommended for mesh shaders, where a meshlet's vertices
+// and triangles are emitted by one workgroup.
+constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+/*
+ * Whether every triangle bounded by cone faces away from a camera at
+ * cameraPosition, for any point within (center, radius). The smallest
+ * dot(normal, point - camera) over the cone is |d| cos(theta + alpha), where
+ * theta is the angle between the cone axis and d = center - camera and alpha
+ * the cone's half angle; the sphere's radius is taken off that.
+ *
+ * This is the reference the culling shader (cull.comp) mirrors.
+ */
+inline bool isConeBackfacing(const glm::vec4 &cone, const glm::vec3 &center, float radius,
+                             const glm::vec3 &cameraPosition) {
+    if (cone.w <= 0.0f) {
+        return false;
+    }
+    glm::vec3 toCenter = center - cameraPosition;
+    float along = glm::dot(toCenter, glm::vec3(cone));
+    float across = std::sqrt(std::max(glm::dot(toCenter, toCenter) - along * along, 0.0f));
+    float sine = std::sqrt(std::max(1.0f - cone.w * cone.w, 0.0f));
+    return along * cone.w - across * sine > radius;
+}
+
+/*
+ * Moves a normal cone through model. Normals only keep their angles under
+ * rotation and uniform scale, so the cone is disabled otherwise.
+ */
+inline glm::vec4 transformCone(const glm::mat4 &model, const glm::vec4 &cone) {
+    glm::vec3 scaleSquared(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                           glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                           glm::dot(glm::vec3(model[2]), glm::vec3(model[2])));
+    float smallest = std::min(std::min(scaleSquared.x, scaleSquared.y), scaleSquared.z);
+    float largest = std::max(std::max(scaleSquared.x, scaleSquared.y), scaleSquared.z);
+    if (cone.w <= 0.0f || largest > smallest * 1.001f) {
+        return glm::vec4(0.0f);
+    }
+    glm::vec3 axis = glm::normalize(glm::mat3(model) * glm::vec3(cone));
+    return glm::vec4(axis, cone.w);
+}
+
+/*
+ * Bounding sphere and normal cone of a meshlet's triangles, which are
+ * outward facing when wound like the cube (clockwise on screen).
+ */
+inline void computeMeshletBounds(const MeshData &mesh, const uint32_t *indices,
+                                 uint32_t triangleCount, Meshlet &meshlet) {
+    Aabb bounds = Aabb::empty();
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        bounds.grow(mesh.vertices[indices[i]].position);
+    }
+    glm::vec3 center = bounds.getCenter();
+    float radiusSquared = 0.0f;
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        glm::vec3 offset = mesh.vertices[indices[i]].position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    meshlet.boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 normalSum(0.0f);
+    for (uint32_t i = 0; i < triangleCount * 3; i += 3) {
+        glm::vec3 a = mesh.vertices[indices[i]].position;
+        glm::vec3 b = mesh.vertices[indices[i + 1]].position;
+        glm::vec3 c = mesh.vertices[indices[i + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        // Degenerate triangles never rasterize and do not bound anything.
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            normalSum += normal / length;
+        }
+    }
+
+    meshlet.cone = glm::vec4(0.0f);
+    float sumLength = glm::length(normalSum);
+    if (normals.empty() || sumLength < 1e-6f) {
+        return;
+    }
+    glm::vec3 axis = normalSum / sumLength;
+    float cosine = 1.0f;
+    for (const auto &normal : normals) {
+        cosine = std::min(cosine, glm::dot(axis, normal));
+    }
+    // Cones of 90 degrees or more can never be entirely backfacing.
+    meshlet.cone = cosine > 0.0f ? glm::vec4(axis, cosine) : glm::vec4(0.0f);
+}
+
+/*
+ * Splits the finest level of detail of mesh into meshlets of at most
+ * MAX_MESHLET_VERTICES vertices and MAX_MESHLET_TRIANGLES triangles, and
+ * appends their triangles to mesh.indices, grouped by meshlet.
+ *
+ * Meshlets grow greedily from a seed triangle, always taking the adjacent
+ * triangle that adds the fewest new vertices. That keeps them compact, which
+ * tightens their bounds and normal cones and so makes culling them pay off.
+ * Meshlets built before are replaced.
+ */
+void buildMeshlets(MeshData &mesh) {
+    uint32_t baseFirst = mesh.lods.empty() ? 0 : mesh.lods[0].firstIndex;
+    uint32_t baseCount = mesh.lods.empty() ? static_cast<uint32_t>(mesh.indices.size())
+                                           : mesh.lods[0].indexCount;
+    if (mesh.lods.empty()) {
+        mesh.lods.push_back({0, baseCount, 0.0f});
+    }
+    uint32_t lodEnd = 0;
+    for (const auto &lod : mesh.lods) {
+        lodEnd = std::max(lodEnd, lod.firstIndex + lod.indexCount);
+    }
+    mesh.indices.resize(lodEnd);
+    std::vector<uint32_t> indices(mesh.indices.begin() + baseFirst,
+                                  mesh.indices.begin() + baseFirst + baseCount);
+    uint32_t triangleCount = baseCount / 3;
+    auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+
+    // Triangles around every vertex, in compressed rows.
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        adjacencyOffsets[indices[i] + 1]++;
+    }
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    mesh.meshlets.clear();
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    // Meshlet each vertex was last added to, to test membership in O(1).
+    std::vector<uint32_t> vertexMeshlets(vertexCount, UINT32_MAX);
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletIndices;
+
+    uint32_t seed = 0;
+    while (true) {
+        while (seed < triangleCount && emitted[seed]) {
+            seed++;
+        }
+        if (seed == triangleCount) {
+            break;
+        }
+
+        auto meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+        auto newVertices = [&](uint32_t triangle) {
+            uint32_t count = 0;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                count += vertexMeshlets[indices[triangle * 3 + corner]] != meshletIndex;
+            }
+            return count;
+        };
+
+        meshletVertices.clear();
+        meshletIndices.clear();
+        uint32_t triangle = seed;
+        while (triangle != UINT32_MAX) {
+            emitted[triangle] = 1;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                if (vertexMeshlets[vertex] != meshletIndex) {
+                    vertexMeshlets[vertex] = meshletIndex;
+                    meshletVertices.push_back(vertex);
+                }
+                meshletIndices.push_back(vertex);
+            }
+            if (meshletIndices.size() / 3 == MAX_MESHLET_TRIANGLES) {
+                break;
+            }
+
+            triangle = UINT32_MAX;
+            uint32_t fewestNew = 4;
+            for (uint32_t vertex : meshletVertices) {
+                for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1];
+                     i++) {
+                    uint32_t candidate = adjacency[i];
+                    if (emitted[candidate]) {
+                        continue;
+                    }
+                    uint32_t added = newVertices(candidate);
+                    if (added < fewestNew &&
+                        meshletVertices.size() + added <= MAX_MESHLET_VERTICES) {
+                        triangle = candidate;
+                        fewestNew = added;
+                    }
+                }
+                if (fewestNew == 0) {
+                    break;
+                }
+            }
+        }
+
+        Meshlet meshlet{};
+        meshlet.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+        meshlet.triangleCount = static_cast<uint32_t>(meshletIndices.size() / 3);
+        meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+        computeMeshletBounds(mesh, meshletIndices.data(), meshlet.triangleCount, meshlet);
+        mesh.meshlets.push_back(meshlet);
+        mesh.indices.insert(mesh.indices.end(), meshletIndices.begin(), meshletIndices.end());
+    }
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "vk_device.h"
+
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+/*
+ * PipelineCache keeps a VkPipelineCache alive for the lifetime of the device
+ * and persists it across runs, so warm starts skip the driver's shader
+ * compilation.
+ *
+ * The file is the driver's cache blob behind a small header of our own that
+ * records its size, a checksum and the driver version. On load, both that
+ * header and the Vulkan cache header (vendorID, deviceID, pipelineCacheUUID)
+ * must match the running device; anything else, including truncated or
+ * corrupted files, is discarded and the cache starts out empty.
+ *
+ * Saves write a temporary file, fsync it and rename it over the old one, so
+ * the file on disk is always either the previous or the new complete cache.
+ */
+class PipelineCache {
+public:
+    PipelineCache(Device& device, std::string path);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    VkPipelineCache getCache() const { return cache; }
+
+    // True when a valid cache was loaded from disk at startup.
+    bool isWarm() const { return warm; }
+
+    void save();
+
+private:
+    static constexpr uint32_t FILE_MAGIC = 0x43505659; // "YVPC"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t driverVersion;
+        uint32_t checksum;
+        uint64_t dataSize;
+    };
+
+    Device& device;
+    std::string path;
+    VkPhysicalDeviceProperties properties;
+
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    bool warm = false;
+    // Of the blob last loaded or saved, so that unchanged caches are not
+    // written again.
+    size_t savedSize = 0;
+    uint32_t savedChecksum = 0;
+
+    std::vector<uint8_t> load();
+    bool isCompatible(const std::vector<uint8_t> &data);
+
+    static uint32_t checksum(const uint8_t *data, size_t size);
+};
+
+PipelineCache::PipelineCache(Device &device, std::string path)
+        : device(device), path(std::move(path)) {
+    vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
+
+    std::vector<uint8_t> data = load();
+    warm = !data.empty();
+    savedSize = data.size();
+    savedChecksum = checksum(data.data(), data.size());
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    VK_CHECK(vkCreatePipelineCache(device.getDevice(), &createInfo, nullptr, &cache));
+
+    LOG_INFO("Pipeline cache: %s (%zu bytes)", warm ? "loaded" : "empty", data.size());
+}
+
+/*
+ * Returns the validated cache blob, or an empty vector if there is no usable
+ * cache on disk.
+ */
+std::vector<uint8_t> PipelineCache::load() {
+    if (path.empty()) {
+        return {};
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+
+    FileHeader header{};
+    std::vector<uint8_t> data;
+    bool valid = read(fd, &header, sizeof(header)) == sizeof(header) &&
+                 header.magic == FILE_MAGIC && header.version == FILE_VERSION &&
+                 header.driverVersion == properties.driverVersion &&
+                 header.dataSize > 0 && header.dataSize <= 64 * 1024 * 1024;
+    if (valid) {
+        data.resize(header.dataSize);
+        valid = read(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) &&
+                checksum(data.data(), data.size()) == header.checksum &&
+                isCompatible(data);
+    }
+    close(fd);
+
+    if (!valid) {
+        LOG_ERR("Discarding stale or corrupted pipeline cache %s", path.c_str());
+        return {};
+    }
+    return data;
+}
+
+/*
+ * Checks the VkPipelineCacheHeaderVersionOne at the start of the blob against
+ * the running device. Drivers are required to reject mismatching caches too,
+ * but not all of them do so gracefully.
+ */
+bool PipelineCache::isCompatible(const std::vector<uint8_t> &data) {
+    const size_t headerSize = 16 + VK_UUID_SIZE;
+    if (data.size() < headerSize) {
+        return false;
+    }
+
+    uint32_t fields[4];
+    memcpy(fields, data.data(), sizeof(fields));
+    return fields[0] >= headerSize &&
+           fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           fields[2] == properties.vendorID &&
+           fields[3] == properties.deviceID &&
+           memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/*
+ * Writes the cache to disk if its contents changed since it was loaded or
+ * last saved. Drivers may replace entries without changing the blob's size,
+ * so the blob is compared by size and checksum. Meant for shutdown and for
+ * points where the app is idle anyway, since retrieving the blob can take a
+ * while on some drivers.
+ */
+void PipelineCache::save() {
+    if (path.empty()) {
+        return;
+    }
+
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device.getDevice(), cache, &size, nullptr));
+    if (size == 0) {
+        return;
+    }
+
+    std::vector<uint8_t> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device.getDevice(), cache, &size, data.data()));
+    data.resize(size);
+    uint32_t dataChecksum = checksum(data.data(), data.size());
+    if (data.size() == savedSize && dataChecksum == savedChecksum) {
+        return;
+    }
+
+    FileHeader header{FILE_MAGIC, FILE_VERSION, properties.driverVersion, dataChecksum,
+                      data.size()};
+
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG_ERR("Could not open %s for writing", tmpPath.c_str());
+        return;
+    }
+    bool written = write(fd, &header, sizeof(header)) == sizeof(header) &&
+                   write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) &&
+                   fsync(fd) == 0;
+    close(fd);
+
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG_ERR("Failed to save pipeline cache to %s", path.c_str());
+        unlink(tmpPath.c_str());
+        return;
+    }
+
+    savedSize = data.size();
+    savedChecksum = dataChecksum;
+    LOG_INFO("Pipeline cache saved (%zu bytes)", data.size());
+}
+
+/*
+ * FNV-1a; only meant to catch truncated or scribbled files.
+ */
+uint32_t PipelineCache::checksum(const uint8_t *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+PipelineCache::~PipelineCache() {
+    vkDestroyPipelineCache(device.getDevice(), cache, nullptr);
+}
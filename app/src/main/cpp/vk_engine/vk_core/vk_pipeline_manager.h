@@ -0,0 +1,240 @@
+#pragma once
+
+#include "vk_device.h"
+#include "vk_filesystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+ * Wraps SPIR-V, typically a FileView's span, in a shader module.
+ */
+VkShaderModule createShaderModule(Device &device, ByteSpan code) {
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size;
+
+    // SPIR-V must be read as 32-bit words. Mapped APK assets are 4-byte
+    // aligned by zipalign, so only the rare misaligned span gets copied.
+    std::vector<uint32_t> alignedCode;
+    if (reinterpret_cast<uintptr_t>(code.data) % alignof(uint32_t) != 0) {
+        alignedCode.resize((code.size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+        memcpy(alignedCode.data(), code.data, code.size);
+        createInfo.pCode = alignedCode.data();
+    } else {
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data);
+    }
+    VkShaderModule shaderModule;
+    VK_CHECK(vkCreateShaderModule(device.getDevice(), &createInfo, nullptr, &shaderModule));
+
+    return shaderModule;
+}
+
+/*
+ * Future-like reference to a pipeline compiled by the PipelineManager.
+ *
+ * get() never blocks: it returns the compiled pipeline once it has been
+ * published, otherwise the fallback's pipeline (if one was registered and is
+ * ready itself), otherwise VK_NULL_HANDLE, in which case the caller is
+ * expected to skip the draws that need it.
+ */
+class PipelineHandle {
+public:
+    PipelineHandle() = default;
+
+    bool isValid() const { return entry != nullptr; }
+    bool isReady() const;
+    bool hasFailed() const;
+    VkPipeline get() const;
+
+private:
+    friend class PipelineManager;
+
+    struct Entry;
+    std::shared_ptr<Entry> entry;
+};
+
+struct PipelineHandle::Entry {
+    std::string name;
+    std::function<VkPipeline()> build;
+    std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+    std::atomic<bool> failed{false};
+    PipelineHandle fallback;
+};
+
+inline bool PipelineHandle::isReady() const {
+    return entry != nullptr && entry->pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+}
+
+inline bool PipelineHandle::hasFailed() const {
+    return entry != nullptr && entry->failed.load(std::memory_order_acquire);
+}
+
+inline VkPipeline PipelineHandle::get() const {
+    if (entry == nullptr) {
+        return VK_NULL_HANDLE;
+    }
+    VkPipeline pipeline = entry->pipeline.load(std::memory_order_acquire);
+    if (pipeline == VK_NULL_HANDLE) {
+        return entry->fallback.get();
+    }
+    return pipeline;
+}
+
+/*
+ * PipelineManager compiles pipelines on background threads so that neither
+ * the first frame nor a newly introduced material waits for the driver's
+ * shader compiler.
+ *
+ * compile() only queues the work and hands back a PipelineHandle. A worker
+ * runs the build function and publishes the result with a single atomic
+ * store, so the render thread reads pipelines without taking a lock. Every
+ * publication bumps getPublishedCount(), which lets the renderer notice that
+ * command buffers recorded without the pipeline are out of date.
+ *
+ * The manager owns every pipeline it built and destroys them with itself.
+ */
+class PipelineManager {
+public:
+    using BuildFunction = std::function<VkPipeline()>;
+
+    PipelineManager(Device& device, uint32_t workerCount = 0);
+    ~PipelineManager();
+
+    PipelineManager(const PipelineManager&) = delete;
+    PipelineManager& operator=(const PipelineManager&) = delete;
+
+    PipelineHandle compile(const std::string &name, BuildFunction build,
+                           const PipelineHandle &fallback = PipelineHandle());
+    void wait(const PipelineHandle &handle);
+    void waitIdle();
+
+    uint64_t getPublishedCount() const { return publishedCount.load(std::memory_order_acquire); }
+
+private:
+    Device& device;
+
+    std::vector<std::thread> workers;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable doneCondition;
+    std::deque<std::shared_ptr<PipelineHandle::Entry>> queue;
+    std::vector<std::shared_ptr<PipelineHandle::Entry>> entries;
+    uint32_t pendingCount = 0;
+    bool stopping = false;
+
+    std::atomic<uint64_t> publishedCount{0};
+
+    void workerLoop();
+};
+
+PipelineManager::PipelineManager(Device &device, uint32_t workerCount) : device(device) {
+    if (workerCount == 0) {
+        // Driver compilers are heavy; a couple of threads is plenty without
+        // starving the render thread and the command recorder.
+        workerCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+    }
+    workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&PipelineManager::workerLoop, this);
+    }
+}
+
+/*
+ * Queues a pipeline for compilation. The build function runs on a worker
+ * thread, so everything it references must stay alive until the pipeline is
+ * ready or the manager is destroyed.
+ */
+PipelineHandle PipelineManager::compile(const std::string &name, BuildFunction build,
+                                        const PipelineHandle &fallback) {
+    PipelineHandle handle;
+    handle.entry = std::make_shared<PipelineHandle::Entry>();
+    handle.entry->name = name;
+    handle.entry->build = std::move(build);
+    handle.entry->fallback = fallback;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        entries.push_back(handle.entry);
+        queue.push_back(handle.entry);
+        pendingCount++;
+    }
+    queueCondition.notify_one();
+    return handle;
+}
+
+/*
+ * Blocks until the handle's pipeline has either been published or failed.
+ */
+void PipelineManager::wait(const PipelineHandle &handle) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    doneCondition.wait(lock, [&handle] { return handle.isReady() || handle.hasFailed(); });
+}
+
+void PipelineManager::waitIdle() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    doneCondition.wait(lock, [this] { return pendingCount == 0; });
+}
+
+void PipelineManager::workerLoop() {
+    while (true) {
+        std::shared_ptr<PipelineHandle::Entry> entry;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            entry = queue.front();
+            queue.pop_front();
+        }
+
+        auto compileStart = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = entry->build();
+        } catch (const std::exception &e) {
+            LOG_ERR("Pipeline %s failed to compile: %s", entry->name.c_str(), e.what());
+        }
+        float compileMs = std::chrono::duration<float, std::milli>(
+                std::chrono::steady_clock::now() - compileStart).count();
+
+        if (pipeline != VK_NULL_HANDLE) {
+            entry->pipeline.store(pipeline, std::memory_order_release);
+            publishedCount.fetch_add(1, std::memory_order_release);
+            LOG_INFO("Pipeline %s ready after %.2f ms", entry->name.c_str(), compileMs);
+        } else {
+            entry->failed.store(true, std::memory_order_release);
+        }
+        entry->build = nullptr;
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pendingCount--;
+        doneCondition.notify_all();
+    }
+}
+
+PipelineManager::~PipelineManager() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        queue.clear();
+    }
+    queueCondition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (auto &entry : entries) {
+        VkPipeline pipeline = entry->pipeline.exchange(VK_NULL_HANDLE);
+        if (pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device.getDevice(), pipeline, nullptr);
+        }
+    }
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "vk_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+/*
+ * How frames are handed to the display. Each profile picks a present mode
+ * and an image count out of what the surface supports, falling back to FIFO,
+ * which every surface has:
+ *
+ * 	- LowLatency: MAILBOX, so the newest frame always replaces the queued
+ * 	  one, or else FIFO with as few images as the surface allows, at most 2.
+ * 	- Throughput: FIFO with 3 images, so the GPU never waits on the display.
+ * 	- Uncapped: IMMEDIATE, tearing, for benchmarking; MAILBOX or FIFO
+ * 	  without it.
+ * 	- PowerSave: frames capped at POWER_SAVE_FRAME_RATE, with FIFO_RELAXED
+ * 	  where supported so a frame that misses its refresh is shown at once
+ * 	  rather than a whole refresh later.
+ */
+enum class PresentProfile {
+    LowLatency,
+    Throughput,
+    Uncapped,
+    PowerSave
+};
+
+constexpr float POWER_SAVE_FRAME_RATE = 30.0f;
+
+struct PresentConfig {
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t imageCount = 0;
+    // Frames per second the CPU paces itself to, or 0 to leave pacing to
+    // the present mode. With frame pacing, the smallest swap interval that
+    // stays under it.
+    float maxFrameRate = 0.0f;
+};
+
+inline const char *getPresentProfileName(PresentProfile profile) {
+    switch (profile) {
+        case PresentProfile::LowLatency:
+            return "low latency";
+        case PresentProfile::Throughput:
+            return "throughput";
+        case PresentProfile::Uncapped:
+            return "uncapped";
+        case PresentProfile::PowerSave:
+            return "power save";
+    }
+    return "unknown";
+}
+
+inline const char *getPresentModeName(VkPresentModeKHR presentMode) {
+    switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "FIFO_RELAXED";
+        default:
+            return "other";
+    }
+}
+
+/*
+ * Resolves profile against the surface's capabilities and present modes.
+ */
+inline PresentConfig choosePresentConfig(PresentProfile profile,
+                                         const VkSurfaceCapabilitiesKHR &capabilities,
+                                         const std::vector<VkPresentModeKHR> &presentModes) {
+    auto supports = [&](VkPresentModeKHR mode) {
+        return std::find(presentModes.begin(), presentModes.end(), mode) != presentModes.end();
+    };
+
+    PresentConfig config;
+    uint32_t imageCount = capabilities.minImageCount + 1;
+    switch (profile) {
+        case PresentProfile::LowLatency:
+            if (supports(VK_PRESENT_MODE_MAILBOX_KHR)) {
+                config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else {
+                imageCount = 2;
+            }
+            break;
+        case PresentProfile::Throughput:
+            imageCount = 3;
+            break;
+        case PresentProfile::Uncapped:
+            if (supports(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+                config.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else if (supports(VK_PRESENT_MODE_MAILBOX_KHR)) {
+                config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            break;
+        case PresentProfile::PowerSave:
+            if (supports(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+                config.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            config.maxFrameRate = POWER_SAVE_FRAME_RATE;
+            break;
+    }
+
+    imageCount = std::max(imageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+    }
+    config.imageCount = imageCount;
+    return config;
+}
+
+struct PresentStats {
+    PresentProfile profile = PresentProfile::Throughput;
+    PresentConfig config;
+    uint64_t frameCount = 0;
+    // Between the starts of consecutive frames.
+    float averageFrameMs = 0.0f;
+    float maxFrameMs = 0.0f;
+    // GPU completion latency: from the start of a frame until its GPU work
+    // has completed, as seen by the next frame polling for it. The image
+    // still waits for its turn on the display after that.
+    float averageGpuLatencyMs = 0.0f;
+    // Present latency: from the start of a frame until the display showed
+    // it, from VK_GOOGLE_display_timing. 0 without display timing.
+    float averagePresentLatencyMs = 0.0f;
+};
+
+/*
+ * Measures frame time and latency for the active present profile. Reset on
+ * every profile change so that profiles can be compared. Present latency is
+ * only measured for frames passed to onPresent, which VKCore does when the
+ * swapchain reports display timing.
+ */
+class PresentStatsTracker {
+public:
+    void reset(PresentProfile profile, const PresentConfig &config);
+    void beginFrame(uint64_t frameValue, std::chrono::steady_clock::time_point start);
+    void update(uint64_t completedValue, std::chrono::steady_clock::time_point now);
+    void onPresent(uint32_t presentId, std::chrono::steady_clock::time_point start);
+    void onPresentTiming(uint32_t presentId, std::chrono::steady_clock::time_point shown);
+
+    const PresentStats& getStats() const { return stats; }
+    void logStats() const;
+
+private:
+    struct PendingFrame {
+        uint64_t frameValue;
+        std::chrono::steady_clock::time_point start;
+    };
+    struct PendingPresent {
+        uint32_t presentId;
+        std::chrono::steady_clock::time_point start;
+    };
+    // Presents the display may not report, e.g. once the swapchain they went
+    // to is gone, are dropped beyond this.
+    static constexpr size_t MAX_PENDING_PRESENTS = 64;
+
+    PresentStats stats;
+    std::chrono::steady_clock::time_point lastStart;
+    double frameMsTotal = 0.0;
+    double gpuLatencyMsTotal = 0.0;
+    uint64_t gpuLatencyCount = 0;
+    double presentLatencyMsTotal = 0.0;
+    uint64_t presentLatencyCount = 0;
+    std::deque<PendingFrame> pendingFrames;
+    std::deque<PendingPresent> pendingPresents;
+};
+
+void PresentStatsTracker::reset(PresentProfile profile, const PresentConfig &config) {
+    stats = PresentStats{};
+    stats.profile = profile;
+    stats.config = config;
+    frameMsTotal = 0.0;
+    gpuLatencyMsTotal = 0.0;
+    gpuLatencyCount = 0;
+    presentLatencyMsTotal = 0.0;
+    presentLatencyCount = 0;
+    pendingFrames.clear();
+    pendingPresents.clear();
+}
+
+void PresentStatsTracker::beginFrame(uint64_t frameValue,
+                                     std::chrono::steady_clock::time_point start) {
+    if (stats.frameCount > 0) {
+        float frameMs = std::chrono::duration<float, std::milli>(start - lastStart).count();
+        frameMsTotal += frameMs;
+        stats.maxFrameMs = std::max(stats.maxFrameMs, frameMs);
+        stats.averageFrameMs = static_cast<float>(frameMsTotal / stats.frameCount);
+    }
+    stats.frameCount++;
+    lastStart = start;
+    pendingFrames.push_back({frameValue, start});
+}
+
+/*
+ * Called once per frame with the value of the newest frame the GPU has
+ * completed, as FrameScheduler counts them.
+ */
+void PresentStatsTracker::update(uint64_t completedValue,
+                                 std::chrono::steady_clock::time_point now) {
+    while (!pendingFrames.empty() && pendingFrames.front().frameValue <= completedValue) {
+        gpuLatencyMsTotal += std::chrono::duration<double, std::milli>(
+                now - pendingFrames.front().start).count();
+        gpuLatencyCount++;
+        pendingFrames.pop_front();
+    }
+    if (gpuLatencyCount > 0) {
+        stats.averageGpuLatencyMs = static_cast<float>(gpuLatencyMsTotal / gpuLatencyCount);
+    }
+}
+
+/*
+ * Records that the frame started at start was presented with presentId, the
+ * VkPresentTimeGOOGLE::presentID its timing will be reported under.
+ */
+void PresentStatsTracker::onPresent(uint32_t presentId,
+                                    std::chrono::steady_clock::time_point start) {
+    if (pendingPresents.size() == MAX_PENDING_PRESENTS) {
+        pendingPresents.pop_front();
+    }
+    pendingPresents.push_back({presentId, start});
+}
+
+/*
+ * A VkPastPresentationTimingGOOGLE entry, with actualPresentTime converted to
+ * shown. Timings arrive in present order; earlier presents that were never
+ * reported are dropped.
+ */
+void PresentStatsTracker::onPresentTiming(uint32_t presentId,
+                                          std::chrono::steady_clock::time_point shown) {
+    while (!pendingPresents.empty() && pendingPresents.front().presentId < presentId) {
+        pendingPresents.pop_front();
+    }
+    if (pendingPresents.empty() || pendingPresents.front().presentId != presentId) {
+        return;
+    }
+    presentLatencyMsTotal += std::chrono::duration<double, std::milli>(
+            shown - pendingPresents.front().start).count();
+    presentLatencyCount++;
+    pendingPresents.pop_front();
+    stats.averagePresentLatencyMs =
+            static_cast<float>(presentLatencyMsTotal / presentLatencyCount);
+}
+
+void PresentStatsTracker::logStats() const {
+    if (stats.frameCount == 0) {
+        return;
+    }
+    char presentLatency[64] = "";
+    if (presentLatencyCount > 0) {
+        snprintf(presentLatency, sizeof(presentLatency), ", %.2f ms average present latency",
+                 stats.averagePresentLatencyMs);
+    }
+    LOG_INFO("Present profile %s (%s, %u images%s): %llu frames, %.2f ms average frame, "
+             "%.2f ms worst, %.2f ms average GPU completion latency%s",
+             getPresentProfileName(stats.profile), getPresentModeName(stats.config.presentMode),
+             stats.config.imageCount, stats.config.maxFrameRate > 0.0f ? ", capped" : "",
+             static_cast<unsigned long long>(stats.frameCount), stats.averageFrameMs,
+             stats.maxFrameMs, stats.averageGpuLatencyMs, presentLatency);
+}
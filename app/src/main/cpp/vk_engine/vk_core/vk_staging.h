@@ -0,0 +1,102 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+/*
+ * StagingUploader copies host data into device-local buffers through a
+ * host-visible staging buffer. Uploads are synchronous: upload() returns once
+ * the copy has executed on the graphics queue, which keeps it suitable for
+ * load time rather than for streaming.
+ */
+class StagingUploader {
+public:
+    StagingUploader(Device& device, MemoryAllocator& allocator);
+    ~StagingUploader();
+
+    StagingUploader(const StagingUploader&) = delete;
+    StagingUploader& operator=(const StagingUploader&) = delete;
+
+    void upload(VkBuffer dstBuffer, const void *data, VkDeviceSize size,
+                VkDeviceSize dstOffset = 0);
+
+private:
+    Device& device;
+    MemoryAllocator& allocator;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+};
+
+StagingUploader::StagingUploader(Device &device, MemoryAllocator &allocator)
+        : device(device), allocator(allocator) {
+    QueueFamilyIndices queueFamilyIndices = device.findQueueFamilies(device.getPhysicalDevice());
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    VK_CHECK(vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPool));
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &commandBuffer));
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK(vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &fence));
+}
+
+/*
+ * The staging buffer comes from a linear pool: it only lives for the
+ * duration of the call.
+ */
+void StagingUploader::upload(VkBuffer dstBuffer, const void *data, VkDeviceSize size,
+                             VkDeviceSize dstOffset) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer stagingBuffer;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &stagingBuffer));
+    MemoryAllocation staging = allocator.allocateBuffer(
+            stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, AllocationStrategy::Linear);
+    memcpy(staging.mapped, data, size);
+
+    VK_CHECK(vkResetCommandPool(device.getDevice(), commandPool, 0));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK(vkQueueSubmit(device.getGraphicsQueue(), 1, &submitInfo, fence));
+    VK_CHECK(vkWaitForFences(device.getDevice(), 1, &fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(device.getDevice(), 1, &fence));
+
+    vkDestroyBuffer(device.getDevice(), stagingBuffer, nullptr);
+    allocator.free(staging);
+}
+
+StagingUploader::~StagingUploader() {
+    vkDestroyFence(device.getDevice(), fence, nullptr);
+    vkDestroyCommandPool(device.getDevice(), commandPool, nullptr);
+}
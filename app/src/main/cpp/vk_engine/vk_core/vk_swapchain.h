@@ -1,8 +1,73 @@
-#include "vk_device.h"
+#pragma once
+
+#include "vk_allocator.h"
+#include "vk_present_profile.h"
+
+struct RenderTargetStats {
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // Memory backing the transient depth and multisampled color images, and
+    // how much of it the driver committed if it is lazily allocated.
+    VkDeviceSize transientBytes = 0;
+    VkDeviceSize committedBytes = 0;
+    bool lazilyAllocated = false;
+    // Per frame, the bytes the render pass writes back to memory (the
+    // single-sampled swapchain image) and those it drops in tile memory
+    // instead of storing them.
+    VkDeviceSize storedBytesPerFrame = 0;
+    VkDeviceSize discardedBytesPerFrame = 0;
+};
+
+/*
+ * Clip-space rotation that pre-rotates a frame drawn upright for the user
+ * into the swapchain's identity orientation, so the compositor can scan it
+ * out as is. Applied after the projection.
+ */
+inline glm::mat4 getPreRotation(VkSurfaceTransformFlagBitsKHR transform) {
+    // Exact quarter turns about z; glm::rotate would leave rounding errors.
+    glm::mat4 rotation(1.0f);
+    switch (transform) {
+        case VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR:
+            rotation[0] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+            rotation[1] = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);
+            break;
+        case VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR:
+            rotation[0] = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);
+            rotation[1] = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+            break;
+        case VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR:
+            rotation[0] = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+            rotation[1] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+            break;
+        default:
+            break;
+    }
+    return rotation;
+}
 
+/*
+ * The swapchain and the attachments rendered alongside it. Depth and, with
+ * more than one sample, the multisampled color image only live for the
+ * duration of the render pass: they are transient attachments backed by
+ * lazily allocated memory where the device has it, so tile-based GPUs keep
+ * them in tile memory and never give them physical pages. The multisampled
+ * color is resolved into the swapchain image at the end of the subpass.
+ *
+ * A swapchain being replaced is passed to its successor as oldSwapChain,
+ * which retires it without waiting for the frames still rendering to it;
+ * its owner destroys it once those and its presents are done.
+ *
+ * Images are always in the display's identity orientation, with the
+ * surface's current transform as preTransform: rendering pre-rotates
+ * with getPreRotation(getPreTransform()), and the frames the user sees
+ * are getDisplayExtent() sized. A rotation thus keeps the extent, and
+ * the successor adopts the transient attachments as they are.
+ */
 class SwapChain {
 public:
-    SwapChain(Device& device);
+    SwapChain(Device& device, MemoryAllocator& allocator,
+              VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+              PresentProfile presentProfile = PresentProfile::Throughput,
+              SwapChain *oldSwapChain = nullptr);
     ~SwapChain();
 
     SwapChain(const SwapChain&) = delete;
@@ -13,10 +78,32 @@ public:
     std::vector<VkImageView> getSwapChainImageViews() const { return swapChainImageViews; }
     VkFormat getSwapChainImageFormat() const { return swapChainImageFormat; }
     VkExtent2D getSwapChainExtent() const { return swapChainExtent; }
+    VkSurfaceTransformFlagBitsKHR getPreTransform() const { return pretransformFlag; }
+    VkExtent2D getDisplayExtent() const;
+    bool isTransformCurrent() const;
     VkImageView getDepthImageView() const { return depthImageView; }
+    // VK_NULL_HANDLE without multisampling.
+    VkImageView getColorImageView() const { return colorImageView; }
+    VkSampleCountFlagBits getSampleCount() const { return samples; }
+    // As resolved for the surface; imageCount is what was asked for, the
+    // driver may create more.
+    const PresentConfig& getPresentConfig() const { return presentConfig; }
+
+    VkFence getPresentFence();
+    bool pollPresentFences();
+
+    // Without VK_GOOGLE_display_timing, getRefreshDuration returns 0 and
+    // there are no past presentation timings.
+    bool hasDisplayTiming() const { return getPastPresentationTiming != nullptr; }
+    uint64_t getRefreshDuration() const;
+    std::vector<VkPastPresentationTimingGOOGLE> getPastPresentationTimings() const;
+
+    RenderTargetStats getRenderTargetStats() const;
+    void logRenderTargetStats() const;
 
 private:
     Device& device;
+    MemoryAllocator& allocator;
 
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
@@ -24,27 +111,53 @@ private:
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     VkSurfaceTransformFlagBitsKHR pretransformFlag;
+    VkSampleCountFlagBits samples;
+    PresentConfig presentConfig;
+
+    VkFormat depthFormat;
+    VkImage depthImage = VK_NULL_HANDLE;
+    MemoryAllocation depthImageMemory;
+    VkImageView depthImageView = VK_NULL_HANDLE;
 
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+    VkImage colorImage = VK_NULL_HANDLE;
+    MemoryAllocation colorImageMemory;
+    VkImageView colorImageView = VK_NULL_HANDLE;
+
+    // Present fences of the presents still holding the swapchain, and the
+    // signaled ones kept for reuse.
+    std::vector<VkFence> pendingPresentFences;
+    std::vector<VkFence> freePresentFences;
+
+    PFN_vkGetRefreshCycleDurationGOOGLE getRefreshCycleDuration = nullptr;
+    PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming = nullptr;
 
     void createImageViews();
-    void createSwapChain();
+    void createSwapChain(PresentProfile presentProfile, VkSwapchainKHR oldSwapChain);
 
     VkExtent2D getDisplaySizeIdentity();
 
-    void createDepthResources();
-    void destroyDepthResources();
-    void createImage(VkFormat format, VkImage &image, VkDeviceMemory &imageMemory);
+    void createTransientResources(SwapChain *oldSwapChain);
+    void destroyTransientResources();
+    void createTransientImage(VkFormat format, VkImageUsageFlags usage, VkImage &image,
+                              MemoryAllocation &imageMemory);
 
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 };
 
-SwapChain::SwapChain(Device &device)  : device(device) {
-    createSwapChain();
+SwapChain::SwapChain(Device &device, MemoryAllocator &allocator, VkSampleCountFlagBits samples,
+                     PresentProfile presentProfile, SwapChain *oldSwapChain)
+        : device(device), allocator(allocator), samples(samples) {
+    createSwapChain(presentProfile,
+                    oldSwapChain != nullptr ? oldSwapChain->swapChain : VK_NULL_HANDLE);
     createImageViews();
-    createDepthResources();
+    createTransientResources(oldSwapChain);
+
+    if (device.supportsDisplayTiming()) {
+        getRefreshCycleDuration = (PFN_vkGetRefreshCycleDurationGOOGLE) vkGetDeviceProcAddr(
+                device.getDevice(), "vkGetRefreshCycleDurationGOOGLE");
+        getPastPresentationTiming = (PFN_vkGetPastPresentationTimingGOOGLE) vkGetDeviceProcAddr(
+                device.getDevice(), "vkGetPastPresentationTimingGOOGLE");
+    }
 }
 
 void SwapChain::createImageViews() {
@@ -69,7 +182,7 @@ void SwapChain::createImageViews() {
     }
 }
 
-void SwapChain::createSwapChain() {
+void SwapChain::createSwapChain(PresentProfile presentProfile, VkSwapchainKHR oldSwapChain) {
     SwapChainSupportDetails swapChainSupport =
             device.querySwapChainSupport(device.getPhysicalDevice());
 
@@ -90,16 +203,10 @@ void SwapChain::createSwapChain() {
     // Please check
     // https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkPresentModeKHR.html
     // for a discourse on different present modes.
-    //
-    // VK_PRESENT_MODE_FIFO_KHR = Hard Vsync
-    // This is always supported on Android phones
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > swapChainSupport.capabilities.maxImageCount) {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    presentConfig = choosePresentConfig(presentProfile, swapChainSupport.capabilities,
+                                        swapChainSupport.presentModes);
+    VkPresentModeKHR presentMode = presentConfig.presentMode;
+    uint32_t imageCount = presentConfig.imageCount;
 
     pretransformFlag = swapChainSupport.capabilities.currentTransform;
     auto displaySizeIdentity = getDisplaySizeIdentity();
@@ -131,7 +238,9 @@ void SwapChain::createSwapChain() {
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // Lets the presentation engine reuse the old swapchain's resources. It
+    // keeps showing its queued images, but no new image can be acquired from it.
+    createInfo.oldSwapchain = oldSwapChain;
 
     VK_CHECK(vkCreateSwapchainKHR(device.getDevice(), &createInfo, nullptr, &swapChain));
 
@@ -144,6 +253,31 @@ void SwapChain::createSwapChain() {
     swapChainExtent = displaySizeIdentity;
 }
 
+/*
+ * The extent as the user sees it, which the projection's aspect ratio and
+ * any screen-space metric are based on. Viewport and scissor stay in the
+ * identity orientation of getSwapChainExtent().
+ */
+VkExtent2D SwapChain::getDisplayExtent() const {
+    if (pretransformFlag & (VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR |
+                            VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR)) {
+        return {swapChainExtent.height, swapChainExtent.width};
+    }
+    return swapChainExtent;
+}
+
+/*
+ * Whether the surface is still in the orientation the swapchain pre-rotates
+ * for. Presents to a swapchain that is not are suboptimal: the compositor
+ * has to rotate them.
+ */
+bool SwapChain::isTransformCurrent() const {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device.getPhysicalDevice(), device.getSurface(),
+                                              &capabilities);
+    return capabilities.currentTransform == pretransformFlag;
+}
+
 VkExtent2D SwapChain::getDisplaySizeIdentity() {
     VkSurfaceCapabilitiesKHR capabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device.getPhysicalDevice(), device.getSurface(),
@@ -161,14 +295,45 @@ VkExtent2D SwapChain::getDisplaySizeIdentity() {
     return capabilities.currentExtent;
 }
 
-void SwapChain::createDepthResources() {
-    VkFormat depthFormat = device.findDepthFormat();
+/*
+ * Takes the transient attachments over from oldSwapChain when they still
+ * fit, as after a rotation. The frames still rendering to oldSwapChain are
+ * ordered before ours by the render pass' dependency.
+ */
+void SwapChain::createTransientResources(SwapChain *oldSwapChain) {
+    depthFormat = device.findDepthFormat();
+    if (oldSwapChain != nullptr && oldSwapChain->swapChainExtent.width == swapChainExtent.width &&
+        oldSwapChain->swapChainExtent.height == swapChainExtent.height &&
+        oldSwapChain->samples == samples &&
+        oldSwapChain->swapChainImageFormat == swapChainImageFormat) {
+        std::swap(depthImage, oldSwapChain->depthImage);
+        std::swap(depthImageMemory, oldSwapChain->depthImageMemory);
+        std::swap(depthImageView, oldSwapChain->depthImageView);
+        std::swap(colorImage, oldSwapChain->colorImage);
+        std::swap(colorImageMemory, oldSwapChain->colorImageMemory);
+        std::swap(colorImageView, oldSwapChain->colorImageView);
+        return;
+    }
 
-    createImage(depthFormat, depthImage, depthImageMemory);
+    createTransientImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImage,
+                         depthImageMemory);
     depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        createTransientImage(swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                             colorImage, colorImageMemory);
+        colorImageView = createImageView(colorImage, swapChainImageFormat,
+                                         VK_IMAGE_ASPECT_COLOR_BIT);
+    }
 }
 
-void SwapChain::createImage(VkFormat format, VkImage& image, VkDeviceMemory& imageMemory) {
+/*
+ * The render pass neither loads nor stores these images, so they are only
+ * ever attachments: without lazily allocated memory they fall back to plain
+ * device-local memory.
+ */
+void SwapChain::createTransientImage(VkFormat format, VkImageUsageFlags usage, VkImage &image,
+                                     MemoryAllocation &imageMemory) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -180,22 +345,15 @@ void SwapChain::createImage(VkFormat format, VkImage& image, VkDeviceMemory& ima
     imageInfo.format = format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.samples = samples;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VK_CHECK(vkCreateImage(device.getDevice(), &imageInfo, nullptr, &image));
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device.getDevice(), image, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = device.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    VK_CHECK(vkAllocateMemory(device.getDevice(), &allocInfo, nullptr, &imageMemory));
-    vkBindImageMemory(device.getDevice(), image, imageMemory, 0);
+    imageMemory = allocator.allocateImage(image, imageInfo.tiling,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                          VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
 }
 
 VkImageView SwapChain::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
@@ -215,14 +373,169 @@ VkImageView SwapChain::createImageView(VkImage image, VkFormat format, VkImageAs
     return imageView;
 }
 
-void SwapChain::destroyDepthResources() {
-    vkDestroyImageView(device.getDevice(), depthImageView, nullptr);
-    vkDestroyImage(device.getDevice(), depthImage, nullptr);
-    vkFreeMemory(device.getDevice(), depthImageMemory, nullptr);
+/*
+ * Estimated bytes per pixel per sample of the attachment formats the engine
+ * picks, as they are laid out in memory.
+ */
+static VkDeviceSize getTexelSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+            return 2;
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return 5;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+RenderTargetStats SwapChain::getRenderTargetStats() const {
+    RenderTargetStats stats;
+    stats.samples = samples;
+    for (const MemoryAllocation *memory : {&depthImageMemory, &colorImageMemory}) {
+        if (memory->memory == VK_NULL_HANDLE) {
+            continue;
+        }
+        stats.transientBytes += memory->size;
+        if (memory->propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            // Lazily allocated memory always gets a dedicated allocation.
+            VkDeviceSize committed = 0;
+            vkGetDeviceMemoryCommitment(device.getDevice(), memory->memory, &committed);
+            stats.committedBytes += committed;
+            stats.lazilyAllocated = true;
+        } else {
+            stats.committedBytes += memory->size;
+        }
+    }
+
+    VkDeviceSize pixels = VkDeviceSize(swapChainExtent.width) * swapChainExtent.height;
+    stats.storedBytesPerFrame = pixels * getTexelSize(swapChainImageFormat);
+    stats.discardedBytesPerFrame = pixels * samples * getTexelSize(depthFormat);
+    if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        stats.discardedBytesPerFrame += pixels * samples * getTexelSize(swapChainImageFormat);
+    }
+    return stats;
+}
+
+void SwapChain::logRenderTargetStats() const {
+    RenderTargetStats stats = getRenderTargetStats();
+    LOG_INFO("Render targets: %ux, %.1f MiB transient (%s), %.1f MiB committed; "
+             "%.1f MiB stored and %.1f MiB kept in tile memory per frame",
+             static_cast<uint32_t>(stats.samples), stats.transientBytes / (1024.0 * 1024.0),
+             stats.lazilyAllocated ? "lazily allocated" : "device local",
+             stats.committedBytes / (1024.0 * 1024.0),
+             stats.storedBytesPerFrame / (1024.0 * 1024.0),
+             stats.discardedBytesPerFrame / (1024.0 * 1024.0));
+}
+
+/*
+ * Returns a fence to pass to the next present to this swapchain through
+ * VkSwapchainPresentFenceInfoEXT, or VK_NULL_HANDLE without present fence
+ * support.
+ */
+VkFence SwapChain::getPresentFence() {
+    if (!device.supportsPresentFence()) {
+        return VK_NULL_HANDLE;
+    }
+    pollPresentFences();
+    VkFence fence;
+    if (!freePresentFences.empty()) {
+        fence = freePresentFences.back();
+        freePresentFences.pop_back();
+    } else {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK(vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &fence));
+    }
+    pendingPresentFences.push_back(fence);
+    return fence;
+}
+
+/*
+ * Recycles the fences of completed presents and returns whether the
+ * presentation engine is done with every present to this swapchain. Always
+ * true without present fence support, where callers have to rely on frame
+ * completion instead.
+ */
+bool SwapChain::pollPresentFences() {
+    for (size_t i = 0; i < pendingPresentFences.size();) {
+        VkFence fence = pendingPresentFences[i];
+        if (vkGetFenceStatus(device.getDevice(), fence) != VK_SUCCESS) {
+            i++;
+            continue;
+        }
+        VK_CHECK(vkResetFences(device.getDevice(), 1, &fence));
+        freePresentFences.push_back(fence);
+        pendingPresentFences[i] = pendingPresentFences.back();
+        pendingPresentFences.pop_back();
+    }
+    return pendingPresentFences.empty();
+}
+
+/*
+ * Duration of one refresh of the display, in nanoseconds.
+ */
+uint64_t SwapChain::getRefreshDuration() const {
+    if (getRefreshCycleDuration == nullptr) {
+        return 0;
+    }
+    VkRefreshCycleDurationGOOGLE refreshCycle{};
+    if (getRefreshCycleDuration(device.getDevice(), swapChain, &refreshCycle) != VK_SUCCESS) {
+        return 0;
+    }
+    return refreshCycle.refreshDuration;
+}
+
+/*
+ * Timings of the presents that reached the display since the last call.
+ * Each is only reported once.
+ */
+std::vector<VkPastPresentationTimingGOOGLE> SwapChain::getPastPresentationTimings() const {
+    std::vector<VkPastPresentationTimingGOOGLE> timings;
+    if (getPastPresentationTiming == nullptr) {
+        return timings;
+    }
+    uint32_t timingCount = 0;
+    if (getPastPresentationTiming(device.getDevice(), swapChain, &timingCount,
+                                  nullptr) != VK_SUCCESS || timingCount == 0) {
+        return timings;
+    }
+    timings.resize(timingCount);
+    VkResult result = getPastPresentationTiming(device.getDevice(), swapChain, &timingCount,
+                                                timings.data());
+    timings.resize(result == VK_SUCCESS || result == VK_INCOMPLETE ? timingCount : 0);
+    return timings;
+}
+
+/*
+ * Attachments handed over to a successor are no longer ours.
+ */
+void SwapChain::destroyTransientResources() {
+    if (depthImage != VK_NULL_HANDLE) {
+        vkDestroyImageView(device.getDevice(), depthImageView, nullptr);
+        vkDestroyImage(device.getDevice(), depthImage, nullptr);
+        allocator.free(depthImageMemory);
+    }
+    if (colorImage != VK_NULL_HANDLE) {
+        vkDestroyImageView(device.getDevice(), colorImageView, nullptr);
+        vkDestroyImage(device.getDevice(), colorImage, nullptr);
+        allocator.free(colorImageMemory);
+    }
 }
 
 SwapChain::~SwapChain() {
-    destroyDepthResources();
+    if (!pendingPresentFences.empty()) {
+        VK_CHECK(vkWaitForFences(device.getDevice(),
+                                 static_cast<uint32_t>(pendingPresentFences.size()),
+                                 pendingPresentFences.data(), VK_TRUE, UINT64_MAX));
+    }
+    pendingPresentFences.insert(pendingPresentFences.end(), freePresentFences.begin(),
+                                freePresentFences.end());
+    for (VkFence fence : pendingPresentFences) {
+        vkDestroyFence(device.getDevice(), fence, nullptr);
+    }
+    destroyTransientResources();
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
         vkDestroyImageView(device.getDevice(), swapChainImageViews[i], nullptr);
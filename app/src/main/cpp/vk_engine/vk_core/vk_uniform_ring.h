@@ -0,0 +1,135 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+/*
+ * UniformRing is a single persistently mapped uniform buffer split into one
+ * region per frame in flight. Each frame suballocates its uniform data from
+ * its own region and binds it through a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+ * descriptor, so any number of objects can share one descriptor set and the
+ * hot path never maps or unmaps memory.
+ *
+ * The buffer's memory comes from the MemoryAllocator, which keeps it
+ * mapped. Host-coherent memory is preferred. When the device only offers
+ * non-coherent host-visible memory, everything written during a frame is
+ * flushed with one vkFlushMappedMemoryRanges call in flush().
+ */
+class UniformRing {
+public:
+    struct Allocation {
+        void *data;
+        uint32_t offset;
+    };
+
+    UniformRing(Device& device, MemoryAllocator& allocator, VkDeviceSize frameCapacity,
+                uint32_t framesInFlight);
+    ~UniformRing();
+
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    VkBuffer getBuffer() const { return buffer; }
+    bool isCoherent() const { return coherent; }
+
+    void beginFrame(uint32_t frameSlot);
+    Allocation allocate(VkDeviceSize size);
+    void flush();
+
+    template <typename T>
+    uint32_t push(const T &value) {
+        Allocation allocation = allocate(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation.offset;
+    }
+
+private:
+    Device& device;
+    MemoryAllocator& allocator;
+
+    VkBuffer buffer;
+    MemoryAllocation allocation;
+    uint8_t *mapped = nullptr;
+    bool coherent = true;
+
+    VkDeviceSize alignment;
+    VkDeviceSize atomSize;
+    VkDeviceSize frameCapacity;
+
+    VkDeviceSize frameBegin = 0;
+    VkDeviceSize frameEnd = 0;
+    VkDeviceSize cursor = 0;
+};
+
+UniformRing::UniformRing(Device &device, MemoryAllocator &allocator, VkDeviceSize frameCapacity,
+                         uint32_t framesInFlight)
+        : device(device), allocator(allocator) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
+    atomSize = properties.limits.nonCoherentAtomSize;
+    alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+
+    // Keeping every region a multiple of the atom size lets flush() cover
+    // whole atoms without spilling into the neighbouring frame's region.
+    this->frameCapacity = alignUp(alignUp(frameCapacity, alignment), atomSize);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = this->frameCapacity * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device.getDevice(), &bufferInfo, nullptr, &buffer));
+
+    allocation = allocator.allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    mapped = static_cast<uint8_t *>(allocation.mapped);
+    coherent = (allocation.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    if (!coherent) {
+        alignment = std::max(alignment, atomSize);
+    }
+}
+
+/*
+ * Rewinds to the start of the frame slot's region. The slot must have been
+ * retired by the FrameScheduler, otherwise the GPU may still read it.
+ */
+void UniformRing::beginFrame(uint32_t frameSlot) {
+    frameBegin = frameSlot * frameCapacity;
+    frameEnd = frameBegin + frameCapacity;
+    cursor = frameBegin;
+}
+
+/*
+ * Returns a pointer to size bytes of mapped memory and the dynamic offset to
+ * bind them with. Allocations are aligned to minUniformBufferOffsetAlignment
+ * (and to nonCoherentAtomSize on non-coherent memory).
+ */
+UniformRing::Allocation UniformRing::allocate(VkDeviceSize size) {
+    VkDeviceSize offset = alignUp(cursor, alignment);
+    if (offset + size > frameEnd) {
+        throw std::runtime_error("Uniform ring frame capacity exceeded!");
+    }
+    cursor = offset + size;
+    return {mapped + offset, static_cast<uint32_t>(offset)};
+}
+
+/*
+ * Makes the frame's writes visible to the device. A no-op on coherent memory.
+ */
+void UniformRing::flush() {
+    if (coherent || cursor == frameBegin) {
+        return;
+    }
+
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = allocation.offset + frameBegin;
+    range.size = std::min(alignUp(cursor - frameBegin, atomSize), frameCapacity);
+    VK_CHECK(vkFlushMappedMemoryRanges(device.getDevice(), 1, &range));
+}
+
+UniformRing::~UniformRing() {
+    vkDestroyBuffer(device.getDevice(), buffer, nullptr);
+    allocator.free(allocation);
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "vk_frustum.h"
+
+#include "glm/gtc/packing.hpp"
+
+/*
+ * Describes how one interleaved vertex binding is laid out in memory and
+ * produces the matching pipeline vertex input state, so the pipeline and the
+ * vertex struct cannot drift apart.
+ */
+class VertexLayout {
+public:
+    explicit VertexLayout(uint32_t stride) : stride(stride) {}
+
+    VertexLayout& add(uint32_t location, VkFormat format, uint32_t offset) {
+        VkVertexInputAttributeDescription attribute{};
+        attribute.location = location;
+        attribute.binding = 0;
+        attribute.format = format;
+        attribute.offset = offset;
+        attributes.push_back(attribute);
+        return *this;
+    }
+
+    uint32_t getStride() const { return stride; }
+
+    /*
+     * The returned struct points into this layout, which has to outlive it.
+     */
+    VkPipelineVertexInputStateCreateInfo getInputState() {
+        binding.binding = 0;
+        binding.stride = stride;
+        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkPipelineVertexInputStateCreateInfo inputState{};
+        inputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        inputState.vertexBindingDescriptionCount = 1;
+        inputState.pVertexBindingDescriptions = &binding;
+        inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+        inputState.pVertexAttributeDescriptions = attributes.data();
+        return inputState;
+    }
+
+private:
+    uint32_t stride;
+    VkVertexInputBindingDescription binding{};
+    std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+/*
+ * Vertex as imported, at full precision. Only the attributes selected by the
+ * VertexFormat a mesh is encoded with reach the GPU.
+ */
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 color;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+/*
+ * Vertex attributes, numbered by their shader input location.
+ */
+enum VertexAttribute : uint32_t {
+    VERTEX_POSITION,
+    VERTEX_COLOR,
+    VERTEX_NORMAL,
+    VERTEX_TEX_COORD,
+    VERTEX_ATTRIBUTE_COUNT
+};
+
+enum class PositionEncoding {
+    Float,
+    // Half floats: exact for small integers, coarser far from the origin.
+    Half,
+    // 16-bit snorm over the mesh bounds, uniform precision across the mesh.
+    Snorm16
+};
+
+/*
+ * Push constants undoing the position encoding in the vertex shader:
+ * position = inPosition * positionScale + positionOffset. Must match
+ * MeshConstants in shader.vert.
+ */
+struct VertexConstants {
+    glm::vec4 positionScale{1.0f, 1.0f, 1.0f, 0.0f};
+    glm::vec4 positionOffset{0.0f};
+};
+
+/*
+ * Describes how vertices are stored for the GPU: which attributes are kept,
+ * interleaved in location order, and how. Packed formats store colours as
+ * 8-bit unorm instead of 32-bit floats. Normals and texture coordinates are
+ * kept as 32-bit floats: no shader reads them yet, so a smaller encoding
+ * would have no measurable effect to weigh its precision loss against.
+ *
+ * Every VkFormat used here supports VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT on
+ * all Vulkan implementations. Three-component 16-bit formats do not, so
+ * quantized positions take four components.
+ */
+struct VertexFormat {
+    uint32_t attributes = (1u << VERTEX_POSITION) | (1u << VERTEX_COLOR);
+    PositionEncoding position = PositionEncoding::Snorm16;
+    bool packed = true;
+
+    static VertexFormat unpacked(uint32_t attributes) {
+        return {attributes, PositionEncoding::Float, false};
+    }
+
+    bool has(VertexAttribute attribute) const { return attributes & (1u << attribute); }
+    bool operator==(const VertexFormat &other) const {
+        return attributes == other.attributes && position == other.position &&
+               packed == other.packed;
+    }
+    bool operator!=(const VertexFormat &other) const { return !(*this == other); }
+    VkFormat getFormat(VertexAttribute attribute) const;
+    uint32_t getSize(VertexAttribute attribute) const;
+    uint32_t getOffset(VertexAttribute attribute) const;
+    uint32_t getStride() const { return getOffset(VERTEX_ATTRIBUTE_COUNT); }
+    VertexLayout getLayout() const;
+};
+
+VkFormat VertexFormat::getFormat(VertexAttribute attribute) const {
+    switch (attribute) {
+        case VERTEX_POSITION:
+            switch (position) {
+                case PositionEncoding::Half:
+                    return VK_FORMAT_R16G16B16A16_SFLOAT;
+                case PositionEncoding::Snorm16:
+                    return VK_FORMAT_R16G16B16A16_SNORM;
+                default:
+                    return VK_FORMAT_R32G32B32_SFLOAT;
+            }
+        case VERTEX_COLOR:
+            return packed ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+        case VERTEX_NORMAL:
+            return VK_FORMAT_R32G32B32_SFLOAT;
+        case VERTEX_TEX_COORD:
+            return VK_FORMAT_R32G32_SFLOAT;
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+uint32_t VertexFormat::getSize(VertexAttribute attribute) const {
+    switch (getFormat(attribute)) {
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Offset of attribute within a vertex, or the stride for
+ * VERTEX_ATTRIBUTE_COUNT. All sizes are multiples of four, which keeps every
+ * attribute aligned.
+ */
+uint32_t VertexFormat::getOffset(VertexAttribute attribute) const {
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < attribute; i++) {
+        if (has(static_cast<VertexAttribute>(i))) {
+            offset += getSize(static_cast<VertexAttribute>(i));
+        }
+    }
+    return offset;
+}
+
+/*
+ * Vertex input state for the pipelines drawing meshes in this format.
+ */
+VertexLayout VertexFormat::getLayout() const {
+    VertexLayout layout(getStride());
+    for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) {
+        auto attribute = static_cast<VertexAttribute>(i);
+        if (has(attribute)) {
+            layout.add(i, getFormat(attribute), getOffset(attribute));
+        }
+    }
+    return layout;
+}
+
+struct EncodedVertices {
+    std::vector<uint8_t> data;
+    VertexConstants constants;
+};
+
+/*
+ * Interleaves the attributes format keeps. Snorm16 positions are stored
+ * relative to the bounds of vertices; the returned constants map them back.
+ */
+EncodedVertices encodeVertices(const VertexFormat &format, const std::vector<Vertex> &vertices) {
+    EncodedVertices encoded;
+    if (format.position == PositionEncoding::Snorm16 && !vertices.empty()) {
+        Aabb bounds = Aabb::empty();
+        for (const auto &vertex : vertices) {
+            bounds.grow(vertex.position);
+        }
+        // Flat meshes still need a non-zero scale on the flat axis.
+        glm::vec3 extent = glm::max(bounds.getExtent(), glm::vec3(1e-6f));
+        encoded.constants.positionScale = glm::vec4(extent, 0.0f);
+        encoded.constants.positionOffset = glm::vec4(bounds.getCenter(), 0.0f);
+    }
+
+    uint32_t stride = format.getStride();
+    glm::vec3 scale = glm::vec3(encoded.constants.positionScale);
+    glm::vec3 offset = glm::vec3(encoded.constants.positionOffset);
+    encoded.data.resize(static_cast<size_t>(stride) * vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex &vertex = vertices[i];
+        uint8_t *out = encoded.data.data() + stride * i;
+
+        if (format.has(VERTEX_POSITION)) {
+            uint8_t *position = out + format.getOffset(VERTEX_POSITION);
+            if (format.position == PositionEncoding::Snorm16) {
+                glm::vec3 normalized = (vertex.position - offset) / scale;
+                uint64_t packed = glm::packSnorm4x16(glm::vec4(normalized, 0.0f));
+                memcpy(position, &packed, sizeof(packed));
+            } else if (format.position == PositionEncoding::Half) {
+                uint64_t packed = glm::packHalf4x16(glm::vec4(vertex.position, 1.0f));
+                memcpy(position, &packed, sizeof(packed));
+            } else {
+                memcpy(position, &vertex.position, sizeof(vertex.position));
+            }
+        }
+        if (format.has(VERTEX_COLOR)) {
+            uint8_t *color = out + format.getOffset(VERTEX_COLOR);
+            if (format.packed) {
+                uint32_t packed = glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f));
+                memcpy(color, &packed, sizeof(packed));
+            } else {
+                memcpy(color, &vertex.color, sizeof(vertex.color));
+            }
+        }
+        if (format.has(VERTEX_NORMAL)) {
+            memcpy(out + format.getOffset(VERTEX_NORMAL), &vertex.normal, sizeof(vertex.normal));
+        }
+        if (format.has(VERTEX_TEX_COORD)) {
+            memcpy(out + format.getOffset(VERTEX_TEX_COORD), &vertex.texCoord,
+                   sizeof(vertex.texCoord));
+        }
+    }
+    return encoded;
+}
+
+/*
+ * Reads vertex index back the way the vertex shader sees it. Attributes the
+ * format drops are left zero.
+ */
+Vertex decodeVertex(const VertexFormat &format, const EncodedVertices &encoded, size_t index) {
+    Vertex vertex{};
+    const uint8_t *in = encoded.data.data() + static_cast<size_t>(format.getStride()) * index;
+
+    if (format.has(VERTEX_POSITION)) {
+        const uint8_t *position = in + format.getOffset(VERTEX_POSITION);
+        if (format.position == PositionEncoding::Float) {
+            memcpy(&vertex.position, position, sizeof(vertex.position));
+        } else {
+            uint64_t packed;
+            memcpy(&packed, position, sizeof(packed));
+            glm::vec4 value = format.position == PositionEncoding::Snorm16
+                              ? glm::unpackSnorm4x16(packed) : glm::unpackHalf4x16(packed);
+            vertex.position = glm::vec3(value) * glm::vec3(encoded.constants.positionScale) +
+                              glm::vec3(encoded.constants.positionOffset);
+        }
+    }
+    if (format.has(VERTEX_COLOR)) {
+        const uint8_t *color = in + format.getOffset(VERTEX_COLOR);
+        if (format.packed) {
+            uint32_t packed;
+            memcpy(&packed, color, sizeof(packed));
+            vertex.color = glm::vec3(glm::unpackUnorm4x8(packed));
+        } else {
+            memcpy(&vertex.color, color, sizeof(vertex.color));
+        }
+    }
+    if (format.has(VERTEX_NORMAL)) {
+        memcpy(&vertex.normal, in + format.getOffset(VERTEX_NORMAL), sizeof(vertex.normal));
+    }
+    if (format.has(VERTEX_TEX_COORD)) {
+        memcpy(&vertex.texCoord, in + format.getOffset(VERTEX_TEX_COORD),
+               sizeof(vertex.texCoord));
+    }
+    return vertex;
+}
+
+/*
+ * Logs the bytes per vertex of format against the same attributes unpacked,
+ * along with the largest error quantizing positions and colours introduced,
+ * measured by decoding them again. This is a size report only: whether the
+ * smaller vertices make drawing any faster depends on whether the GPU was
+ * bound by vertex fetch, which has to be measured on the device.
+ */
+void logVertexSizeReport(const VertexFormat &format, const std::vector<Vertex> &vertices) {
+    VertexFormat reference = VertexFormat::unpacked(format.attributes);
+    EncodedVertices encoded = encodeVertices(format, vertices);
+
+    float positionError = 0.0f;
+    float colorError = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        Vertex decoded = decodeVertex(format, encoded, i);
+        const Vertex &vertex = vertices[i];
+        if (format.has(VERTEX_POSITION)) {
+            positionError = std::max(positionError,
+                                     glm::length(decoded.position - vertex.position));
+        }
+        if (format.has(VERTEX_COLOR)) {
+            colorError = std::max(colorError, glm::length(decoded.color - vertex.color));
+        }
+    }
+
+    size_t bytes = encoded.data.size();
+    size_t referenceBytes = static_cast<size_t>(reference.getStride()) * vertices.size();
+    LOG_INFO("Vertex size: %u bytes/vertex vs %u unpacked, %zu vs %zu bytes for %zu vertices "
+             "(%.0f%% smaller)", format.getStride(), reference.getStride(), bytes,
+             referenceBytes, vertices.size(),
+             referenceBytes ? 100.0 * (1.0 - double(bytes) / double(referenceBytes)) : 0.0);
+    LOG_INFO("Vertex size: max error position %g, colour %g", positionError, colorError);
+}
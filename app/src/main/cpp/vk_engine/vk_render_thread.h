@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "vk_core.h"
+#include "vk_core/vk_lockfree_queue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+
+/*
+ * Lifecycle and input events forwarded from the android_main looper to the
+ * render thread.
+ *
+ * InitWindow carries a window reference acquired by the sender, ownership of
+ * which passes to VKCore once the command is processed. SetPresentProfile
+ * switches to presentProfile, see VKCore::setPresentProfile.
+ */
+struct RenderCommand {
+    enum Type {
+        InitWindow,
+        TermWindow,
+        Destroy,
+        SetPresentProfile
+    };
+
+    Type type = InitWindow;
+    ANativeWindow *window = nullptr;
+    AAssetManager *assetManager = nullptr;
+    const char *dataPath = nullptr;
+    PresentProfile presentProfile = PresentProfile::Throughput;
+};
+
+/*
+ * RenderThread owns every call into VKCore. The looper thread only posts
+ * RenderCommands, so neither lifecycle callbacks nor input bursts can stall a
+ * frame.
+ *
+ * Commands travel through a lock-free queue that the render thread drains
+ * once per frame. The mutex and condition variables below are only used to
+ * park the thread while there is no surface, and to let the looper wait for
+ * commands that must be completed before the callback returns (the window
+ * must no longer be in use once APP_CMD_TERM_WINDOW has been handled).
+ */
+class RenderThread {
+public:
+    explicit RenderThread(VKCore& core) : core(core) {}
+    ~RenderThread();
+
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+
+    void start();
+    void post(const RenderCommand& command);
+    void postAndWait(const RenderCommand& command);
+    void join();
+
+private:
+    VKCore& core;
+    std::thread thread;
+    LockFreeQueue<RenderCommand, 16> commands;
+
+    // Written by the looper thread only.
+    uint64_t postedCount = 0;
+    std::atomic<uint64_t> processedCount{0};
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable processedCondition;
+
+    bool canRender = false;
+
+    void run();
+    bool process(const RenderCommand& command);
+};
+
+void RenderThread::start() {
+    thread = std::thread(&RenderThread::run, this);
+    pthread_setname_np(thread.native_handle(), "yavcp-render");
+}
+
+void RenderThread::post(const RenderCommand& command) {
+    while (!commands.push(command)) {
+        std::this_thread::yield();
+    }
+    postedCount++;
+
+    // Taking the lock orders the push against the render thread's emptiness
+    // check, so a parked thread cannot miss the wake-up.
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeCondition.notify_one();
+}
+
+void RenderThread::postAndWait(const RenderCommand& command) {
+    post(command);
+
+    uint64_t ticket = postedCount;
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    processedCondition.wait(lock, [this, ticket] {
+        return processedCount.load(std::memory_order_acquire) >= ticket;
+    });
+}
+
+void RenderThread::join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void RenderThread::run() {
+    bool running = true;
+    while (running) {
+        RenderCommand command;
+        while (running && commands.pop(command)) {
+            running = process(command);
+
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            processedCount.fetch_add(1, std::memory_order_release);
+            processedCondition.notify_all();
+        }
+
+        if (!running) {
+            break;
+        }
+
+        if (canRender) {
+            core.render();
+        } else {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCondition.wait(lock, [this] { return !commands.empty(); });
+        }
+    }
+}
+
+/*
+ * Returns false once the render thread should exit.
+ */
+bool RenderThread::process(const RenderCommand& command) {
+    switch (command.type) {
+        case RenderCommand::InitWindow:
+            LOG_INFO("Setting a new surface");
+            core.reset(command.window, command.assetManager,
+                       command.dataPath != nullptr ? command.dataPath : "");
+            if (!core.initialized) {
+                LOG_INFO("Starting application");
+                core.initVulkan();
+            }
+            canRender = true;
+            break;
+        case RenderCommand::TermWindow:
+            // Nothing may touch the surface after the looper returns from
+            // APP_CMD_TERM_WINDOW, so drain the GPU before acknowledging.
+            // The app may be killed in the background, so this is also where
+            // the pipeline cache gets persisted.
+            canRender = false;
+            core.waitIdle();
+            core.savePipelineCache();
+            break;
+        case RenderCommand::Destroy:
+            LOG_INFO("Destroying");
+            canRender = false;
+            if (core.initialized) {
+                core.cleanup();
+            }
+            return false;
+        case RenderCommand::SetPresentProfile:
+            core.setPresentProfile(command.presentProfile);
+            break;
+    }
+    return true;
+}
+
+RenderThread::~RenderThread() {
+    join();
+}
@@ -23,7 +23,7 @@
 
 #include <iostream>
 
-#include "vk_engine/vk_core.h"
+#include "vk_engine/vk_render_thread.h"
 
 /*
  * Shared state for the app. This will be accessed within lifecycle callbacks
@@ -32,17 +32,18 @@
  * We store:
  * struct android_app - a pointer to the Android application handle
  *
- * vkt::VKCore - a pointer to our (this) Vulkan application in order to call
- *  the rendering logic
+ * RenderThread - a pointer to the thread running our (this) Vulkan
+ *  application. Lifecycle events are forwarded to it as RenderCommands; the
+ *  looper thread never calls into the Vulkan backend directly.
  *
- * bool canRender - a flag which signals that we are ready to call the vulkan
- * rendering logic
+ * PresentProfile - the present profile last requested, cycled by tapping the
+ *  screen.
  *
  */
 struct VulkanEngine {
   struct android_app *app;
-  VKCore *app_backend;
-  bool canRender = false;
+  RenderThread *render_thread;
+  PresentProfile present_profile = PresentProfile::Throughput;
 };
 
 /**
@@ -53,47 +54,52 @@ static void HandleCmd(struct android_app *app, int32_t cmd) {
   auto *engine = (VulkanEngine *)app->userData;
   switch (cmd) {
     case APP_CMD_START:
-      if (engine->app->window != nullptr) {
-        engine->app_backend->reset(app->window, app->activity->assetManager);
-        engine->app_backend->initVulkan();
-        engine->canRender = true;
-      }
     case APP_CMD_INIT_WINDOW:
       // The window is being shown, get it ready.
       LOG_INFO("Called - APP_CMD_INIT_WINDOW");
       if (engine->app->window != nullptr) {
-        LOG_INFO("Setting a new surface");
-        engine->app_backend->reset(app->window, app->activity->assetManager);
-        if (!engine->app_backend->initialized) {
-          LOG_INFO("Starting application");
-          engine->app_backend->initVulkan();
-        }
-        engine->canRender = true;
+        // The render thread takes over this reference together with the
+        // command, so the window stays valid however long it takes to
+        // process.
+        ANativeWindow_acquire(app->window);
+        RenderCommand command{};
+        command.type = RenderCommand::InitWindow;
+        command.window = app->window;
+        command.assetManager = app->activity->assetManager;
+        command.dataPath = app->activity->internalDataPath;
+        engine->render_thread->post(command);
       }
       break;
-    case APP_CMD_TERM_WINDOW:
-      // The window is being hidden or closed, clean it up.
-      engine->canRender = false;
+    case APP_CMD_TERM_WINDOW: {
+      // The window is being hidden or closed, clean it up. The surface must
+      // be out of use before we return, hence the blocking post.
+      RenderCommand command{};
+      command.type = RenderCommand::TermWindow;
+      engine->render_thread->postAndWait(command);
       break;
-    case APP_CMD_DESTROY:
+    }
+    case APP_CMD_DESTROY: {
       // The window is being hidden or closed, clean it up.
-      LOG_INFO("Destroying");
-      engine->app_backend->cleanup();
+      RenderCommand command{};
+      command.type = RenderCommand::Destroy;
+      engine->render_thread->postAndWait(command);
+      break;
+    }
     default:
       break;
   }
 }
 
 /*
- * Key events filter to GameActivity's android_native_app_glue. This sample does
- * not use/process any input events, return false for all input events so system
- * can still process them.
+ * Key events filter to GameActivity's android_native_app_glue. Key events are
+ * not used, so return false for them and let the system process them. Touch
+ * events are kept for HandleInputEvents.
  */
 extern "C" bool VulkanKeyEventFilter(const GameActivityKeyEvent *event) {
   return false;
 }
 extern "C" bool VulkanMotionEventFilter(const GameActivityMotionEvent *event) {
-  return false;
+  return event->source == AINPUT_SOURCE_TOUCHSCREEN;
 }
 
 /*
@@ -108,10 +114,28 @@ static void HandleInputEvents(struct android_app *app) {
     return;
   }
 
+  // A tap switches to the next present profile, so that their frame times
+  // and latencies can be compared on the device; each switch logs the stats
+  // of the profile left.
+  auto *engine = (VulkanEngine *)app->userData;
+  for (uint64_t i = 0; i < inputBuf->motionEventsCount; i++) {
+    const GameActivityMotionEvent &event = inputBuf->motionEvents[i];
+    if ((event.action & AMOTION_EVENT_ACTION_MASK) != AMOTION_EVENT_ACTION_UP) {
+      continue;
+    }
+    engine->present_profile = static_cast<PresentProfile>(
+        (static_cast<int>(engine->present_profile) + 1) %
+        (static_cast<int>(PresentProfile::PowerSave) + 1));
+    RenderCommand command{};
+    command.type = RenderCommand::SetPresentProfile;
+    command.presentProfile = engine->present_profile;
+    engine->render_thread->post(command);
+  }
+
   // For the minimum, apps need to process the exit event (for example,
-  // listening to AKEYCODE_BACK). This sample has done that in the Kotlin side
-  // and not processing other input events, we just reset the event counter
-  // inside the android_input_buffer to keep app glue code in a working state.
+  // listening to AKEYCODE_BACK). This sample has done that in the Kotlin side,
+  // and after the taps above we reset the event counter inside the
+  // android_input_buffer to keep app glue code in a working state.
   android_app_clear_motion_events(inputBuf);
   android_app_clear_motion_events(inputBuf);
 }
@@ -124,28 +148,32 @@ static void HandleInputEvents(struct android_app *app) {
 void android_main(struct android_app *state) {
   VulkanEngine engine{};
   VKCore vulkanBackend{};
+  RenderThread renderThread(vulkanBackend);
 
   engine.app = state;
-  engine.app_backend = &vulkanBackend;
+  engine.render_thread = &renderThread;
   state->userData = &engine;
   state->onAppCmd = HandleCmd;
 
   android_app_set_key_event_filter(state, VulkanKeyEventFilter);
   android_app_set_motion_event_filter(state, VulkanMotionEventFilter);
 
-  while (true) {
+  renderThread.start();
+
+  // Rendering happens on the render thread, so the looper can block until
+  // the next event arrives.
+  while (!state->destroyRequested) {
     int ident;
     int events;
     android_poll_source *source;
-    while ((ident = ALooper_pollAll(engine.canRender ? 0 : -1, nullptr, &events,
-                                    (void **)&source)) >= 0) {
+    if ((ident = ALooper_pollAll(-1, nullptr, &events, (void **)&source)) >= 0) {
       if (source != nullptr) {
         source->process(state, source);
       }
     }
 
     HandleInputEvents(state);
-
-    engine.app_backend->render();
   }
+
+  renderThread.join();
 }
\ No newline at end of file
@@ -1,5 +1,16 @@
 #version 450
 
+// Interleaved vertex attributes, see VertexFormat. Positions may be
+// quantized; mesh.positionScale and mesh.positionOffset map them back.
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// See VertexConstants, pushed by Mesh::bind.
+layout(push_constant) uniform MeshConstants {
+    vec4 positionScale;
+    vec4 positionOffset;
+} mesh;
+
 // Colour passed to the fragment shader
 layout(location = 0) out vec3 fragColor;
 
@@ -10,45 +21,19 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
-// Define positions for 12 triangles (6 faces) to form a cube
-vec3 positions[36] = vec3[](
-// Front face
-    vec3(-0.5, -0.5,  0.5), vec3( 0.5, -0.5,  0.5), vec3( 0.5,  0.5,  0.5),
-    vec3(-0.5, -0.5,  0.5), vec3( 0.5,  0.5,  0.5), vec3(-0.5,  0.5,  0.5),
-// Back face
-    vec3(-0.5, -0.5, -0.5), vec3(-0.5,  0.5, -0.5), vec3( 0.5,  0.5, -0.5),
-    vec3(-0.5, -0.5, -0.5), vec3( 0.5,  0.5, -0.5), vec3( 0.5, -0.5, -0.5),
-// Top face
-    vec3(-0.5,  0.5, -0.5), vec3(-0.5,  0.5,  0.5), vec3( 0.5,  0.5,  0.5),
-    vec3(-0.5,  0.5, -0.5), vec3( 0.5,  0.5,  0.5), vec3( 0.5,  0.5, -0.5),
-// Bottom face
-    vec3(-0.5, -0.5, -0.5), vec3( 0.5, -0.5, -0.5), vec3( 0.5, -0.5,  0.5),
-    vec3(-0.5, -0.5, -0.5), vec3( 0.5, -0.5,  0.5), vec3(-0.5, -0.5,  0.5),
-// Right face
-    vec3( 0.5, -0.5, -0.5), vec3( 0.5,  0.5, -0.5), vec3( 0.5,  0.5,  0.5),
-    vec3( 0.5, -0.5, -0.5), vec3( 0.5,  0.5,  0.5), vec3( 0.5, -0.5,  0.5),
-// Left face
-    vec3(-0.5, -0.5, -0.5), vec3(-0.5, -0.5,  0.5), vec3(-0.5,  0.5,  0.5),
-    vec3(-0.5, -0.5, -0.5), vec3(-0.5,  0.5,  0.5), vec3(-0.5,  0.5, -0.5)
-);
+// Per-instance transforms, see InstanceBuffer. Placed inside the scene by
+// ubo.model.
+struct InstanceData {
+    mat4 model;
+};
 
-vec3 colors[36] = vec3[](
-// Colors for each face (or you can choose your own scheme)
-    vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), // Front face red
-    vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), // Back face green
-    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0), // Top face blue
-    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, 1.0),
-    vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), // Bottom face yellow
-    vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0),
-    vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0), // Right face cyan
-    vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0),
-    vec3(1.0, 0.0, 1.0), vec3(1.0, 0.0, 1.0), vec3(1.0, 0.0, 1.0), // Left face magenta
-    vec3(1.0, 0.0, 1.0), vec3(1.0, 0.0, 1.0), vec3(1.0, 0.0, 1.0)
-);
+layout(std430, binding = 1) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(positions[gl_VertexIndex], 1.0);
-    fragColor = colors[gl_VertexIndex];
+    mat4 instanceModel = instances[gl_InstanceIndex].model;
+    vec3 position = inPosition * mesh.positionScale.xyz + mesh.positionOffset.xyz;
+    gl_Position = ubo.proj * ubo.view * ubo.model * instanceModel * vec4(position, 1.0);
+    fragColor = inColor;
 }
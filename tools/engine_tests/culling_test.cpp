@@ -0,0 +1,169 @@
+/*
+ * Checks every CPU culling ISA compiled into the host build against the
+ * scalar reference, and the scalar reference against the same tests in
+ * double precision.
+ *
+ * The variants need not agree bit for bit: whether a compiler contracts the
+ * scalar plane distance into fused multiply-adds, and in which order the
+ * SIMD paths add the terms, moves the distance by a few ulps. Objects whose
+ * distance lies within EPSILON of the plane may therefore land either way;
+ * everything else must agree exactly.
+ */
+
+#include "test_check.h"
+
+#include "vk_engine/vk_core/vk_culling.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+
+namespace {
+
+// Far above the rounding error of coordinates around 10, far below the
+// object sizes.
+constexpr double EPSILON = 1e-4;
+
+std::vector<Frustum> makeFrusta() {
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 20.0f);
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+    return {Frustum::fromMatrix(proj * glm::lookAt(glm::vec3(0, 0, 8), glm::vec3(0), up)),
+            Frustum::fromMatrix(proj * glm::lookAt(glm::vec3(3, 4, 5), glm::vec3(0), up)),
+            Frustum::fromMatrix(proj * glm::lookAt(glm::vec3(-1, 0.5f, 0.5f),
+                                                   glm::vec3(2, -1, -3), up))};
+}
+
+// Smallest plane distance of the object, from the side the culling keeps,
+// in double precision; reach is the object's extent towards the plane.
+template<typename Reach>
+double getMargin(const Frustum &frustum, const glm::vec3 &center, Reach reach) {
+    double margin = 1e30;
+    for (const auto &plane : frustum.planes) {
+        double distance = double(plane.x) * center.x + double(plane.y) * center.y +
+                          double(plane.z) * center.z + double(plane.w);
+        margin = std::min(margin, distance + reach(plane));
+    }
+    return margin;
+}
+
+/*
+ * Random spheres through the frustum's surroundings, plus spheres resting
+ * against each plane from the outside, on the boundary of the test.
+ */
+SphereBounds makeSpheres(const Frustum &frustum, std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> size(0.01f, 0.4f);
+    std::vector<glm::vec4> spheres;
+    for (uint32_t i = 0; i < 20000; i++) {
+        spheres.emplace_back(position(random), position(random), position(random), size(random));
+    }
+    for (const auto &plane : frustum.planes) {
+        glm::vec3 normal(plane);
+        for (uint32_t i = 0; i < 500; i++) {
+            glm::vec3 point(position(random), position(random), position(random));
+            // Projected onto the plane, then pushed out by the radius.
+            point -= normal * (glm::dot(normal, point) + plane.w);
+            float radius = size(random);
+            spheres.emplace_back(point - normal * radius, radius);
+        }
+    }
+
+    SphereBounds bounds;
+    bounds.resize(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        bounds.set(static_cast<uint32_t>(i), spheres[i]);
+    }
+    return bounds;
+}
+
+BoxBounds makeBoxes(std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> size(0.01f, 0.3f);
+    BoxBounds bounds;
+    bounds.resize(20000);
+    for (uint32_t i = 0; i < 20000; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extent(size(random), size(random), size(random));
+        bounds.set(i, center - extent, center + extent);
+    }
+    return bounds;
+}
+
+/*
+ * Whether result agrees with expected apart from objects within EPSILON of
+ * a plane, and stays in ascending order.
+ */
+template<typename MarginOf>
+bool agrees(const std::vector<uint32_t> &result, const std::vector<uint32_t> &expected,
+            MarginOf marginOf) {
+    if (!std::is_sorted(result.begin(), result.end())) {
+        return false;
+    }
+    std::vector<uint32_t> differing;
+    std::set_symmetric_difference(result.begin(), result.end(), expected.begin(),
+                                  expected.end(), std::back_inserter(differing));
+    return std::all_of(differing.begin(), differing.end(), [&](uint32_t index) {
+        return std::abs(marginOf(index)) <= EPSILON;
+    });
+}
+
+void testSpheres(const Frustum &frustum, std::mt19937 &random) {
+    SphereBounds spheres = makeSpheres(frustum, random);
+    auto marginOf = [&](uint32_t i) {
+        glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+        return getMargin(frustum, center, [&](const glm::vec4 &) { return spheres.radius[i]; });
+    };
+
+    std::vector<uint32_t> exact;
+    for (uint32_t i = 0; i < spheres.size(); i++) {
+        if (marginOf(i) >= 0.0) {
+            exact.push_back(i);
+        }
+    }
+    std::vector<uint32_t> reference;
+    cullSpheres(frustum, spheres, reference, CullingIsa::Scalar);
+    CHECK(agrees(reference, exact, marginOf));
+
+    for (CullingIsa isa : getCullingIsas()) {
+        std::vector<uint32_t> visible;
+        CHECK(cullSpheres(frustum, spheres, visible, isa) == visible.size());
+        if (!agrees(visible, reference, marginOf)) {
+            std::fprintf(stderr, "%s spheres disagree with scalar\n", getCullingIsaName(isa));
+            CHECK(false);
+        }
+    }
+}
+
+void testBoxes(const Frustum &frustum, std::mt19937 &random) {
+    BoxBounds boxes = makeBoxes(random);
+    auto marginOf = [&](uint32_t i) {
+        glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+        return getMargin(frustum, center, [&](const glm::vec4 &plane) {
+            return std::abs(double(plane.x)) * boxes.extentX[i] +
+                   std::abs(double(plane.y)) * boxes.extentY[i] +
+                   std::abs(double(plane.z)) * boxes.extentZ[i];
+        });
+    };
+
+    std::vector<uint32_t> reference;
+    cullBoxes(frustum, boxes, reference, CullingIsa::Scalar);
+    for (CullingIsa isa : getCullingIsas()) {
+        std::vector<uint32_t> visible;
+        CHECK(cullBoxes(frustum, boxes, visible, isa) == visible.size());
+        if (!agrees(visible, reference, marginOf)) {
+            std::fprintf(stderr, "%s boxes disagree with scalar\n", getCullingIsaName(isa));
+            CHECK(false);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 random(1);
+    for (const Frustum &frustum : makeFrusta()) {
+        testSpheres(frustum, random);
+        testBoxes(frustum, random);
+    }
+    return testResult("culling_test");
+}
@@ -0,0 +1,229 @@
+/*
+ * Runs FramePacer against a simulated FIFO display, fed either with
+ * VK_GOOGLE_display_timing results or with acquire timestamps only.
+ */
+
+#include "test_check.h"
+
+#include "vk_engine/vk_core/vk_frame_pacer.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t REFRESH = FramePacer::DEFAULT_REFRESH_DURATION;
+constexpr uint64_t MS = 1000000;
+// Where the display's vsyncs lie, unknown to the pacer.
+constexpr uint64_t VSYNC_PHASE = 5 * MS;
+// Presents are reported this many frames late, as drivers do.
+constexpr size_t TIMING_DELAY = 2;
+
+uint64_t vsyncAtOrAfter(uint64_t time) {
+    if (time <= VSYNC_PHASE) {
+        return VSYNC_PHASE;
+    }
+    return VSYNC_PHASE + (time - VSYNC_PHASE + REFRESH - 1) / REFRESH * REFRESH;
+}
+
+/*
+ * A render loop presenting to a FIFO swapchain. With display timing, a
+ * present waits for its desiredPresentTime and its actual present time is
+ * reported back; without it, acquires block until the previous frame was
+ * shown, as they do when the swapchain's images are all queued.
+ */
+class Simulation {
+public:
+    explicit Simulation(bool displayTiming) : displayTiming(displayTiming) {}
+
+    FramePacer pacer;
+    std::vector<uint64_t> shown;
+
+    void frame(uint64_t work) {
+        FramePlan plan = pacer.planFrame(now);
+        uint64_t start = std::max(now, plan.wakeTime);
+        if (!displayTiming) {
+            uint64_t acquired = std::max(start, lastShown);
+            pacer.onFrameAcquired(start, acquired);
+            start = acquired;
+        }
+
+        uint64_t ready = start + work;
+        uint64_t shownTime = vsyncAtOrAfter(displayTiming ? std::max(ready, plan.desiredPresentTime)
+                                                          : ready);
+        if (lastShown != 0) {
+            shownTime = std::max(shownTime, lastShown + REFRESH);
+        }
+        lastShown = shownTime;
+        shown.push_back(shownTime);
+
+        pacer.onFrameWork(work);
+        if (displayTiming) {
+            pendingTimings.push_back({plan.desiredPresentTime, shownTime});
+            if (pendingTimings.size() > TIMING_DELAY) {
+                pacer.onPresentTiming(pendingTimings.front().desired,
+                                      pendingTimings.front().actual);
+                pendingTimings.pop_front();
+            }
+        }
+        now = ready;
+    }
+
+    void run(uint32_t frames, uint64_t work) {
+        for (uint32_t i = 0; i < frames; i++) {
+            frame(work);
+        }
+    }
+
+    // Whether the last count frames were each shown interval refreshes
+    // after the one before.
+    bool isSteady(size_t count, uint32_t interval) const {
+        for (size_t i = shown.size() - count; i < shown.size(); i++) {
+            if (shown[i] - shown[i - 1] != interval * REFRESH) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Timing {
+        uint64_t desired;
+        uint64_t actual;
+    };
+
+    bool displayTiming;
+    uint64_t now = 1 * MS;
+    uint64_t lastShown = 0;
+    std::deque<Timing> pendingTimings;
+};
+
+void testLocksToRefreshFractions(bool displayTiming) {
+    Simulation simulation(displayTiming);
+    simulation.run(200, 8 * MS);
+    CHECK(simulation.pacer.getSwapInterval() == 1);
+    CHECK(simulation.isSteady(100, 1));
+
+    // Would alternate between 16 and 33 ms unpaced.
+    for (uint32_t i = 0; i < 300; i++) {
+        simulation.frame(19 * MS + (i % 3) * MS);
+    }
+    CHECK(simulation.pacer.getSwapInterval() == 2);
+    CHECK(simulation.isSteady(200, 2));
+
+    simulation.run(300, 40 * MS);
+    CHECK(simulation.pacer.getSwapInterval() == 3);
+    CHECK(simulation.isSteady(200, 3));
+}
+
+void testStepsBackAfterDownFrames(bool displayTiming) {
+    Simulation simulation(displayTiming);
+    simulation.run(200, 20 * MS);
+    CHECK(simulation.pacer.getSwapInterval() == 2);
+
+    // Fits one refresh, but not comfortably: stays at 30 fps.
+    simulation.run(600, 12 * MS);
+    CHECK(simulation.pacer.getSwapInterval() == 2);
+
+    uint32_t frames = 0;
+    while (simulation.pacer.getSwapInterval() == 2 && frames < 1000) {
+        simulation.frame(6 * MS);
+        frames++;
+    }
+    CHECK(simulation.pacer.getSwapInterval() == 1);
+    CHECK(frames >= FramePacer::DOWN_FRAMES);
+    // Plus the frames it takes the average work to drop below DOWN_LOAD.
+    CHECK(frames <= FramePacer::DOWN_FRAMES + FramePacer::WORK_WINDOW + TIMING_DELAY + 2);
+
+    simulation.run(100, 6 * MS);
+    CHECK(simulation.isSteady(50, 1));
+}
+
+/*
+ * A single miss per MISS_WINDOW presents is tolerated; MISS_LIMIT misses
+ * within one step the interval up.
+ */
+void testMissWindow(bool displayTiming) {
+    FramePacer pacer;
+    uint64_t time = 1000 * MS;
+    auto present = [&](bool missed) {
+        if (displayTiming) {
+            // Desired half a refresh ahead of the vsync it is meant for.
+            pacer.onPresentTiming(time, time + REFRESH / 2 + (missed ? REFRESH : 0));
+        } else {
+            if (missed) {
+                time += REFRESH;
+            }
+            pacer.onFrameAcquired(time, time);
+        }
+        time += REFRESH;
+    };
+
+    for (uint32_t i = 0; i < 30; i++) {
+        present(false);
+    }
+    present(true);
+    for (uint32_t i = 0; i < FramePacer::MISS_WINDOW; i++) {
+        present(false);
+    }
+    present(true);
+    CHECK(pacer.getSwapInterval() == 1);
+    CHECK(pacer.getMissedCount() == 2);
+
+    static_assert(FramePacer::MISS_LIMIT == 2, "the presents below assume two misses");
+    for (uint32_t i = 0; i < FramePacer::MISS_WINDOW - 2; i++) {
+        present(false);
+    }
+    present(true);
+    CHECK(pacer.getSwapInterval() == 2);
+    CHECK(pacer.getMissedCount() == 3);
+}
+
+/*
+ * Without display timing, the predicted vsyncs converge on when blocking
+ * acquires return, even from a first timestamp far off the grid, and are
+ * not dragged along by acquires that did not block.
+ */
+void testVsyncPredictorConverges(uint64_t firstOffset) {
+    constexpr uint64_t ACQUIRE_LATENCY = MS / 5;
+    FramePacer pacer;
+    uint64_t vsync = VSYNC_PHASE + 100 * REFRESH;
+    pacer.onFrameAcquired(vsync, vsync + firstOffset);
+
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < 300; i++) {
+        vsync += REFRESH;
+        // Up to 0.3 ms either way.
+        seed = seed * 1664525u + 1013904223u;
+        int64_t jitter = static_cast<int64_t>(seed >> 8) % 600000 - 300000;
+        if (i % 3 == 0) {
+            // Finds an image free, in the middle of the refresh.
+            uint64_t time = vsync + 6 * MS + jitter;
+            pacer.onFrameAcquired(time, time);
+        } else {
+            pacer.onFrameAcquired(vsync - 2 * MS, vsync + ACQUIRE_LATENCY + jitter);
+        }
+    }
+    CHECK(pacer.getMissedCount() == 0);
+
+    uint64_t expected = vsync + REFRESH + ACQUIRE_LATENCY;
+    uint64_t predicted = pacer.nextVsyncAtOrAfter(expected - REFRESH / 2);
+    uint64_t error = predicted > expected ? predicted - expected : expected - predicted;
+    CHECK(error < MS / 2);
+}
+
+}  // namespace
+
+int main() {
+    for (bool displayTiming : {true, false}) {
+        testLocksToRefreshFractions(displayTiming);
+        testStepsBackAfterDownFrames(displayTiming);
+        testMissWindow(displayTiming);
+    }
+    // Within and well outside the locked band.
+    testVsyncPredictorConverges(3 * MS);
+    testVsyncPredictorConverges(7 * MS);
+    testVsyncPredictorConverges(REFRESH - 3 * MS);
+    return testResult("frame_pacer_test");
+}
@@ -0,0 +1,108 @@
+/*
+ * Checks the CPU reference of the culling shader, countVisibleObjects,
+ * against fixed frusta and instance sets whose outcome is known.
+ */
+
+#include "test_check.h"
+
+#include "vk_engine/vk_core/vk_gpu_object.h"
+
+#include <vector>
+
+namespace {
+
+const glm::vec3 CAMERA(0.0f, 0.0f, 5.0f);
+
+// 90 degrees wide, so the side planes pass 5 units off the axis at z = 0.
+Frustum makeFrustum(const glm::vec3 &target) {
+    glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(CAMERA, target, glm::vec3(0.0f, 1.0f, 0.0f));
+    return Frustum::fromMatrix(proj * view);
+}
+
+GpuObject makeObject(uint32_t instanceIndex, const glm::vec4 &cone = glm::vec4(0.0f)) {
+    return {glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), cone, 36, 0, 0, instanceIndex};
+}
+
+enum Instance { Center, Behind, BeyondFar, Straddling, Outside, ScaledOutside, Stretched };
+
+std::vector<glm::mat4> makeInstances() {
+    glm::mat4 identity(1.0f);
+    std::vector<glm::mat4> models;
+    models.push_back(identity);
+    models.push_back(glm::translate(identity, glm::vec3(0.0f, 0.0f, 10.0f)));
+    models.push_back(glm::translate(identity, glm::vec3(0.0f, 0.0f, -200.0f)));
+    // 0.35 past the left plane, within the unit radius.
+    models.push_back(glm::translate(identity, glm::vec3(-5.5f, 0.0f, 0.0f)));
+    // 2.1 past it.
+    models.push_back(glm::translate(identity, glm::vec3(-8.0f, 0.0f, 0.0f)));
+    models.push_back(glm::scale(glm::translate(identity, glm::vec3(-8.0f, 0.0f, 0.0f)),
+                                glm::vec3(3.0f)));
+    models.push_back(glm::scale(identity, glm::vec3(1.0f, 2.0f, 1.0f)));
+    return models;
+}
+
+uint32_t countVisible(const std::vector<GpuObject> &objects, const Frustum &frustum,
+                      const std::vector<glm::mat4> &models) {
+    return countVisibleObjects(objects, frustum, CAMERA,
+                               [&](uint32_t index) -> const glm::mat4 & {
+                                   return models[index];
+                               });
+}
+
+bool isVisible(const GpuObject &object, const Frustum &frustum,
+               const std::vector<glm::mat4> &models) {
+    return countVisible({object}, frustum, models) == 1;
+}
+
+void testFrustum() {
+    Frustum frustum = makeFrustum(glm::vec3(0.0f));
+    std::vector<glm::mat4> models = makeInstances();
+    CHECK(isVisible(makeObject(Center), frustum, models));
+    CHECK(!isVisible(makeObject(Behind), frustum, models));
+    CHECK(!isVisible(makeObject(BeyondFar), frustum, models));
+    CHECK(isVisible(makeObject(Straddling), frustum, models));
+    CHECK(!isVisible(makeObject(Outside), frustum, models));
+    // The radius grows with the instance's scale.
+    CHECK(isVisible(makeObject(ScaledOutside), frustum, models));
+
+    // Turned around, only the instance behind the camera is left.
+    Frustum behind = makeFrustum(glm::vec3(0.0f, 0.0f, 10.0f));
+    CHECK(isVisible(makeObject(Behind), behind, models));
+    CHECK(!isVisible(makeObject(Center), behind, models));
+}
+
+void testNormalCones() {
+    Frustum frustum = makeFrustum(glm::vec3(0.0f));
+    std::vector<glm::mat4> models = makeInstances();
+    // Triangles within 25 degrees of the axis.
+    glm::vec4 awayFromCamera(0.0f, 0.0f, -1.0f, 0.9f);
+    glm::vec4 towardsCamera(0.0f, 0.0f, 1.0f, 0.9f);
+    CHECK(!isVisible(makeObject(Center, awayFromCamera), frustum, models));
+    CHECK(isVisible(makeObject(Center, towardsCamera), frustum, models));
+    // Non-uniform scale bends normals, so the cone no longer applies.
+    CHECK(isVisible(makeObject(Stretched, awayFromCamera), frustum, models));
+}
+
+void testCounts() {
+    std::vector<glm::mat4> models = makeInstances();
+    std::vector<GpuObject> objects;
+    for (uint32_t instance = Center; instance <= Stretched; instance++) {
+        objects.push_back(makeObject(instance));
+    }
+    objects.push_back(makeObject(Center, glm::vec4(0.0f, 0.0f, -1.0f, 0.9f)));
+
+    // Center, Straddling, ScaledOutside and Stretched.
+    CHECK(countVisible(objects, makeFrustum(glm::vec3(0.0f)), models) == 4);
+    CHECK(countVisible(objects, makeFrustum(glm::vec3(0.0f, 0.0f, 10.0f)), models) == 1);
+    CHECK(countVisible({}, makeFrustum(glm::vec3(0.0f)), models) == 0);
+}
+
+}  // namespace
+
+int main() {
+    testFrustum();
+    testNormalCones();
+    testCounts();
+    return testResult("gpu_culling_test");
+}
@@ -0,0 +1,82 @@
+/*
+ * Writes mesh files, damages them the ways a corrupt or hostile asset could,
+ * and checks that MeshFile::open rejects them.
+ */
+
+#include "test_check.h"
+
+#include "vk_engine/vk_core/vk_mesh_file.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+
+namespace {
+
+MeshData makeQuad() {
+    MeshData mesh;
+    for (glm::vec3 position : {glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 1, 0),
+                               glm::vec3(0, 1, 0)}) {
+        mesh.vertices.push_back({position, glm::vec3(1.0f), glm::vec3(0, 0, 1), glm::vec2(0)});
+    }
+    mesh.indices = {0, 1, 2, 0, 2, 3};
+    Meshlet meshlet{};
+    meshlet.triangleCount = 2;
+    meshlet.vertexCount = 4;
+    mesh.meshlets.push_back(meshlet);
+    return mesh;
+}
+
+template<typename T>
+T* at(std::vector<uint8_t> &file, MeshFileSection section, size_t index = 0) {
+    MeshFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    return reinterpret_cast<T *>(file.data() + header.sections[section].offset) + index;
+}
+
+/*
+ * Writes the quad's file, lets damage change it and opens it again.
+ */
+bool opens(const std::function<void(std::vector<uint8_t> &)> &damage) {
+    std::vector<uint8_t> file = writeMeshFile(makeQuad(), VertexFormat());
+    damage(file);
+
+    const char *directory = std::getenv("TMPDIR");
+    std::string root = directory ? directory : "/tmp";
+    std::ofstream output(root + "/mesh_file_test.mesh", std::ios::binary);
+    output.write(reinterpret_cast<const char *>(file.data()), file.size());
+    output.close();
+    FileSystem fileSystem(root);
+    return static_cast<bool>(MeshFile::open(fileSystem, "mesh_file_test.mesh"));
+}
+
+void testRejectsDamagedFiles() {
+    CHECK(opens([](std::vector<uint8_t> &) {}));
+    CHECK(!opens([](std::vector<uint8_t> &file) { file.resize(file.size() / 2); }));
+
+    // One past the last vertex.
+    CHECK(!opens([](std::vector<uint8_t> &file) {
+        *at<uint16_t>(file, MESH_SECTION_INDICES, 4) = 4;
+    }));
+    CHECK(opens([](std::vector<uint8_t> &file) {
+        *at<uint16_t>(file, MESH_SECTION_INDICES, 4) = 3;
+    }));
+
+    CHECK(!opens([](std::vector<uint8_t> &file) {
+        at<MeshLod>(file, MESH_SECTION_LODS)->indexCount = 7;
+    }));
+    CHECK(!opens([](std::vector<uint8_t> &file) {
+        at<MeshLod>(file, MESH_SECTION_LODS)->firstIndex = UINT32_MAX;
+    }));
+    // Three times the count wraps to 2 in 32 bits.
+    CHECK(!opens([](std::vector<uint8_t> &file) {
+        at<Meshlet>(file, MESH_SECTION_MESHLETS)->triangleCount = 0x55555556;
+    }));
+}
+
+}  // namespace
+
+int main() {
+    testRejectsDamagedFiles();
+    return testResult("mesh_file_test");
+}
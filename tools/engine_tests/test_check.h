@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+
+/*
+ * Minimal checks for the host tests: a failed CHECK reports its location
+ * and makes the test's main return non-zero through testResult().
+ */
+inline int& failedChecks() {
+    static int count = 0;
+    return count;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,           \
+                         #condition);                                                       \
+            failedChecks()++;                                                               \
+        }                                                                                   \
+    } while (false)
+
+inline int testResult(const char *name) {
+    if (failedChecks() != 0) {
+        std::fprintf(stderr, "%s: %d checks failed\n", name, failedChecks());
+        return 1;
+    }
+    std::printf("%s: passed\n", name);
+    return 0;
+}
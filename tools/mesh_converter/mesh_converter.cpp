@@ -0,0 +1,333 @@
+/*
+ * Converts Wavefront OBJ and STL (binary or ASCII) meshes to the engine's
+ * binary mesh format, running the same import steps the engine runs on
+ * generated meshes: level of detail chain, meshlets and triangle and vertex
+ * ordering. The output goes into the APK's assets, e.g.
+ * app/src/main/assets/meshes/cube.mesh, where VKCore picks it up.
+ *
+ * 	mesh_converter [options] <input.obj|input.stl> <output.mesh>
+ *
+ * 	--attributes=position,color,normal,texcoord
+ * 	                      Attributes to store (default position,color).
+ * 	--position=float|half|snorm16
+ * 	                      Position encoding (default snorm16).
+ * 	--unpacked            Store colours as 32-bit floats.
+ * 	--lods=<count>        Levels of detail, including the mesh (default 4).
+ * 	--no-meshlets         Do not build meshlets.
+ */
+
+#include "vk_engine/vk_core/vk_lod.h"
+#include "vk_engine/vk_core/vk_mesh_file.h"
+#include "vk_engine/vk_core/vk_mesh_optimizer.h"
+#include "vk_engine/vk_core/vk_meshlet.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+
+namespace {
+
+struct Options {
+    VertexFormat format;
+    uint32_t lodCount = 4;
+    bool meshlets = true;
+    std::string input;
+    std::string output;
+};
+
+bool endsWith(const std::string &text, const std::string &suffix) {
+    if (text.size() < suffix.size()) {
+        return false;
+    }
+    std::string tail = text.substr(text.size() - suffix.size());
+    for (auto &c : tail) {
+        c = static_cast<char>(tolower(c));
+    }
+    return tail == suffix;
+}
+
+bool readFile(const std::string &path, std::string &contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+/*
+ * Smooth normals for meshes that come without any: every vertex gets the
+ * area-weighted sum of the normals of the triangles around it.
+ */
+void computeNormals(MeshData &mesh) {
+    for (auto &vertex : mesh.vertices) {
+        vertex.normal = glm::vec3(0.0f);
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        Vertex &a = mesh.vertices[mesh.indices[i]];
+        Vertex &b = mesh.vertices[mesh.indices[i + 1]];
+        Vertex &c = mesh.vertices[mesh.indices[i + 2]];
+        glm::vec3 normal = glm::cross(b.position - a.position, c.position - a.position);
+        a.normal += normal;
+        b.normal += normal;
+        c.normal += normal;
+    }
+    for (auto &vertex : mesh.vertices) {
+        float length = glm::length(vertex.normal);
+        vertex.normal = length > 0.0f ? vertex.normal / length : glm::vec3(0.0f);
+    }
+}
+
+/*
+ * Positions with an optional vertex colour ("v x y z r g b"), texture
+ * coordinates, normals and polygonal faces, which are triangulated as fans.
+ * Every distinct position/texture coordinate/normal triple becomes a vertex.
+ */
+bool loadObj(const std::string &contents, MeshData &mesh) {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::map<std::tuple<int, int, int>, uint32_t> vertexIndices;
+
+    // OBJ indices are 1-based, negative ones count back from the end.
+    auto resolve = [](int index, size_t count) {
+        return index < 0 ? static_cast<int>(count) + index : index - 1;
+    };
+
+    std::istringstream lines(contents);
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "v") {
+            glm::vec3 position(0.0f);
+            glm::vec3 color(1.0f);
+            tokens >> position.x >> position.y >> position.z;
+            if (!(tokens >> color.r >> color.g >> color.b)) {
+                color = glm::vec3(1.0f);
+            }
+            positions.push_back(position);
+            colors.push_back(color);
+        } else if (keyword == "vt") {
+            glm::vec2 texCoord(0.0f);
+            tokens >> texCoord.x >> texCoord.y;
+            // OBJ puts v = 0 at the bottom of the image, Vulkan at the top.
+            texCoords.emplace_back(texCoord.x, 1.0f - texCoord.y);
+        } else if (keyword == "vn") {
+            glm::vec3 normal(0.0f);
+            tokens >> normal.x >> normal.y >> normal.z;
+            normals.push_back(normal);
+        } else if (keyword == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (tokens >> corner) {
+                int position = 0;
+                int texCoord = 0;
+                int normal = 0;
+                if (sscanf(corner.c_str(), "%d/%d/%d", &position, &texCoord, &normal) != 3 &&
+                    sscanf(corner.c_str(), "%d//%d", &position, &normal) != 2 &&
+                    sscanf(corner.c_str(), "%d/%d", &position, &texCoord) != 2 &&
+                    sscanf(corner.c_str(), "%d", &position) != 1) {
+                    fprintf(stderr, "line %u: bad face corner '%s'\n", lineNumber,
+                            corner.c_str());
+                    return false;
+                }
+                std::tuple<int, int, int> key(
+                        resolve(position, positions.size()),
+                        texCoord ? resolve(texCoord, texCoords.size()) : -1,
+                        normal ? resolve(normal, normals.size()) : -1);
+                if (std::get<0>(key) < 0 || std::get<0>(key) >= int(positions.size()) ||
+                    std::get<1>(key) >= int(texCoords.size()) ||
+                    std::get<2>(key) >= int(normals.size())) {
+                    fprintf(stderr, "line %u: face index out of range\n", lineNumber);
+                    return false;
+                }
+
+                auto inserted = vertexIndices.emplace(
+                        key, static_cast<uint32_t>(mesh.vertices.size()));
+                if (inserted.second) {
+                    Vertex vertex{};
+                    vertex.position = positions[std::get<0>(key)];
+                    vertex.color = colors[std::get<0>(key)];
+                    if (std::get<1>(key) >= 0) {
+                        vertex.texCoord = texCoords[std::get<1>(key)];
+                    }
+                    if (std::get<2>(key) >= 0) {
+                        vertex.normal = glm::normalize(normals[std::get<2>(key)]);
+                    }
+                    mesh.vertices.push_back(vertex);
+                }
+                face.push_back(inserted.first->second);
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+
+    if (normals.empty()) {
+        computeNormals(mesh);
+    }
+    return true;
+}
+
+/*
+ * STL stores unconnected triangles; equal positions are welded back into
+ * shared vertices and normals smoothed across them.
+ */
+bool loadStl(const std::string &contents, MeshData &mesh) {
+    std::vector<glm::vec3> corners;
+    uint32_t binaryCount = 0;
+    if (contents.size() >= 84) {
+        memcpy(&binaryCount, contents.data() + 80, sizeof(binaryCount));
+    }
+
+    if (contents.size() >= 84 && contents.size() == 84 + size_t(binaryCount) * 50) {
+        for (uint32_t i = 0; i < binaryCount; i++) {
+            // Each record: normal, three corners, attribute byte count.
+            const char *record = contents.data() + 84 + size_t(i) * 50;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                glm::vec3 position;
+                memcpy(&position, record + 12 + corner * 12, sizeof(position));
+                corners.push_back(position);
+            }
+        }
+    } else {
+        std::istringstream tokens(contents);
+        std::string token;
+        while (tokens >> token) {
+            if (token == "vertex") {
+                glm::vec3 position(0.0f);
+                tokens >> position.x >> position.y >> position.z;
+                corners.push_back(position);
+            }
+        }
+        if (corners.empty() || corners.size() % 3 != 0) {
+            fprintf(stderr, "not a binary or ASCII STL file\n");
+            return false;
+        }
+    }
+
+    std::map<std::tuple<float, float, float>, uint32_t> vertexIndices;
+    for (const auto &position : corners) {
+        auto inserted = vertexIndices.emplace(std::make_tuple(position.x, position.y, position.z),
+                                              static_cast<uint32_t>(mesh.vertices.size()));
+        if (inserted.second) {
+            Vertex vertex{};
+            vertex.position = position;
+            vertex.color = glm::vec3(1.0f);
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices.push_back(inserted.first->second);
+    }
+    computeNormals(mesh);
+    return true;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        std::string value = argument.substr(argument.find('=') + 1);
+        if (argument.rfind("--attributes=", 0) == 0) {
+            options.format.attributes = 0;
+            std::istringstream names(value);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                if (name == "position") {
+                    options.format.attributes |= 1u << VERTEX_POSITION;
+                } else if (name == "color") {
+                    options.format.attributes |= 1u << VERTEX_COLOR;
+                } else if (name == "normal") {
+                    options.format.attributes |= 1u << VERTEX_NORMAL;
+                } else if (name == "texcoord") {
+                    options.format.attributes |= 1u << VERTEX_TEX_COORD;
+                } else {
+                    fprintf(stderr, "unknown attribute '%s'\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if (argument.rfind("--position=", 0) == 0) {
+            if (value == "float") {
+                options.format.position = PositionEncoding::Float;
+            } else if (value == "half") {
+                options.format.position = PositionEncoding::Half;
+            } else if (value == "snorm16") {
+                options.format.position = PositionEncoding::Snorm16;
+            } else {
+                fprintf(stderr, "unknown position encoding '%s'\n", value.c_str());
+                return false;
+            }
+        } else if (argument == "--unpacked") {
+            options.format.packed = false;
+        } else if (argument.rfind("--lods=", 0) == 0) {
+            options.lodCount = static_cast<uint32_t>(std::max(atoi(value.c_str()), 1));
+        } else if (argument == "--no-meshlets") {
+            options.meshlets = false;
+        } else if (argument.rfind("--", 0) == 0) {
+            fprintf(stderr, "unknown option '%s'\n", argument.c_str());
+            return false;
+        } else {
+            paths.push_back(argument);
+        }
+    }
+    if (paths.size() != 2) {
+        return false;
+    }
+    options.input = paths[0];
+    options.output = paths[1];
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--attributes=position,color,normal,texcoord] "
+                        "[--position=float|half|snorm16] [--unpacked] [--lods=<count>] "
+                        "[--no-meshlets] <input.obj|input.stl> <output.mesh>\n", argv[0]);
+        return 1;
+    }
+
+    std::string contents;
+    if (!readFile(options.input, contents)) {
+        fprintf(stderr, "cannot read %s\n", options.input.c_str());
+        return 1;
+    }
+    MeshData mesh;
+    bool loaded = endsWith(options.input, ".stl") ? loadStl(contents, mesh)
+                                                  : loadObj(contents, mesh);
+    if (!loaded || mesh.indices.empty()) {
+        fprintf(stderr, "%s: no triangles\n", options.input.c_str());
+        return 1;
+    }
+
+    generateLods(mesh, options.lodCount);
+    if (options.meshlets) {
+        buildMeshlets(mesh);
+    }
+    MeshOptimizationReport report = optimizeMesh(mesh);
+    logMeshOptimizationReport(options.input.c_str(), report);
+    logVertexSizeReport(options.format, mesh.vertices);
+
+    std::vector<uint8_t> file = writeMeshFile(mesh, options.format);
+    std::ofstream output(options.output, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(file.data()), file.size());
+    if (!output) {
+        fprintf(stderr, "cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+    printf("%s: %zu vertices, %zu triangles, %zu levels of detail, %zu meshlets, %zu bytes\n",
+           options.output.c_str(), mesh.vertices.size(), size_t(mesh.lods[0].indexCount / 3),
+           mesh.lods.size(), mesh.meshlets.size(), file.size());
+    return 0;
+}